@@ -52,7 +52,7 @@ static struct
     int enqueue, enqueue_to_temp;
     int mainwin, show_jump_box;
     int headless, quit_after_play;
-    int verbose;
+    int verbose, async_log, trace;
 #if defined(USE_QT) && defined(USE_GTK)
     int gtk;
     int qt;
@@ -90,6 +90,10 @@ static const struct
      N_("Quit on playback stop")},
     {"verbose", 'V', &options.verbose,
      N_("Print debugging messages (may be used twice)")},
+    {"async-log", 'A', &options.async_log,
+     N_("Format log messages on a background thread")},
+    {"trace", 'T', &options.trace,
+     N_("Write a trace of startup and shutdown times")},
 #if defined(USE_QT) && defined(USE_GTK)
     {"gtk", 'G', &options.gtk, N_("Run in GTK mode")},
     {"qt", 'Q', &options.qt, N_("Run in Qt mode")},
@@ -185,6 +189,14 @@ static bool parse_options(int argc, char ** argv)
     else if (options.verbose)
         audlog::set_stderr_level(audlog::Info);
 
+    if (options.async_log)
+        audlog::set_async(true);
+
+    /* AUDACIOUS_TRACE may name the file to write the trace to */
+    const char * trace_file = getenv("AUDACIOUS_TRACE");
+    if (options.trace || trace_file)
+        audtrace::enable((trace_file && trace_file[0]) ? trace_file : nullptr);
+
 #if defined(USE_QT) && defined(USE_GTK)
     if (options.qt && options.gtk)
         fprintf(stderr, "--gtk and --qt are mutually exclusive, ignoring\n");
@@ -326,6 +338,9 @@ static void do_commands()
 
 static void do_commands_at_idle()
 {
+    /* the main loop is running and the interface is up */
+    audtrace::add("startup", nullptr, 0, audtrace::now());
+
     if (options.show_jump_box && !options.headless)
         aud_ui_show_jump_to_song();
     if (options.mainwin && !options.headless)
@@ -334,6 +349,9 @@ static void do_commands_at_idle()
 
 static void main_cleanup()
 {
+    /* stop the logger thread before static destructors run */
+    audlog::set_async(false);
+
     if (initted)
     {
         /* Somebody was naughty and called exit() instead of aud_quit().
@@ -433,6 +451,7 @@ int main(int argc, char ** argv)
 
     if (aud_restart_requested())
     {
+        audlog::set_async(false);
         fprintf(stderr, "Restarting %s ...\n", argv[0]);
 #ifdef _WIN32
         if (exec_argv0() < 0)
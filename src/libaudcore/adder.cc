@@ -24,6 +24,7 @@
 #include <string.h>
 
 #include "audstrings.h"
+#include "cue-cache.h"
 #include "hook.h"
 #include "i18n.h"
 #include "interface.h"
@@ -248,14 +249,31 @@ static void add_playlist(const char * filename, Playlist::FilterFunc filter,
         add_generic(std::move(item), filter, user, result, false, true);
 }
 
-static void add_cuesheets(Index<String> & files, Playlist::FilterFunc filter,
-                          void * user, AddResult * result)
+static int entry_compare(const VFSFolderEntry & a, const VFSFolderEntry & b)
 {
-    Index<String> cuesheets;
+    return filename_compare(a.filename, b.filename);
+}
+
+static int entry_search(const char * key, const VFSFolderEntry & entry)
+{
+    return filename_compare(key, entry.filename);
+}
+
+static int entry_compare_encoded(const VFSFolderEntry & a,
+                                 const VFSFolderEntry & b)
+{
+    return str_compare_encoded(a.filename, b.filename);
+}
+
+static void add_cuesheets(Index<VFSFolderEntry> & files,
+                          Playlist::FilterFunc filter, void * user,
+                          AddResult * result)
+{
+    Index<VFSFolderEntry> cuesheets;
 
     for (int i = 0; i < files.len();)
     {
-        if (str_has_suffix_nocase(files[i], ".cue"))
+        if (str_has_suffix_nocase(files[i].filename, ".cue"))
             cuesheets.move_from(files, i, -1, 1, true, true);
         else
             i++;
@@ -265,31 +283,30 @@ static void add_cuesheets(Index<String> & files, Playlist::FilterFunc filter,
         return;
 
     // sort cuesheet list in natural order
-    cuesheets.sort(str_compare_encoded);
+    cuesheets.sort(entry_compare_encoded);
 
     // sort file list in system-dependent order for duplicate removal
-    files.sort(filename_compare);
+    files.sort(entry_compare);
 
-    for (String & cuesheet : cuesheets)
+    for (VFSFolderEntry & entry : cuesheets)
     {
+        const String & cuesheet = entry.filename;
+
         AUDINFO("Adding cuesheet: %s\n", (const char *)cuesheet);
         status_update(cuesheet, result->items.len());
 
-        String title; // ignored
-        Index<PlaylistAddItem> items;
-
-        if (!playlist_load(cuesheet, title, items))
-            continue;
+        // parsed cuesheets are cached (also across restarts)
+        CueCacheRef cue_cache(cuesheet);
 
         String prev_filename;
-        for (auto & item : items)
+        for (auto & item : cue_cache.load())
         {
             String filename = item.tuple.get_str(Tuple::AudioFile);
             if (!filename)
                 continue; // shouldn't happen
 
             if (!filter || filter(item.filename, user))
-                add_file(std::move(item), filter, user, result, false);
+                add_file(item.copy(), filter, user, result, false);
             else
                 result->filtered = true;
 
@@ -297,7 +314,7 @@ static void add_cuesheets(Index<String> & files, Playlist::FilterFunc filter,
             if (prev_filename && !filename_compare(filename, prev_filename))
                 continue;
 
-            int idx = files.bsearch((const char *)filename, filename_compare);
+            int idx = files.bsearch((const char *)filename, entry_search);
             if (idx >= 0)
                 files.remove(idx, 1);
 
@@ -313,7 +330,7 @@ static void add_folder(const char * filename, Playlist::FilterFunc filter,
     status_update(filename, result->items.len());
 
     String error;
-    Index<String> files = VFSFile::read_folder(filename, error);
+    Index<VFSFolderEntry> files = VFSFile::read_folder_entries(filename, error);
     Index<String> folders;
 
     if (error)
@@ -333,23 +350,20 @@ static void add_folder(const char * filename, Playlist::FilterFunc filter,
     add_cuesheets(files, filter, user, result);
 
     // sort file list in natural order (must come after add_cuesheets)
-    files.sort(str_compare_encoded);
+    files.sort(entry_compare_encoded);
 
-    for (const String & file : files)
+    for (const VFSFolderEntry & entry : files)
     {
+        const String & file = entry.filename;
+
         if (filter && !filter(file, user))
         {
             result->filtered = true;
             continue;
         }
 
-        String error;
-        VFSFileTest mode = VFSFile::test_file(
-            file, VFSFileTest(VFS_IS_REGULAR | VFS_IS_SYMLINK | VFS_IS_DIR),
-            error);
-
-        if (error)
-            AUDERR("%s: %s\n", (const char *)file, (const char *)error);
+        // the entry type comes from the folder listing, without a stat() call
+        VFSFileTest mode = entry.type;
 
         // to prevent infinite recursion, skip symlinks to folders
         if ((mode & (VFS_IS_SYMLINK | VFS_IS_DIR)) ==
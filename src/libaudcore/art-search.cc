@@ -21,18 +21,84 @@
 
 #include <string.h>
 
-#include <glib.h> /* for g_dir_open, g_file_test */
+#include <glib/gstdio.h>
 
 #include "audstrings.h"
 #include "index.h"
+#include "multihash.h"
 #include "runtime.h"
+#include "threads.h"
+#include "vfs.h"
 
-struct SearchParams
+/* Every track of an album usually lives in the same folder, so the result of
+ * searching a folder is cached and shared by all of its tracks.  A cached
+ * result remains valid as long as none of the folders it was built from has
+ * been modified (that is, had files added, removed or renamed). */
+
+/* upper limit on the number of cached folders */
+static constexpr int max_folders = 256;
+
+/* search settings, compiled once each time the config changes */
+struct SearchSettings
 {
-    String filename;
+    String include_str, exclude_str;
     Index<String> include, exclude;
+    bool use_file_cover = false;
+    bool recurse = false;
+    int recurse_depth = 0;
+
+    bool same_config(const SearchSettings & b) const
+    {
+        return include_str == b.include_str && exclude_str == b.exclude_str &&
+               use_file_cover == b.use_file_cover && recurse == b.recurse &&
+               recurse_depth == b.recurse_depth;
+    }
+
+    void compile()
+    {
+        include = str_list_to_index(include_str, ", ");
+        exclude = str_list_to_index(exclude_str, ", ");
+    }
+
+    void copy_from(const SearchSettings & b)
+    {
+        include_str = b.include_str;
+        exclude_str = b.exclude_str;
+        include.clear();
+        include.insert(b.include.begin(), 0, b.include.len());
+        exclude.clear();
+        exclude.insert(b.exclude.begin(), 0, b.exclude.len());
+        use_file_cover = b.use_file_cover;
+        recurse = b.recurse;
+        recurse_depth = b.recurse_depth;
+    }
+};
+
+struct FolderStamp
+{
+    String path;
+    int64_t mtime;
+};
+
+struct CoverImage
+{
+    String uri, name;
+};
+
+struct FolderResult
+{
+    Index<CoverImage> images;  /* candidates for matching by song file name */
+    String cover;              /* result of the search by keywords */
+    Index<FolderStamp> stamps; /* every folder that was read */
+    bool searching = false;    /* another thread is filling in the result */
 };
 
+static aud::mutex mutex;
+static aud::condvar cond;
+static SearchSettings settings;
+static SimpleHash<String, FolderResult> folders;
+static int settings_serial;
+
 static bool has_front_cover_extension(const char * name)
 {
     const char * ext = strrchr(name, '.');
@@ -58,78 +124,125 @@ static bool cover_name_filter(const char * name, const Index<String> & keywords,
     return false;
 }
 
-static String fileinfo_recursive_get_image(const char * path,
-                                           const SearchParams * params,
-                                           int depth)
+static bool get_mtime(const char * path, int64_t & mtime)
 {
-    GDir * d = g_dir_open(path, 0, nullptr);
-    if (!d)
-        return String();
+    GStatBuf st;
+    if (g_stat(path, &st) < 0)
+        return false;
 
-    const char * name;
+    mtime = st.st_mtime;
+    return true;
+}
 
-    if (aud_get_bool("use_file_cover") && !depth)
+static bool is_up_to_date(const FolderResult & result)
+{
+    for (const FolderStamp & stamp : result.stamps)
     {
-        /* Look for images matching file name */
-        while ((name = g_dir_read_name(d)))
-        {
-            StringBuf newpath = filename_build({path, name});
+        int64_t mtime;
+        if (!get_mtime(stamp.path, mtime) || mtime != stamp.mtime)
+            return false;
+    }
 
-            if (has_front_cover_extension(name) &&
-                same_basename(name, params->filename) &&
-                !g_file_test(newpath, G_FILE_TEST_IS_DIR))
-            {
-                g_dir_close(d);
-                return String(newpath);
-            }
-        }
+    return true;
+}
 
-        g_dir_rewind(d);
-    }
+static String fileinfo_recursive_get_image(const char * folder,
+                                           const SearchSettings & params,
+                                           int depth, FolderResult & result)
+{
+    StringBuf path = uri_to_filename(folder);
+    int64_t mtime;
+
+    /* check the folder before reading it, so that changes made in the
+     * meantime are noticed next time */
+    if (path && get_mtime(path, mtime))
+        result.stamps.append(FolderStamp{String(path), mtime});
 
-    /* Search for files using filter */
-    while ((name = g_dir_read_name(d)))
+    /* the entry types come with the listing, so no stat() calls are needed */
+    String error; /* discarded */
+    auto entries = VFSFile::read_folder_entries(folder, error);
+
+    String found;
+
+    for (const VFSFolderEntry & entry : entries)
     {
-        StringBuf newpath = filename_build({path, name});
+        if (entry.type & VFS_IS_DIR)
+            continue;
 
-        if (has_front_cover_extension(name) &&
-            cover_name_filter(name, params->include, true) &&
-            !cover_name_filter(name, params->exclude, false) &&
-            !g_file_test(newpath, G_FILE_TEST_IS_DIR))
-        {
-            g_dir_close(d);
-            return String(newpath);
-        }
+        StringBuf entry_path = uri_to_filename(entry.filename);
+        const char * name =
+            entry_path ? last_path_element(entry_path) : nullptr;
+        if (!name || !has_front_cover_extension(name))
+            continue;
+
+        /* Remember images for matching by song file name */
+        if (params.use_file_cover && !depth)
+            result.images.append(CoverImage{entry.filename, String(name)});
+
+        /* Search for files using filter */
+        if (!found && cover_name_filter(name, params.include, true) &&
+            !cover_name_filter(name, params.exclude, false))
+            found = entry.filename;
     }
 
-    g_dir_rewind(d);
+    if (found)
+        return found;
 
-    if (aud_get_bool("recurse_for_cover") &&
-        depth < aud_get_int("recurse_for_cover_depth"))
+    if (params.recurse && depth < params.recurse_depth)
     {
         /* Descend into directories recursively. */
-        while ((name = g_dir_read_name(d)))
+        for (const VFSFolderEntry & entry : entries)
         {
-            StringBuf newpath = filename_build({path, name});
-
-            if (g_file_test(newpath, G_FILE_TEST_IS_DIR))
+            if (entry.type & VFS_IS_DIR)
             {
-                String tmp =
-                    fileinfo_recursive_get_image(newpath, params, depth + 1);
+                String tmp = fileinfo_recursive_get_image(
+                    entry.filename, params, depth + 1, result);
 
                 if (tmp)
-                {
-                    g_dir_close(d);
                     return tmp;
-                }
             }
         }
     }
 
-    g_dir_close(d);
     return String();
 }
 
+static void update_settings()
+{
+    SearchSettings current;
+    current.include_str = aud_get_str("cover_name_include");
+    current.exclude_str = aud_get_str("cover_name_exclude");
+    current.use_file_cover = aud_get_bool("use_file_cover");
+    current.recurse = aud_get_bool("recurse_for_cover");
+    current.recurse_depth = aud_get_int("recurse_for_cover_depth");
+
+    if (settings_serial && settings.same_config(current))
+        return;
+
+    current.compile();
+    settings = std::move(current);
+    settings_serial++;
+
+    /* results found with the old settings are no longer valid */
+    folders.clear();
+}
+
+static String find_in_result(const FolderResult & result,
+                             const SearchSettings & params, const char * elem)
+{
+    if (params.use_file_cover)
+    {
+        /* Look for images matching file name */
+        for (const CoverImage & image : result.images)
+        {
+            if (same_basename(image.name, elem))
+                return image.uri;
+        }
+    }
+
+    return result.cover;
+}
+
 String art_search(const char * filename)
 {
     StringBuf local = uri_to_filename(filename);
@@ -140,14 +253,72 @@ String art_search(const char * filename)
     if (!elem)
         return String();
 
-    String include = aud_get_str("cover_name_include");
-    String exclude = aud_get_str("cover_name_exclude");
+    String name(elem);
+    cut_path_element(local, elem - local);
+    String folder(filename_to_uri(local));
 
-    SearchParams params = {String(elem), str_list_to_index(include, ", "),
-                           str_list_to_index(exclude, ", ")};
+    auto mh = mutex.take();
 
-    cut_path_element(local, elem - local);
+    update_settings();
+
+    FolderResult * result;
+    while ((result = folders.lookup(folder)))
+    {
+        if (!result->searching)
+        {
+            if (is_up_to_date(*result))
+                return find_in_result(*result, settings, name);
+
+            folders.remove(folder);
+            break;
+        }
+
+        /* wait for the other thread rather than reading the folder twice */
+        cond.wait(mh);
+    }
+
+    if (folders.n_items() >= max_folders)
+    {
+        /* simply start over, keeping only searches in progress */
+        Index<String> stale;
+        folders.iterate([&](const String & key, FolderResult & entry) {
+            if (!entry.searching)
+                stale.append(key);
+        });
+
+        for (const String & key : stale)
+            folders.remove(key);
+    }
 
-    String image_local = fileinfo_recursive_get_image(local, &params, 0);
-    return image_local ? String(filename_to_uri(image_local)) : String();
+    FolderResult placeholder;
+    placeholder.searching = true;
+    folders.add(folder, std::move(placeholder));
+
+    SearchSettings params;
+    params.copy_from(settings);
+    int serial = settings_serial;
+
+    mh.unlock();
+
+    FolderResult found;
+    found.cover = fileinfo_recursive_get_image(folder, params, 0, found);
+    String image = find_in_result(found, params, name);
+
+    mh.lock();
+
+    /* if the settings changed in the meantime, our placeholder is gone */
+    if (settings_serial == serial)
+        folders.add(folder, std::move(found));
+
+    cond.notify_all();
+
+    return image;
+}
+
+void art_search_cleanup()
+{
+    auto mh = mutex.take();
+    folders.clear();
+    settings = SearchSettings();
+    settings_serial = 0;
 }
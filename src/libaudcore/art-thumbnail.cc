@@ -0,0 +1,517 @@
+/*
+ * art-thumbnail.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Album art thumbnails, so that views showing many covers at once (album grids
+ * and the like) never decode or scale an image in the UI thread.  Thumbnails
+ * are created by background workers, which read the art the same way as the
+ * scanner does and pass it to the scale function registered by the interface
+ * library.  Finished thumbnails are kept in two tiers:
+ *
+ *  - in memory, as decoded pixels, up to a byte budget, dropping the least
+ *    recently used thumbnails first;
+ *  - on disk (for local files only), as raw pixels tagged with the song file's
+ *    modification time, so that they survive restarts but not file changes.
+ *    The disk cache is trimmed to its budget at exit, oldest files first. */
+
+#include "internal.h"
+#include "probe.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <thread>
+
+#include <glib.h> /* for g_get_user_cache_dir */
+#include <glib/gstdio.h>
+
+#include "audstrings.h"
+#include "hook.h"
+#include "mainloop.h"
+#include "multihash.h"
+#include "runtime.h"
+#include "scanner.h"
+#include "threads.h"
+#include "vfs.h"
+
+static constexpr int n_workers = 2;
+
+/* rough per-thumbnail overhead, so that thumbnails of songs without album art
+ * count against the memory budget as well */
+static constexpr int entry_overhead = 256;
+
+/* header of a thumbnail file on disk; followed by the key (not terminated)
+ * and then the pixels */
+struct DiskHeader
+{
+    char magic[8];
+    int32_t width, height;
+    int64_t mtime;
+    int32_t key_len;
+};
+
+static const char disk_magic[8] = "AUDTHM1";
+
+struct CachedThumbnail
+{
+    AudArtThumbnail thumb;
+    int64_t last_used;
+};
+
+struct ThumbnailJob
+{
+    String file;
+    int size;
+    String key;
+};
+
+static aud::mutex mutex;
+static aud::condvar cond;
+static std::thread workers[n_workers];
+static bool workers_running, quit;
+
+static AudArtScaleFunc scale_func;
+static int active_scales; /* workers calling a copy of scale_func */
+
+static SimpleHash<String, CachedThumbnail> memory_tier;
+static int64_t memory_bytes, use_serial;
+
+static Index<ThumbnailJob> jobs; /* most recent request last */
+static Index<String> pending;    /* keys of queued or running jobs */
+static Index<String> ready;      /* files to announce in the main thread */
+static QueuedFunc queued_ready;
+
+static String make_key(const char * file, int size)
+{
+    return String(str_printf("%d:%s", size, file));
+}
+
+static StringBuf get_cache_dir()
+{
+    return filename_build({g_get_user_cache_dir(), "audacious", "thumbnails"});
+}
+
+static StringBuf get_disk_path(const String & key)
+{
+    return filename_build(
+        {get_cache_dir(), str_printf("%08x.thumb", key.hash())});
+}
+
+static int64_t get_bytes(const AudArtThumbnail & thumb)
+{
+    return thumb.pixels.len() + entry_overhead;
+}
+
+/* only local song files can be validated against the disk cache */
+static bool get_mtime(const char * file, int64_t & mtime)
+{
+    StringBuf path = uri_to_filename(strip_subtune(file));
+    GStatBuf st;
+
+    if (!path || g_stat(path, &st) < 0)
+        return false;
+
+    mtime = st.st_mtime;
+    return true;
+}
+
+/* the file is not trusted to be intact, so the size must be within the one
+ * requested */
+static bool read_disk(const String & key, int64_t mtime, int size,
+                      AudArtThumbnail & thumb)
+{
+    FILE * handle = g_fopen(get_disk_path(key), "rb");
+    if (!handle)
+        return false;
+
+    DiskHeader header;
+    bool valid = (fread(&header, sizeof header, 1, handle) == 1 &&
+                  !memcmp(header.magic, disk_magic, sizeof disk_magic) &&
+                  header.mtime == mtime && header.width > 0 &&
+                  header.width <= size && header.height > 0 &&
+                  header.height <= size &&
+                  header.key_len == (int)strlen(key));
+
+    /* different keys may share a file name, so check the key as well */
+    if (valid)
+    {
+        StringBuf stored(header.key_len);
+        valid = (fread(stored, 1, header.key_len, handle) ==
+                     (size_t)header.key_len &&
+                 !strcmp(stored, key));
+    }
+
+    if (valid)
+    {
+        int64_t len = (int64_t)4 * header.width * header.height;
+        thumb.pixels.resize(len);
+        valid = (fread(thumb.pixels.begin(), 1, len, handle) == (size_t)len);
+    }
+
+    fclose(handle);
+
+    if (!valid)
+        return false;
+
+    thumb.width = header.width;
+    thumb.height = header.height;
+    return true;
+}
+
+static void write_disk(const String & key, int64_t mtime,
+                       const AudArtThumbnail & thumb)
+{
+    StringBuf dir = get_cache_dir();
+    if (g_mkdir_with_parents(dir, 0700) < 0)
+    {
+        AUDERR("Error creating %s: %s\n", (const char *)dir, strerror(errno));
+        return;
+    }
+
+    StringBuf path = get_disk_path(key);
+    StringBuf temp = str_concat({path, ".XXXXXX"});
+
+    int fd = g_mkstemp(temp);
+    FILE * handle = (fd < 0) ? nullptr : fdopen(fd, "wb");
+
+    if (!handle)
+    {
+        AUDERR("Error creating %s: %s\n", (const char *)temp, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    DiskHeader header{};
+    memcpy(header.magic, disk_magic, sizeof disk_magic);
+    header.width = thumb.width;
+    header.height = thumb.height;
+    header.mtime = mtime;
+    header.key_len = strlen(key);
+
+    bool success =
+        (fwrite(&header, sizeof header, 1, handle) == 1 &&
+         fwrite(key, 1, header.key_len, handle) == (size_t)header.key_len &&
+         fwrite(thumb.pixels.begin(), 1, thumb.pixels.len(), handle) ==
+             (size_t)thumb.pixels.len());
+
+    if (fclose(handle) < 0)
+        success = false;
+
+    /* replace any existing file atomically */
+    if (!success || g_rename(temp, path) < 0)
+    {
+        AUDERR("Error writing %s: %s\n", (const char *)path, strerror(errno));
+        g_unlink(temp);
+    }
+}
+
+/* deletes the oldest thumbnails until the disk cache fits its budget */
+static void trim_disk()
+{
+    int64_t limit = (int64_t)aud_get_int("art_thumbnail_disk_size") << 20;
+
+    String error;
+    auto entries = VFSFile::read_folder_entries(
+        filename_to_uri(get_cache_dir()), error, true);
+
+    int64_t total = 0;
+    for (auto & entry : entries)
+        total += entry.size;
+
+    if (total <= limit)
+        return;
+
+    entries.sort([](const VFSFolderEntry & a, const VFSFolderEntry & b) {
+        return (a.mtime > b.mtime) - (a.mtime < b.mtime);
+    });
+
+    for (auto & entry : entries)
+    {
+        if (total <= limit)
+            break;
+
+        StringBuf path = uri_to_filename(entry.filename);
+        if (path && g_unlink(path) == 0)
+            total -= entry.size;
+    }
+}
+
+static void trim_memory()
+{
+    int64_t limit = (int64_t)aud_get_int("art_thumbnail_cache_size") << 20;
+
+    while (memory_bytes > limit)
+    {
+        const String * oldest = nullptr;
+        int64_t oldest_used = 0;
+
+        memory_tier.iterate([&](const String & key, CachedThumbnail & cached) {
+            if (!oldest || cached.last_used < oldest_used)
+            {
+                oldest = &key;
+                oldest_used = cached.last_used;
+            }
+        });
+
+        if (!oldest)
+            break;
+
+        String key = *oldest;
+        memory_bytes -= get_bytes(memory_tier.lookup(key)->thumb);
+        memory_tier.remove(key);
+    }
+}
+
+static void send_ready()
+{
+    auto mh = mutex.take();
+    auto files = std::move(ready);
+    mh.unlock();
+
+    for (const String & file : files)
+        hook_call("art thumbnail ready", (void *)(const char *)file);
+}
+
+static void scan_callback(ScanRequest *) {}
+
+/* reads the album art of a song the same way as a playback scan */
+static Index<char> load_image(const String & file)
+{
+    ScanRequest request(file, SCAN_IMAGE, scan_callback);
+    request.run();
+
+    if (!request.image_data.len() && request.image_file)
+    {
+        VFSFile image_file(request.image_file, "r");
+        if (image_file)
+            return image_file.read_all();
+    }
+
+    return std::move(request.image_data);
+}
+
+/* only the call itself is counted, so that unregistering does not wait for
+ * file reads */
+static AudArtThumbnail scale_image(const Index<char> & image, int size)
+{
+    auto mh = mutex.take();
+
+    AudArtScaleFunc func = scale_func;
+    if (!func)
+        return AudArtThumbnail();
+
+    active_scales++;
+    mh.unlock();
+
+    AudArtThumbnail thumb = func(image, size);
+
+    mh.lock();
+
+    /* wake aud_art_set_scale_func() */
+    active_scales--;
+    cond.notify_all();
+
+    return thumb;
+}
+
+static AudArtThumbnail make_thumbnail(const ThumbnailJob & job)
+{
+    AudArtThumbnail thumb;
+
+    int64_t mtime;
+    bool local = get_mtime(job.file, mtime);
+
+    if (local && read_disk(job.key, mtime, job.size, thumb))
+        return thumb;
+
+    Index<char> image = load_image(job.file);
+    if (image.len())
+        thumb = scale_image(image, job.size);
+
+    if (thumb.width < 1 || thumb.height < 1 ||
+        thumb.pixels.len() != (int64_t)4 * thumb.width * thumb.height)
+        return AudArtThumbnail();
+
+    if (local)
+        write_disk(job.key, mtime, thumb);
+
+    return thumb;
+}
+
+static void worker()
+{
+    auto mh = mutex.take();
+
+    while (!quit)
+    {
+        if (!jobs.len() || !scale_func)
+        {
+            cond.wait(mh);
+            continue;
+        }
+
+        ThumbnailJob job = std::move(jobs[jobs.len() - 1]);
+        jobs.remove(jobs.len() - 1, 1);
+
+        mh.unlock();
+
+        AudArtThumbnail thumb = make_thumbnail(job);
+
+        mh.lock();
+
+        pending.remove(pending.find(job.key), 1);
+
+        if (quit)
+            break;
+
+        /* unregistered while loading; the thumbnail may be missing */
+        if (!scale_func)
+            continue;
+
+        memory_bytes += get_bytes(thumb);
+        memory_tier.add(job.key, {std::move(thumb), ++use_serial});
+        trim_memory();
+
+        if (!ready.len())
+            queued_ready.queue(send_ready);
+
+        ready.append(std::move(job.file));
+    }
+}
+
+EXPORT void aud_art_set_scale_func(AudArtScaleFunc func)
+{
+    auto mh = mutex.take();
+    scale_func = func;
+    cond.notify_all();
+
+    /* the old function may belong to a library about to be unloaded */
+    while (active_scales)
+        cond.wait(mh);
+}
+
+EXPORT void aud_art_unset_scale_func(AudArtScaleFunc func)
+{
+    auto mh = mutex.take();
+
+    /* another interface library may have taken over in the meantime */
+    if (scale_func == func)
+        scale_func = nullptr;
+
+    while (active_scales)
+        cond.wait(mh);
+}
+
+EXPORT AudArtThumbnail aud_art_request_thumbnail(const char * file, int size,
+                                                 bool * queued)
+{
+    AudArtThumbnail thumb;
+
+    if (queued)
+        *queued = false;
+
+    // blacklist stdin
+    if (size < 1 || !strncmp(file, "stdin://", 8))
+        return thumb;
+
+    auto mh = mutex.take();
+
+    if (!scale_func || quit)
+        return thumb;
+
+    String key = make_key(file, size);
+    CachedThumbnail * cached = memory_tier.lookup(key);
+
+    if (cached)
+    {
+        cached->last_used = ++use_serial;
+        thumb.width = cached->thumb.width;
+        thumb.height = cached->thumb.height;
+        thumb.pixels.insert(cached->thumb.pixels.begin(), 0,
+                            cached->thumb.pixels.len());
+        return thumb;
+    }
+
+    if (pending.find(key) < 0)
+    {
+        pending.append(key);
+        jobs.append(ThumbnailJob{String(file), size, key});
+    }
+    else
+    {
+        /* move a waiting request to the front of the line */
+        for (int i = 0; i < jobs.len(); i++)
+        {
+            if (jobs[i].key == key)
+            {
+                ThumbnailJob job = std::move(jobs[i]);
+                jobs.remove(i, 1);
+                jobs.append(std::move(job));
+                break;
+            }
+        }
+    }
+
+    if (!workers_running)
+    {
+        for (std::thread & thread : workers)
+            thread = std::thread(worker);
+
+        workers_running = true;
+    }
+
+    cond.notify_one();
+
+    if (queued)
+        *queued = true;
+
+    return thumb;
+}
+
+void art_thumbnail_cleanup()
+{
+    auto mh = mutex.take();
+
+    quit = true;
+    cond.notify_all();
+
+    if (workers_running)
+    {
+        mh.unlock();
+
+        for (std::thread & thread : workers)
+            thread.join();
+
+        mh.lock();
+        workers_running = false;
+    }
+
+    queued_ready.stop();
+
+    jobs.clear();
+    pending.clear();
+    ready.clear();
+    memory_tier.clear();
+    memory_bytes = 0;
+
+    mh.unlock();
+
+    trim_disk();
+}
@@ -130,23 +130,20 @@ EXPORT StringBuf str_copy(const char * s, int len)
 
 EXPORT StringBuf str_concat(const std::initializer_list<const char *> & strings)
 {
-    StringBuf str(-1);
+    int total = 0;
+    for (const char * s : strings)
+        total += strlen(s);
+
+    StringBuf str(total);
     char * set = str;
-    int left = str.len();
 
     for (const char * s : strings)
     {
         int len = strlen(s);
-        if (len > left)
-            throw std::bad_alloc();
-
         memcpy(set, s, len);
-
         set += len;
-        left -= len;
     }
 
-    str.resize(set - str);
     return str;
 }
 
@@ -169,19 +166,31 @@ EXPORT void str_append_printf(StringBuf & str, const char * format, ...)
 
 EXPORT StringBuf str_vprintf(const char * format, va_list args)
 {
-    StringBuf str(-1);
-    int len = vsnprintf(str, str.len(), format, args);
-    str.resize(len);
+    StringBuf str;
+    str_append_vprintf(str, format, args);
     return str;
 }
 
 EXPORT void str_append_vprintf(StringBuf & str, const char * format,
                                va_list args)
 {
+    va_list args2;
+    va_copy(args2, args);
+
     int len0 = str.len();
     str.resize(-1);
     int len1 = vsnprintf(str + len0, str.len() - len0, format, args);
-    str.resize(len0 + len1);
+
+    /* output was truncated; the stack can grow, so try again */
+    if (len1 >= str.len() - len0)
+    {
+        str.resize(len0 + len1);
+        vsnprintf(str + len0, len1 + 1, format, args2);
+    }
+    else
+        str.resize(len0 + len1);
+
+    va_end(args2);
 }
 
 EXPORT bool str_has_prefix_nocase(const char * str, const char * prefix)
@@ -985,32 +994,28 @@ EXPORT Index<String> str_list_to_index(const char * list, const char * delims)
 EXPORT StringBuf index_to_str_list(const Index<String> & index,
                                    const char * sep)
 {
-    StringBuf str(-1);
-    char * set = str;
-    int left = str.len();
     int seplen = strlen(sep);
+    int total = 0;
 
     for (const String & s : index)
-    {
-        int len = strlen(s);
-        if (len + seplen > left)
-            throw std::bad_alloc();
+        total += (total ? seplen : 0) + strlen(s);
+
+    StringBuf str(total);
+    char * set = str;
 
+    for (const String & s : index)
+    {
         if (set > str)
         {
             memcpy(set, sep, seplen);
-
             set += seplen;
-            left -= seplen;
         }
 
+        int len = strlen(s);
         memcpy(set, s, len);
-
         set += len;
-        left -= len;
     }
 
-    str.resize(set - str);
     return str;
 }
 
@@ -75,6 +75,9 @@ void str_replace_char(char * string, char old_c, char new_c);
 StringBuf str_decode_percent(const char * str, int len = -1);
 StringBuf str_encode_percent(const char * str, int len = -1);
 
+/* same result as g_utf8_validate(), but faster for mostly-ASCII strings */
+bool str_is_utf8(const char * str, int len = -1);
+
 StringBuf str_convert(const char * str, int len, const char * from_charset,
                       const char * to_charset);
 StringBuf str_from_locale(const char * str, int len = -1);
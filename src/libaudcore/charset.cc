@@ -22,8 +22,11 @@
 
 #include <errno.h>
 #include <iconv.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <string.h>
 
+#include <mutex>
 #include <new>
 
 #include <glib.h>
@@ -35,10 +38,106 @@
 #include "runtime.h"
 #include "threads.h"
 
+/* Opening an iconv descriptor loads the conversion tables each time, which
+ * costs far more than converting a short tag string.  Each thread therefore
+ * keeps the most recently used descriptors open (including failed ones, so
+ * that an unknown fallback charset is not looked up again for every string). */
+static constexpr int N_CONVERTERS = 8;
+static constexpr int MAX_CHARSET_NAME = 32;
+
+struct Converter
+{
+    char from[MAX_CHARSET_NAME], to[MAX_CHARSET_NAME];
+    iconv_t conv;
+};
+
+struct ConverterCache
+{
+    Converter slots[N_CONVERTERS]; /* most recently used first */
+    int count;
+};
+
+static pthread_key_t conv_key;
+static std::once_flag conv_once;
+
+static void free_converters(void * cache_)
+{
+    auto cache = (ConverterCache *)cache_;
+    if (!cache)
+        return;
+
+    for (int i = 0; i < cache->count; i++)
+    {
+        if (cache->slots[i].conv != (iconv_t)-1)
+            iconv_close(cache->slots[i].conv);
+    }
+
+    delete cache;
+}
+
+static void make_conv_key() { pthread_key_create(&conv_key, free_converters); }
+
+/* returns a descriptor owned by the cache, or (if the names are too long to be
+ * cached) a new one that the caller must close */
+static iconv_t get_converter(const char * from, const char * to, bool & cached)
+{
+    cached = (strlen(from) < MAX_CHARSET_NAME && strlen(to) < MAX_CHARSET_NAME);
+    if (!cached)
+        return iconv_open(to, from);
+
+    std::call_once(conv_once, make_conv_key);
+
+    auto cache = (ConverterCache *)pthread_getspecific(conv_key);
+
+    if (!cache)
+    {
+        cache = new ConverterCache();
+        pthread_setspecific(conv_key, cache);
+    }
+
+    Converter * slots = cache->slots;
+    int i = 0;
+
+    while (i < cache->count &&
+           (strcmp(slots[i].from, from) || strcmp(slots[i].to, to)))
+        i++;
+
+    Converter found;
+
+    if (i < cache->count)
+        found = slots[i];
+    else
+    {
+        strcpy(found.from, from);
+        strcpy(found.to, to);
+        found.conv = iconv_open(to, from);
+
+        /* drop the least recently used descriptor */
+        if (cache->count == N_CONVERTERS)
+        {
+            i = N_CONVERTERS - 1;
+            if (slots[i].conv != (iconv_t)-1)
+                iconv_close(slots[i].conv);
+        }
+        else
+            i = cache->count++;
+    }
+
+    memmove(slots + 1, slots, sizeof(Converter) * i);
+    slots[0] = found;
+
+    /* discard any shift state left over from the last conversion */
+    if (found.conv != (iconv_t)-1)
+        iconv(found.conv, nullptr, nullptr, nullptr, nullptr);
+
+    return found.conv;
+}
+
 EXPORT StringBuf str_convert(const char * str, int len,
                              const char * from_charset, const char * to_charset)
 {
-    iconv_t conv = iconv_open(to_charset, from_charset);
+    bool cached;
+    iconv_t conv = get_converter(from_charset, to_charset, cached);
     if (conv == (iconv_t)-1)
         return StringBuf();
 
@@ -55,11 +154,12 @@ EXPORT StringBuf str_convert(const char * str, int len,
     errno = 0;
     size_t ret = iconv(conv, &in, &inbytesleft, &out, &outbytesleft);
 
+    if (!cached)
+        iconv_close(conv);
+
     if (ret == (size_t)-1 && errno == E2BIG)
         throw std::bad_alloc();
 
-    iconv_close(conv);
-
     if (ret == (size_t)-1 || inbytesleft)
         return StringBuf();
 
@@ -67,6 +167,91 @@ EXPORT StringBuf str_convert(const char * str, int len,
     return buf;
 }
 
+/* Tag strings are mostly ASCII, so runs of ASCII are checked eight bytes at a
+ * time; only the bytes of multi-byte sequences are checked one by one.  The
+ * result is the same as from g_utf8_validate(), which goes byte by byte. */
+EXPORT bool str_is_utf8(const char * str, int len)
+{
+    constexpr uint64_t ones = 0x0101010101010101;
+    constexpr uint64_t highs = 0x8080808080808080;
+
+    if (len < 0)
+        len = strlen(str);
+
+    auto s = (const unsigned char *)str;
+    auto end = s + len;
+
+    while (s < end)
+    {
+        if (end - s >= 8)
+        {
+            uint64_t word;
+            memcpy(&word, s, 8);
+
+            /* no byte has the high bit set or is zero? */
+            if (!((word | ((word - ones) & ~word)) & highs))
+            {
+                s += 8;
+                continue;
+            }
+
+            /* skip to the first byte that does; it is one of these eight */
+            while (*s && *s < 0x80)
+                s++;
+        }
+
+        unsigned c = *s;
+
+        if (c < 0x80)
+        {
+            if (!c)
+                return false;
+
+            s++;
+            continue;
+        }
+
+        /* the allowed range of the second byte excludes overlong forms,
+         * surrogates, and values beyond U+10FFFF (see RFC 3629) */
+        int extra;
+        unsigned lo = 0x80, hi = 0xbf;
+
+        if (c >= 0xc2 && c <= 0xdf)
+            extra = 1;
+        else if (c >= 0xe0 && c <= 0xef)
+        {
+            extra = 2;
+            if (c == 0xe0)
+                lo = 0xa0;
+            else if (c == 0xed)
+                hi = 0x9f;
+        }
+        else if (c >= 0xf0 && c <= 0xf4)
+        {
+            extra = 3;
+            if (c == 0xf0)
+                lo = 0x90;
+            else if (c == 0xf4)
+                hi = 0x8f;
+        }
+        else
+            return false;
+
+        if (end - s <= extra || s[1] < lo || s[1] > hi)
+            return false;
+
+        for (int i = 2; i <= extra; i++)
+        {
+            if ((s[i] & 0xc0) != 0x80)
+                return false;
+        }
+
+        s += 1 + extra;
+    }
+
+    return true;
+}
+
 static void whine_locale(const char * str, int len, const char * dir,
                          const char * charset)
 {
@@ -84,7 +269,7 @@ EXPORT StringBuf str_from_locale(const char * str, int len)
     if (g_get_charset(&charset))
     {
         /* locale is UTF-8 */
-        if (!g_utf8_validate(str, len, nullptr))
+        if (!str_is_utf8(str, len))
         {
             whine_locale(str, len, "from", "UTF-8");
             return StringBuf();
@@ -172,7 +357,7 @@ static StringBuf convert_to_utf8(const char * str, int len)
 EXPORT StringBuf str_to_utf8(const char * str, int len)
 {
     /* check whether already UTF-8 */
-    if (g_utf8_validate(str, len, nullptr))
+    if (str_is_utf8(str, len))
         return str_copy(str, len);
 
     return convert_to_utf8(str, len);
@@ -181,7 +366,7 @@ EXPORT StringBuf str_to_utf8(const char * str, int len)
 EXPORT StringBuf str_to_utf8(StringBuf && str)
 {
     /* check whether already UTF-8 */
-    if (g_utf8_validate(str, str.len(), nullptr))
+    if (str_is_utf8(str, str.len()))
         return std::move(str);
 
     str = convert_to_utf8(str, str.len());
@@ -23,14 +23,19 @@
 #include <assert.h>
 #include <string.h>
 
+#include <thread>
+
+#include <glib/gstdio.h>
+
 #include "audstrings.h"
 #include "hook.h"
 #include "inifile.h"
 #include "multihash.h"
 #include "runtime.h"
+#include "threads.h"
 #include "vfs.h"
 
-#define DEFAULT_SECTION "audacious"
+static const char default_section[] = "audacious";
 
 static const char * const core_defaults[] = {
     /* clang-format off */
@@ -52,6 +57,8 @@ static const char * const core_defaults[] = {
     "equalizer_preamp", "0",
 
     /* info popup / info window */
+    "art_thumbnail_cache_size", "32",
+    "art_thumbnail_disk_size", "256",
     "cover_name_exclude", "back",
     "cover_name_include", "album,cover,front,folder",
     "filepopup_delay", "5",
@@ -73,12 +80,18 @@ static const char * const core_defaults[] = {
     "default_gain", "0",
     "enable_replay_gain", "TRUE",
     "enable_clipping_prevention", "TRUE",
+    "loudness_analysis", "FALSE",
+    "loudness_max_speed", "10",
+    "loudness_threads", "2",
     "output_bit_depth", "-1",
     "output_buffer_size", "500",
     "record", "FALSE",
     "record_stream", aud::numeric_string<(int) OutputStream::AfterReplayGain>::str,
     "replay_gain_mode", aud::numeric_string<(int) ReplayGainMode::Track>::str,
     "replay_gain_preamp", "0",
+    "resample_output", "FALSE",
+    "resample_quality", aud::numeric_string<(int) ResampleQuality::High>::str,
+    "resample_rate", "0",
     "soft_clipping", "FALSE",
     "software_volume_control", "FALSE",
     "sw_volume_left", "100",
@@ -88,6 +101,9 @@ static const char * const core_defaults[] = {
     /* playback */
     "album_shuffle", "FALSE",
     "no_playlist_advance", "FALSE",
+    "prefetch_cache_size", "64",
+    "prefetch_size", "4",
+    "prefetch_tracks", "2",
     "repeat", "FALSE",
     "shuffle", "FALSE",
     "step_size", "5",
@@ -100,6 +116,8 @@ static const char * const core_defaults[] = {
 #else
     "convert_backslash", "FALSE",
 #endif
+    "cue_cache_disk_size", "32",
+    "cue_cache_size", "64",
     "export_relative_paths", "TRUE",
     "folders_in_playlist", "FALSE",
     "generic_title_format", "${?artist:${artist} - }${?album:${album} - }${title}",
@@ -109,6 +127,7 @@ static const char * const core_defaults[] = {
     "metadata_on_play", "FALSE",
     "show_numbers_in_pl", "FALSE",
     "slow_probe", "FALSE",
+    "tag_padding", "16384",
     /* clang-format on */
     nullptr};
 
@@ -116,17 +135,37 @@ enum OpType
 {
     OP_IS_DEFAULT,
     OP_GET,
+    OP_GET_TYPED, /* like OP_GET, but without copying the string */
     OP_SET,
     OP_SET_NO_FLAG,
     OP_CLEAR,
     OP_CLEAR_NO_FLAG
 };
 
+/* A value is kept in string form (as written to the config file and returned
+ * by aud_get_str) and also converted to each of the other types once when it
+ * is set, so that aud_get_int() etc. do not parse it again on every call. */
+struct ConfigValue
+{
+    String str;
+    int int_val = 0;
+    double double_val = 0;
+    bool bool_val = false;
+
+    ConfigValue() {}
+
+    explicit ConfigValue(String && value)
+        : str(std::move(value)), int_val(str_to_int(str)),
+          double_val(str_to_double(str)), bool_val(!strcmp(str, "TRUE"))
+    {
+    }
+};
+
 struct ConfigItem
 {
     String section;
     String key;
-    String value;
+    ConfigValue value;
 };
 
 struct ConfigNode;
@@ -137,7 +176,7 @@ struct ConfigOp
     OpType type;
     const char * section;
     const char * key;
-    String value;
+    ConfigValue value;
     unsigned hash;
     bool result;
 
@@ -163,7 +202,7 @@ ConfigNode * ConfigOp::add(const ConfigOp *)
     switch (type)
     {
     case OP_IS_DEFAULT:
-        result = !value[0]; /* empty string is default */
+        result = !value.str[0]; /* empty string is default */
         return nullptr;
 
     case OP_SET:
@@ -190,15 +229,23 @@ bool ConfigOp::found(ConfigNode * node)
     switch (type)
     {
     case OP_IS_DEFAULT:
-        result = !strcmp(node->value, value);
+        result = !strcmp(node->value.str, value.str);
         return false;
 
     case OP_GET:
         value = node->value;
+        result = true;
+        return false;
+
+    case OP_GET_TYPED:
+        value.int_val = node->value.int_val;
+        value.double_val = node->value.double_val;
+        value.bool_val = node->value.bool_val;
+        result = true;
         return false;
 
     case OP_SET:
-        result = !!strcmp(node->value, value);
+        result = (node->value.str != value.str);
         if (result)
             s_modified = true;
         // fall-through
@@ -223,8 +270,13 @@ bool ConfigOp::found(ConfigNode * node)
 
 static bool config_op_run(ConfigOp & op, ConfigTable & table)
 {
+    /* nearly all lookups are in the default section */
+    static const unsigned default_hash = str_calc_hash(default_section);
+
     if (!op.hash)
-        op.hash = str_calc_hash(op.section) + str_calc_hash(op.key);
+        op.hash = ((op.section == default_section) ? default_hash
+                                                   : str_calc_hash(op.section)) +
+                  str_calc_hash(op.key);
 
     op.result = false;
     table.lookup(&op, op.hash, op);
@@ -243,7 +295,7 @@ private:
         if (!section)
             return;
 
-        ConfigOp op = {OP_SET_NO_FLAG, section, key, String(value)};
+        ConfigOp op = {OP_SET_NO_FLAG, section, key, ConfigValue(String(value))};
         config_op_run(op, s_config);
     }
 };
@@ -282,6 +334,86 @@ void config_load()
     }
 }
 
+/* The config file is written by a background thread, from a snapshot taken
+ * in config_save(), so that autosaving does not block the main thread on
+ * disk I/O.  Only the newest snapshot is written if several are pending. */
+static aud::mutex saver_mutex;
+static aud::condvar saver_cond;
+static std::thread saver_thread;
+static Index<ConfigItem> saver_pending;
+static bool saver_has_pending, saver_quit;
+
+static bool write_items(const char * filename, const Index<ConfigItem> & list)
+{
+    VFSFile file(filename, "w");
+    if (!file)
+        return false;
+
+    String current_heading;
+
+    for (const ConfigItem & item : list)
+    {
+        if (item.section != current_heading)
+        {
+            if (!inifile_write_heading(file, item.section))
+                return false;
+
+            current_heading = item.section;
+        }
+
+        if (!inifile_write_entry(file, item.key, item.value.str))
+            return false;
+    }
+
+    return file.fflush() == 0;
+}
+
+static void write_config(const Index<ConfigItem> & list)
+{
+    StringBuf path = filename_build({aud_get_path(AudPath::UserDir), "config"});
+    StringBuf temp = str_concat({path, ".tmp"});
+
+    /* replace the old file atomically */
+    if (!write_items(temp, list) || g_rename(temp, path) < 0)
+    {
+        AUDWARN("Error saving configuration.\n");
+        g_unlink(temp);
+    }
+}
+
+static void saver_run()
+{
+    auto mh = saver_mutex.take();
+
+    while (1)
+    {
+        if (!saver_has_pending)
+        {
+            if (saver_quit)
+                break;
+
+            saver_cond.wait(mh);
+            continue;
+        }
+
+        auto list = std::move(saver_pending);
+        saver_has_pending = false;
+        mh.unlock();
+
+        list.sort([](const ConfigItem & a, const ConfigItem & b) {
+            if (a.section == b.section)
+                return strcmp(a.key, b.key);
+            else
+                return strcmp(a.section, b.section);
+        });
+
+        write_config(list);
+
+        mh.lock();
+        saver_cond.notify_all(); /* for config_cleanup() */
+    }
+}
+
 void config_save()
 {
     if (!s_modified)
@@ -299,48 +431,25 @@ void config_save()
 
     s_config.iterate(add_to_list, finish);
 
-    list.sort([](const ConfigItem & a, const ConfigItem & b) {
-        if (a.section == b.section)
-            return strcmp(a.key, b.key);
-        else
-            return strcmp(a.section, b.section);
-    });
-
-    String current_heading;
+    auto mh = saver_mutex.take();
 
-    VFSFile file(filename_build({aud_get_path(AudPath::UserDir), "config"}),
-                 "w");
-    if (!file)
-        goto FAILED;
+    saver_pending = std::move(list);
+    saver_has_pending = true;
 
-    for (const ConfigItem & item : list)
+    if (!saver_thread.joinable())
     {
-        if (item.section != current_heading)
-        {
-            if (!inifile_write_heading(file, item.section))
-                goto FAILED;
-
-            current_heading = item.section;
-        }
-
-        if (!inifile_write_entry(file, item.key, item.value))
-            goto FAILED;
+        saver_quit = false;
+        saver_thread = std::thread(saver_run);
     }
 
-    if (file.fflush() < 0)
-        goto FAILED;
-
-    return;
-
-FAILED:
-    AUDWARN("Error saving configuration.\n");
+    saver_cond.notify_all();
 }
 
 EXPORT void aud_config_set_defaults(const char * section,
                                     const char * const * entries)
 {
     if (!section)
-        section = DEFAULT_SECTION;
+        section = default_section;
 
     while (1)
     {
@@ -349,44 +458,86 @@ EXPORT void aud_config_set_defaults(const char * section,
         if (!name || !value)
             break;
 
-        ConfigOp op = {OP_SET_NO_FLAG, section, name, String(value)};
+        ConfigOp op = {OP_SET_NO_FLAG, section, name,
+                       ConfigValue(String(value))};
         config_op_run(op, s_defaults);
     }
 }
 
 void config_cleanup()
 {
+    /* waits for any pending snapshot to be written */
+    auto mh = saver_mutex.take();
+    saver_quit = true;
+    saver_cond.notify_all();
+    mh.unlock();
+
+    if (saver_thread.joinable())
+        saver_thread.join();
+
     s_config.clear();
     s_defaults.clear();
 }
 
+/* sets one value and returns true if it was changed */
+static bool set_str(const char * section, const char * name,
+                    const char * value)
+{
+    ConfigOp op = {OP_IS_DEFAULT, section ? section : default_section, name,
+                   ConfigValue(String(value))};
+    bool is_default = config_op_run(op, s_defaults);
+
+    op.type = is_default ? OP_CLEAR : OP_SET;
+    return config_op_run(op, s_config);
+}
+
 EXPORT void aud_set_str(const char * section, const char * name,
                         const char * value)
 {
     assert(name && value);
 
-    ConfigOp op = {OP_IS_DEFAULT, section ? section : DEFAULT_SECTION, name,
-                   String(value)};
-    bool is_default = config_op_run(op, s_defaults);
+    if (set_str(section, name, value) && !section)
+        event_queue(str_concat({"set ", name}), nullptr);
+}
 
-    op.type = is_default ? OP_CLEAR : OP_SET;
-    bool changed = config_op_run(op, s_config);
+EXPORT void aud_set_strs(const char * section, const char * const * entries)
+{
+    auto changed = new Index<String>;
 
-    if (changed && !section)
-        event_queue(str_concat({"set ", name}), nullptr);
+    while (1)
+    {
+        const char * name = *entries++;
+        const char * value = *entries++;
+        if (!name || !value)
+            break;
+
+        if (set_str(section, name, value))
+            changed->append(String(name));
+    }
+
+    if (changed->len() && !section)
+        event_queue("set", changed, aud::delete_obj<Index<String>>);
+    else
+        delete changed;
 }
 
-EXPORT String aud_get_str(const char * section, const char * name)
+static ConfigOp get_value(const char * section, const char * name,
+                          OpType type)
 {
     assert(name);
 
-    ConfigOp op = {OP_GET, section ? section : DEFAULT_SECTION, name};
-    config_op_run(op, s_config);
+    ConfigOp op = {type, section ? section : default_section, name};
 
-    if (!op.value)
+    if (!config_op_run(op, s_config))
         config_op_run(op, s_defaults);
 
-    return op.value ? op.value : String("");
+    return op;
+}
+
+EXPORT String aud_get_str(const char * section, const char * name)
+{
+    ConfigOp op = get_value(section, name, OP_GET);
+    return op.value.str ? op.value.str : String("");
 }
 
 EXPORT void aud_set_bool(const char * section, const char * name, bool value)
@@ -396,7 +547,7 @@ EXPORT void aud_set_bool(const char * section, const char * name, bool value)
 
 EXPORT bool aud_get_bool(const char * section, const char * name)
 {
-    return !strcmp(aud_get_str(section, name), "TRUE");
+    return get_value(section, name, OP_GET_TYPED).value.bool_val;
 }
 
 EXPORT void aud_toggle_bool(const char * section, const char * name)
@@ -412,7 +563,7 @@ EXPORT void aud_set_int(const char * section, const char * name, int value)
 
 EXPORT int aud_get_int(const char * section, const char * name)
 {
-    return str_to_int(aud_get_str(section, name));
+    return get_value(section, name, OP_GET_TYPED).value.int_val;
 }
 
 EXPORT void aud_set_double(const char * section, const char * name,
@@ -423,5 +574,5 @@ EXPORT void aud_set_double(const char * section, const char * name,
 
 EXPORT double aud_get_double(const char * section, const char * name)
 {
-    return str_to_double(aud_get_str(section, name));
+    return get_value(section, name, OP_GET_TYPED).value.double_val;
 }
@@ -17,10 +17,40 @@
  * the use of this software.
  */
 
+/* Parsed cuesheets are cached in two tiers.  In memory, a cuesheet stays
+ * loaded while any scan request refers to it and for some time afterward,
+ * up to "cue_cache_size" cuesheets (least recently used out first).  On disk,
+ * the items of each local cuesheet are saved in a small text file tagged with
+ * the cuesheet's modification time, so that they survive restarts but not
+ * changes to the cuesheet.  The disk cache is trimmed to "cue_cache_disk_size"
+ * at exit, least recently used first. */
+
+#define __STDC_FORMAT_MACROS
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h> /* for g_get_user_cache_dir */
+#include <glib/gstdio.h>
+
 #include "cue-cache.h"
+#include "audstrings.h"
+#include "internal.h"
 #include "multihash.h"
+#include "parse.h"
 #include "playlist-internal.h"
+#include "plugins.h"
+#include "runtime.h"
 #include "threads.h"
+#include "vfs.h"
+
+#define FORMAT 1
+
+/* values longer than this are not saved, since TextParser could not read
+ * them back in one piece */
+static constexpr int max_value_len = 480;
 
 enum NodeState
 {
@@ -34,12 +64,304 @@ struct CueCacheNode
     Index<PlaylistAddItem> items;
     NodeState state = NotLoaded;
     int refcount = 0;
+    int64_t mtime = -1; /* -1 if not a local file or not loaded successfully */
+    int64_t last_used = 0;
 };
 
 static SimpleHash<String, CueCacheNode> cache;
 static aud::mutex mutex;
 static aud::condvar cond;
 
+static CueCacheStats stats;
+static int64_t use_serial;
+
+static StringBuf get_cache_dir()
+{
+    return filename_build({g_get_user_cache_dir(), "audacious", "cuesheets"});
+}
+
+static StringBuf get_disk_path(const String & filename)
+{
+    return filename_build(
+        {get_cache_dir(), str_printf("%08x.cue", filename.hash())});
+}
+
+static int64_t get_mtime(const char * filename)
+{
+    StringBuf path = uri_to_filename(filename);
+    GStatBuf st;
+
+    if (!path || g_stat(path, &st) < 0)
+        return -1;
+
+    return st.st_mtime;
+}
+
+static bool read_disk(const String & filename, int64_t mtime,
+                      Index<PlaylistAddItem> & items)
+{
+    StringBuf path = get_disk_path(filename);
+    FILE * handle = g_fopen(path, "r");
+    if (!handle)
+        return false;
+
+    TextParser parser(handle);
+
+    int format;
+    bool valid = parser.get_int("format", format) && format == FORMAT;
+
+    /* different cuesheets may share a file name, so check the URI as well */
+    if (valid)
+    {
+        parser.next();
+        String uri = parser.get_str("uri");
+        valid = uri && !strcmp(uri, filename);
+    }
+
+    if (valid)
+    {
+        parser.next();
+        String stamp = parser.get_str("stamp");
+        valid = stamp && strtoll(stamp, nullptr, 10) == mtime;
+    }
+
+    if (valid)
+        parser.next();
+
+    while (valid && !parser.eof())
+    {
+        String item_filename = parser.get_str("item");
+        if (!item_filename)
+        {
+            valid = false;
+            break;
+        }
+
+        PlaylistAddItem item{item_filename, Tuple(), nullptr};
+        int state = Tuple::Initial;
+
+        for (parser.next(); !parser.eof() && !parser.get_str("item");
+             parser.next())
+        {
+            String decoder = parser.get_str("decoder");
+            if (decoder)
+            {
+                item.decoder = aud_plugin_lookup_basename(decoder);
+                continue;
+            }
+
+            if (parser.get_int("state", state))
+                continue;
+
+            auto field = Tuple::field_by_name(parser.key());
+            if (field < 0)
+            {
+                valid = false;
+                break;
+            }
+
+            String value = parser.get_str(parser.key());
+            if (Tuple::field_get_type(field) == Tuple::Int)
+                item.tuple.set_int(field, atoi(value));
+            else
+                item.tuple.set_str(field, str_decode_percent(value));
+        }
+
+        item.tuple.set_state((Tuple::State)state);
+        items.append(std::move(item));
+    }
+
+    fclose(handle);
+
+    if (!valid)
+    {
+        items.clear();
+        return false;
+    }
+
+    /* the file's modification time serves as the last use time */
+    g_utime(path, nullptr);
+    return true;
+}
+
+static bool save_item(FILE * handle, const PlaylistAddItem & item)
+{
+    const Tuple & tuple = item.tuple;
+
+    /* subtune arrays are not saved; cuesheets do not have them */
+    if (strlen(item.filename) > max_value_len || tuple.get_n_subtunes())
+        return false;
+
+    fprintf(handle, "item %s\n", (const char *)item.filename);
+
+    if (item.decoder)
+        fprintf(handle, "decoder %s\n", aud_plugin_get_basename(item.decoder));
+
+    fprintf(handle, "state %d\n", (int)tuple.state());
+
+    for (auto field : Tuple::all_fields())
+    {
+        switch (tuple.get_value_type(field))
+        {
+        case Tuple::Int:
+            fprintf(handle, "%s %d\n", Tuple::field_get_name(field),
+                    tuple.get_int(field));
+            break;
+
+        case Tuple::String:
+        {
+            StringBuf value = str_encode_percent(tuple.get_str(field));
+            if (value.len() > max_value_len)
+                return false;
+
+            fprintf(handle, "%s %s\n", Tuple::field_get_name(field),
+                    (const char *)value);
+            break;
+        }
+
+        default:
+            break;
+        }
+    }
+
+    return true;
+}
+
+static void write_disk(const String & filename, int64_t mtime,
+                       const Index<PlaylistAddItem> & items)
+{
+    if (strlen(filename) > max_value_len)
+        return;
+
+    StringBuf dir = get_cache_dir();
+    if (g_mkdir_with_parents(dir, 0700) < 0)
+    {
+        AUDERR("Error creating %s: %s\n", (const char *)dir, strerror(errno));
+        return;
+    }
+
+    StringBuf path = get_disk_path(filename);
+    StringBuf temp = str_concat({path, ".XXXXXX"});
+
+    int fd = g_mkstemp(temp);
+    FILE * handle = (fd < 0) ? nullptr : fdopen(fd, "w");
+
+    if (!handle)
+    {
+        AUDERR("Error creating %s: %s\n", (const char *)temp, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    fprintf(handle, "format %d\n", FORMAT);
+    fprintf(handle, "uri %s\n", (const char *)filename);
+    fprintf(handle, "stamp %" PRId64 "\n", mtime);
+
+    bool success = true;
+    for (auto & item : items)
+    {
+        if (!(success = save_item(handle, item)))
+            break;
+    }
+
+    if (fclose(handle) < 0)
+        success = false;
+
+    /* replace any existing file atomically */
+    if (!success || g_rename(temp, path) < 0)
+    {
+        if (success)
+            AUDERR("Error writing %s: %s\n", (const char *)path,
+                   strerror(errno));
+
+        g_unlink(temp);
+    }
+}
+
+/* deletes the least recently used files until the disk cache fits its budget */
+static void trim_disk()
+{
+    int64_t limit = (int64_t)aud_get_int("cue_cache_disk_size") << 20;
+
+    String error;
+    auto entries = VFSFile::read_folder_entries(
+        filename_to_uri(get_cache_dir()), error, true);
+
+    int64_t total = 0;
+    for (auto & entry : entries)
+        total += entry.size;
+
+    if (total <= limit)
+        return;
+
+    entries.sort([](const VFSFolderEntry & a, const VFSFolderEntry & b) {
+        return (a.mtime > b.mtime) - (a.mtime < b.mtime);
+    });
+
+    for (auto & entry : entries)
+    {
+        if (total <= limit)
+            break;
+
+        StringBuf path = uri_to_filename(entry.filename);
+        if (path && g_unlink(path) == 0)
+            total -= entry.size;
+    }
+}
+
+/* drops the least recently used cuesheets not in use until the memory cache
+ * fits its budget */
+static void trim_memory()
+{
+    int limit = aud::max(0, aud_get_int("cue_cache_size"));
+
+    while (true)
+    {
+        const String * oldest = nullptr;
+        int64_t oldest_used = 0;
+        int unused = 0;
+
+        cache.iterate([&](const String & filename, CueCacheNode & node) {
+            if (node.refcount)
+                return;
+
+            unused++;
+            if (!oldest || node.last_used < oldest_used)
+            {
+                oldest = &filename;
+                oldest_used = node.last_used;
+            }
+        });
+
+        if (unused <= limit)
+            break;
+
+        cache.remove(String(*oldest));
+        stats.evictions++;
+    }
+}
+
+/* returns true if the items were found in the disk cache */
+static bool load_items(const String & filename, CueCacheNode * node,
+                       int64_t mtime)
+{
+    if (mtime >= 0 && read_disk(filename, mtime, node->items))
+    {
+        node->mtime = mtime;
+        return true;
+    }
+
+    String title; // not used
+    if (playlist_load(filename, title, node->items) && mtime >= 0)
+    {
+        write_disk(filename, mtime, node->items);
+        node->mtime = mtime;
+    }
+
+    return false;
+}
+
 CueCacheRef::CueCacheRef(const char * filename) : m_filename(filename)
 {
     auto mh = mutex.take();
@@ -56,14 +378,34 @@ CueCacheRef::~CueCacheRef()
     auto mh = mutex.take();
 
     m_node->refcount--;
-    if (!m_node->refcount)
+    if (m_node->refcount)
+        return;
+
+    /* keep only cuesheets that can be checked for changes */
+    if (m_node->state == Loaded && m_node->mtime >= 0)
+    {
+        m_node->last_used = ++use_serial;
+        trim_memory();
+    }
+    else
         cache.remove(m_filename);
 }
 
 const Index<PlaylistAddItem> & CueCacheRef::load()
 {
+    int64_t mtime = get_mtime(m_filename);
+    bool from_disk;
     auto mh = mutex.take();
-    String title; // not used
+
+    /* a cuesheet that has changed is reloaded, unless it is still in use
+     * elsewhere; the items must not change while others are reading them */
+    if (m_node->state == Loaded && m_node->mtime != mtime &&
+        m_node->refcount == 1)
+    {
+        m_node->items.clear();
+        m_node->mtime = -1;
+        m_node->state = NotLoaded;
+    }
 
     switch (m_node->state)
     {
@@ -71,9 +413,10 @@ const Index<PlaylistAddItem> & CueCacheRef::load()
         // load the cuesheet in this thread
         m_node->state = Loading;
         mh.unlock();
-        playlist_load(m_filename, title, m_node->items);
+        from_disk = load_items(m_filename, m_node, mtime);
         mh.lock();
 
+        (from_disk ? stats.disk_hits : stats.misses)++;
         m_node->state = Loaded;
         cond.notify_all();
         break;
@@ -83,12 +426,38 @@ const Index<PlaylistAddItem> & CueCacheRef::load()
         while (m_node->state != Loaded)
             cond.wait(mh);
 
+        stats.hits++;
         break;
 
     case Loaded:
         // cuesheet already loaded
+        stats.hits++;
         break;
     }
 
     return m_node->items;
 }
+
+CueCacheStats cue_cache_get_stats()
+{
+    auto mh = mutex.take();
+    CueCacheStats current = stats;
+    current.cuesheets = cache.n_items();
+    return current;
+}
+
+void cue_cache_cleanup()
+{
+    auto mh = mutex.take();
+
+    AUDINFO("Cuesheet cache: %" PRId64 " hits, %" PRId64 " disk hits, "
+            "%" PRId64 " misses, %" PRId64 " evictions.\n",
+            stats.hits, stats.disk_hits, stats.misses, stats.evictions);
+
+    cache.clear();
+    stats = CueCacheStats();
+
+    mh.unlock();
+
+    trim_disk();
+}
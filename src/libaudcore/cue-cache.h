@@ -25,6 +25,15 @@
 
 struct CueCacheNode;
 
+struct CueCacheStats
+{
+    int64_t hits;      /* cuesheet was already in memory */
+    int64_t disk_hits; /* cuesheet was read from the disk cache */
+    int64_t misses;    /* cuesheet had to be parsed */
+    int64_t evictions; /* cuesheet was dropped from memory to save space */
+    int cuesheets;     /* cuesheets currently in memory */
+};
+
 class CueCacheRef
 {
 public:
@@ -38,4 +47,6 @@ private:
     CueCacheNode * m_node;
 };
 
+CueCacheStats cue_cache_get_stats();
+
 #endif // LIBAUDCORE_CUE_CACHE_H
@@ -34,7 +34,8 @@ struct HookItem
 
 struct HookList
 {
-    Index<HookItem> items;
+    // most hooks have only a few subscribers
+    SmallIndex<HookItem, 4> items;
     int use_count;
 
     void compact()
@@ -124,7 +125,7 @@ void hook_cleanup()
 
     hooks.iterate([](const String & name, HookList & list) {
         AUDWARN("Hook not disconnected: %s (%d)\n", (const char *)name,
-                list.items.len());
+                (int)list.items.len());
     });
 
     hooks.clear();
@@ -20,6 +20,8 @@
 #ifndef LIBAUDCORE_HOOK_H
 #define LIBAUDCORE_HOOK_H
 
+#include <stdint.h>
+
 #include <libaudcore/templates.h>
 
 // Timer API.  This API allows functions to be registered to run at a given
@@ -48,6 +50,12 @@ void timer_add(TimerRate rate, TimerFunc func, void * data = nullptr);
  * matching <func> are removed. */
 void timer_remove(TimerRate rate, TimerFunc func, void * data = nullptr);
 
+/* All rates share a single wakeup source, which is stopped while no timers are
+ * registered.  These return the total number of wakeups so far and the recent
+ * average number of wakeups per second (zero while stopped). */
+int64_t timer_get_wakeups();
+float timer_get_wakeup_rate();
+
 /* Convenience wrapper for C++ classes.  Allows non-static member functions to
  * be used as timer callbacks.  The Timer should be made a member of the class
  * in question so that timer_remove() is called automatically from the
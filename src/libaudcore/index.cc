@@ -21,23 +21,32 @@
 #include "internal.h"
 
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <glib.h> /* for g_qsort_with_data */
 
-static void do_fill(void * data, int len, aud::FillFunc fill_func)
+/* the callbacks take an int length, so more than 2 GB is supported only for
+ * basic types (which have no callbacks) */
+static void do_fill(void * data, int64_t len, aud::FillFunc fill_func)
 {
     if (fill_func)
+    {
+        assert(len <= INT_MAX);
         fill_func(data, len);
+    }
     else
         memset(data, 0, len);
 }
 
-static void do_erase(void * data, int len, aud::EraseFunc erase_func)
+static void do_erase(void * data, int64_t len, aud::EraseFunc erase_func)
 {
     if (erase_func)
+    {
+        assert(len <= INT_MAX);
         erase_func(data, len);
+    }
 }
 
 EXPORT void IndexBase::clear(aud::EraseFunc erase_func)
@@ -84,6 +93,7 @@ EXPORT void * IndexBase::insert(int pos, int len)
             throw std::bad_alloc(); /* nothing changed yet */
 
         __sync_add_and_fetch(&misc_bytes_allocated, new_size - m_size);
+        __sync_add_and_fetch(&misc_allocations, 1);
 
         m_data = new_data;
         m_size = new_size;
@@ -252,3 +262,145 @@ EXPORT int IndexBase::bsearch(const void * key, CompareFunc compare,
 
     return -1;
 }
+
+EXPORT void SmallIndexBase::clear(void * buf, int64_t buf_size,
+                                  aud::EraseFunc erase_func)
+{
+    do_erase(m_data, m_len, erase_func);
+
+    if (m_data != buf)
+    {
+        __sync_sub_and_fetch(&misc_bytes_allocated, m_size);
+        free(m_data);
+    }
+
+    m_data = buf;
+    m_len = 0;
+    m_size = buf_size;
+}
+
+EXPORT void SmallIndexBase::move_from(SmallIndexBase & b, void * buf,
+                                      void * b_buf, int64_t b_buf_size)
+{
+    assert(m_data == buf && !m_len);
+
+    if (b.m_data != b_buf)
+    {
+        /* take over the heap buffer */
+        m_data = b.m_data;
+        m_size = b.m_size;
+    }
+    else
+        memcpy(m_data, b.m_data, b.m_len); /* same inline size */
+
+    m_len = b.m_len;
+
+    b.m_data = b_buf;
+    b.m_len = 0;
+    b.m_size = b_buf_size;
+}
+
+EXPORT void * SmallIndexBase::insert(int64_t pos, int64_t len, void * buf,
+                                     GrowFunc grow)
+{
+    assert(pos <= m_len);
+    assert(len >= 0);
+
+    if (pos < 0)
+        pos = m_len; /* insert at end */
+
+    if (m_size < m_len + len)
+    {
+        int64_t new_size = grow(m_size, m_len + len);
+        assert(new_size >= m_len + len);
+
+        void * new_data;
+        if (m_data == buf)
+        {
+            /* first spill out of the inline buffer */
+            new_data = malloc(new_size);
+            if (new_data)
+                memcpy(new_data, m_data, m_len);
+        }
+        else
+            new_data = realloc(m_data, new_size);
+
+        if (!new_data)
+            throw std::bad_alloc(); /* nothing changed yet */
+
+        /* the inline buffer is not counted as allocated */
+        int64_t old_size = (m_data == buf) ? 0 : m_size;
+        __sync_add_and_fetch(&misc_bytes_allocated, new_size - old_size);
+        __sync_add_and_fetch(&misc_allocations, 1);
+
+        m_data = new_data;
+        m_size = new_size;
+    }
+
+    memmove((char *)m_data + pos + len, (char *)m_data + pos, m_len - pos);
+    m_len += len;
+
+    return (char *)m_data + pos;
+}
+
+EXPORT void SmallIndexBase::insert(int64_t pos, int64_t len, void * buf,
+                                   GrowFunc grow, aud::FillFunc fill_func)
+{
+    void * to = insert(pos, len, buf, grow);
+
+    if (len)
+        do_fill(to, len, fill_func);
+}
+
+EXPORT void SmallIndexBase::insert(const void * from, int64_t pos, int64_t len,
+                                   void * buf, GrowFunc grow,
+                                   aud::CopyFunc copy_func)
+{
+    void * to = insert(pos, len, buf, grow);
+
+    if (!len)
+        return;
+
+    if (copy_func)
+    {
+        assert(len <= INT_MAX);
+        copy_func(from, to, len);
+    }
+    else
+        memcpy(to, from, len);
+}
+
+EXPORT void SmallIndexBase::remove(int64_t pos, int64_t len,
+                                   aud::EraseFunc erase_func)
+{
+    assert(pos >= 0 && pos <= m_len);
+    assert(len <= m_len - pos);
+
+    if (len < 0)
+        len = m_len - pos; /* remove all following */
+
+    if (!len)
+        return;
+
+    do_erase((char *)m_data + pos, len, erase_func);
+    memmove((char *)m_data + pos, (char *)m_data + pos + len,
+            m_len - pos - len);
+    m_len -= len;
+}
+
+EXPORT void SmallIndexBase::erase(int64_t pos, int64_t len,
+                                  aud::FillFunc fill_func,
+                                  aud::EraseFunc erase_func)
+{
+    assert(pos >= 0 && pos <= m_len);
+    assert(len <= m_len - pos);
+
+    if (len < 0)
+        len = m_len - pos; /* erase all following */
+
+    if (!len)
+        return;
+
+    do_erase((char *)m_data + pos, len, erase_func);
+    do_fill((char *)m_data + pos, len, fill_func);
+}
@@ -20,6 +20,8 @@
 #ifndef LIBAUDCORE_INDEX_H
 #define LIBAUDCORE_INDEX_H
 
+#include <stdint.h>
+
 #include <libaudcore/templates.h>
 
 /*
@@ -223,4 +225,187 @@ private:
     static constexpr int cooked(int len) { return len / sizeof(T); }
 };
 
+/*
+ * SmallIndex is a variant of Index intended for short lists.  It differs from
+ * Index in the following ways:
+ *  - Up to N elements are stored inline, so that short lists do not require
+ *    any heap allocation at all.  As a consequence, a SmallIndex (or any object
+ *    containing one) must not itself be moved in memory without calling its
+ *    move constructor, so it cannot be stored inside a plain Index.
+ *  - Lengths and positions are 64-bit.
+ *  - The growth of the heap buffer (once the inline storage is exceeded) can
+ *    be customized by passing a different policy class in place of
+ *    IndexGrowth.  A policy provides a single static function, next_size(),
+ *    which returns the new capacity in bytes.
+ */
+
+struct IndexGrowth
+{
+    // same policy as Index: 4/3 the current size, but at least 16 bytes
+    static int64_t next_size(int64_t size, int64_t needed)
+    {
+        int64_t new_size = aud::max(size, (int64_t)16);
+        if (new_size < needed)
+            new_size = (new_size + 2) / 3 * 4;
+
+        return aud::max(new_size, needed);
+    }
+};
+
+class SmallIndexBase
+{
+public:
+    typedef int64_t (*GrowFunc)(int64_t size, int64_t needed);
+
+    constexpr SmallIndexBase(void * buf, int64_t buf_size)
+        : m_data(buf), m_len(0), m_size(buf_size)
+    {
+    }
+
+    // use as destructor
+    void clear(void * buf, int64_t buf_size, aud::EraseFunc erase_func);
+
+    // must be called on a cleared (empty) list; leaves b cleared
+    void move_from(SmallIndexBase & b, void * buf, void * b_buf,
+                   int64_t b_buf_size);
+
+    void * begin() { return m_data; }
+    const void * begin() const { return m_data; }
+    void * end() { return (char *)m_data + m_len; }
+    const void * end() const { return (char *)m_data + m_len; }
+
+    int64_t len() const { return m_len; }
+    int64_t size() const { return m_size; }
+
+    void * insert(int64_t pos, int64_t len, void * buf, GrowFunc grow); // no fill
+    void insert(int64_t pos, int64_t len, void * buf, GrowFunc grow,
+                aud::FillFunc fill_func);
+    void insert(const void * from, int64_t pos, int64_t len, void * buf,
+                GrowFunc grow, aud::CopyFunc copy_func);
+    void remove(int64_t pos, int64_t len, aud::EraseFunc erase_func);
+    void erase(int64_t pos, int64_t len, aud::FillFunc fill_func,
+               aud::EraseFunc erase_func);
+
+private:
+    void * m_data;
+    int64_t m_len, m_size;
+};
+
+template<class T, int N, class Growth = IndexGrowth>
+class SmallIndex : private SmallIndexBase
+{
+    static_assert(N > 0, "use Index if no inline storage is needed");
+
+public:
+    SmallIndex() : SmallIndexBase(m_buf, sizeof m_buf) {}
+
+    void clear()
+    {
+        SmallIndexBase::clear(m_buf, sizeof m_buf, aud::erase_func<T>());
+    }
+
+    ~SmallIndex() { clear(); }
+
+    SmallIndex(SmallIndex && b) : SmallIndexBase(m_buf, sizeof m_buf)
+    {
+        SmallIndexBase::move_from(b, m_buf, b.m_buf, sizeof b.m_buf);
+    }
+
+    SmallIndex & operator=(SmallIndex && b)
+    {
+        if (this != &b)
+        {
+            clear();
+            SmallIndexBase::move_from(b, m_buf, b.m_buf, sizeof b.m_buf);
+        }
+
+        return *this;
+    }
+
+    // true if the elements are stored inline
+    bool is_inline() const { return SmallIndexBase::begin() == m_buf; }
+
+    T * begin() { return (T *)SmallIndexBase::begin(); }
+    const T * begin() const { return (const T *)SmallIndexBase::begin(); }
+    T * end() { return (T *)SmallIndexBase::end(); }
+    const T * end() const { return (const T *)SmallIndexBase::end(); }
+
+    int64_t len() const { return cooked(SmallIndexBase::len()); }
+    int64_t capacity() const { return cooked(SmallIndexBase::size()); }
+
+    T & operator[](int64_t i) { return begin()[i]; }
+    const T & operator[](int64_t i) const { return begin()[i]; }
+
+    void insert(int64_t pos, int64_t len)
+    {
+        SmallIndexBase::insert(raw(pos), raw(len), m_buf, Growth::next_size,
+                               aud::fill_func<T>());
+    }
+
+    void insert(const T * from, int64_t pos, int64_t len)
+    {
+        SmallIndexBase::insert(from, raw(pos), raw(len), m_buf,
+                               Growth::next_size, aud::copy_func<T>());
+    }
+
+    void remove(int64_t pos, int64_t len)
+    {
+        SmallIndexBase::remove(raw(pos), raw(len), aud::erase_func<T>());
+    }
+
+    void erase(int64_t pos, int64_t len)
+    {
+        SmallIndexBase::erase(raw(pos), raw(len), aud::fill_func<T>(),
+                              aud::erase_func<T>());
+    }
+
+    template<class... Args>
+    T & append(Args &&... args)
+    {
+        void * to = SmallIndexBase::insert(-1, sizeof(T), m_buf,
+                                           Growth::next_size);
+        return *aud::construct<T>::make(to, std::forward<Args>(args)...);
+    }
+
+    int64_t find(const T & val) const
+    {
+        for (const T * iter = begin(); iter != end(); iter++)
+        {
+            if (*iter == val)
+                return iter - begin();
+        }
+
+        return -1;
+    }
+
+    // func(val) returns true to remove val, false to keep it
+    template<class F>
+    bool remove_if(F func, bool clear_if_empty = false)
+    {
+        T * iter = begin();
+        bool changed = false;
+        while (iter != end())
+        {
+            if (func(*iter))
+            {
+                remove(iter - begin(), 1);
+                changed = true;
+            }
+            else
+                iter++;
+        }
+
+        if (clear_if_empty && !len())
+            clear();
+
+        return changed;
+    }
+
+private:
+    alignas(T) char m_buf[N * sizeof(T)];
+
+    static constexpr int64_t raw(int64_t len) { return len * sizeof(T); }
+    static constexpr int64_t cooked(int64_t len) { return len / sizeof(T); }
+};
+
 #endif // LIBAUDCORE_INDEX_H
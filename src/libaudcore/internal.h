@@ -31,6 +31,7 @@ class Plugin;
 class PluginHandle;
 class VFSFile;
 class Tuple;
+struct ReplayGainInfo;
 
 typedef bool (*DirForeachFunc)(const char * path, const char * basename,
                                void * user);
@@ -46,6 +47,13 @@ void art_cleanup();
 
 /* art-search.cc */
 String art_search(const char * filename);
+void art_search_cleanup();
+
+/* art-thumbnail.cc */
+void art_thumbnail_cleanup();
+
+/* cue-cache.cc */
+void cue_cache_cleanup();
 
 /* charset.cc */
 void chardet_init();
@@ -94,6 +102,11 @@ bool iface_plugin_set_current(PluginHandle * plugin);
 
 void interface_run();
 
+/* loudness.cc */
+bool loudness_get_gain(const char * filename, ReplayGainInfo & gain);
+void loudness_prioritize(const Index<String> & filenames);
+void loudness_cleanup();
+
 /* mainloop.cc */
 void mainloop_cleanup();
 
@@ -105,6 +118,19 @@ void playback_stop(bool exiting = false);
 bool playback_check_serial(int serial);
 void playback_set_info(int entry, Tuple && tuple);
 
+/* Receives the output of an input plugin decoding outside of playback (e.g.
+ * for loudness analysis) in place of the output system.  A sink is installed
+ * for the calling thread only; pass nullptr to remove it. */
+class DecodeSink
+{
+public:
+    virtual void open_audio(int format, int rate, int channels) = 0;
+    virtual void write_audio(const void * data, int length) = 0;
+    virtual bool check_stop() = 0;
+};
+
+void playback_set_decode_sink(DecodeSink * sink);
+
 /* probe.cc */
 bool open_input_file(const char * filename, const char * mode, InputPlugin * ip,
                      VFSFile & file, String * error = nullptr);
@@ -117,10 +143,14 @@ int probe_by_filename(const char * filename);
 
 /* runtime.cc */
 extern size_t misc_bytes_allocated;
+extern size_t misc_allocations; /* number of Index (re)allocations */
 
 /* strpool.cc */
 void string_leak_check();
 
+/* tag-writer.cc */
+void tag_writer_cleanup();
+
 /* timer.cc */
 void timer_cleanup();
 
@@ -149,6 +179,14 @@ struct IntHashKey
     unsigned hash() const { return int32_hash(val); }
 };
 
+/* vfs_async.cc */
+void vfs_async_cleanup();
+
+/* vfs_prefetch.cc */
+void vfs_prefetch(const Index<String> & filenames);
+bool vfs_prefetch_take(const char * path, Index<char> & head);
+void vfs_prefetch_cleanup();
+
 /* vis-runner.cc */
 void vis_runner_start_stop(bool playing, bool paused);
 void vis_runner_pass_audio(int time, const Index<float> & data, int channels,
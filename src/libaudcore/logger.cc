@@ -22,7 +22,15 @@
 #include "runtime.h"
 #include "threads.h"
 
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
 
 namespace audlog
 {
@@ -36,7 +44,7 @@ struct HandlerData
 static aud::spinlock_rw lock;
 static Index<HandlerData> handlers;
 static Level stderr_level = Warning;
-static Level min_level = Warning;
+static std::atomic<Level> min_level(Warning);
 
 EXPORT void set_stderr_level(Level level)
 {
@@ -93,28 +101,667 @@ EXPORT const char * get_level_name(Level level)
     return nullptr;
 }
 
-EXPORT void log(Level level, const char * file, int line, const char * func,
-                const char * format, ...)
+/* caller must hold the read lock */
+static void dispatch(Level level, const char * file, int line,
+                     const char * func, const char * message)
 {
-    auto rd = lock.read();
+    if (level >= stderr_level)
+        fprintf(stderr, "%s %s:%d [%s]: %s", get_level_name(level), file, line,
+                func, message);
 
-    if (level >= min_level)
+    for (const HandlerData & h : handlers)
     {
-        va_list args;
-        va_start(args, format);
-        StringBuf message = str_vprintf(format, args);
-        va_end(args);
+        if (level >= h.level)
+            h.handler(level, file, line, func, message);
+    }
+}
+
+/*
+ * Asynchronous backend
+ *
+ * Each thread that logs gets its own single-producer, single-consumer ring.
+ * The caller copies the message arguments into the ring in binary form
+ * (numbers as-is, strings by value) and returns immediately.  The logger
+ * thread drains all the rings in timestamp order, formats each record, and
+ * passes it on to stderr and the handlers.  The format, file and function
+ * strings are stored by pointer, so they must be literals (which they are
+ * when the AUDxxx macros are used); flush() must be called before a plugin
+ * module is unloaded.  Messages that do not fit are dropped and counted, and
+ * the count is reported by a warning once the rings have been drained.
+ */
+
+enum class ArgType : char
+{
+    Int,
+    Double,
+    Pointer,
+    String
+};
+
+struct LogArg
+{
+    ArgType type;
+    int len; /* for String, length of the inline data that follows */
+    union
+    {
+        long long i;
+        double d;
+        const void * p;
+    };
+};
+
+struct LogRecord
+{
+    int size; /* total size in bytes including arguments; 0 = wrap marker */
+    Level level;
+    int line;
+    int nargs;
+    int64_t time;
+    const char * file;
+    const char * func;
+    const char * format; /* nullptr if the message was preformatted */
+};
+
+struct LogRing
+{
+    static constexpr int Size = 65536;     // 64 KB per thread
+    static constexpr int MaxRecord = 8192; // longer messages are truncated
+
+    std::atomic<unsigned> head{0}, tail{0}; /* free-running byte counters */
+    std::atomic<bool> orphaned{false};
+    LogRing * next = nullptr;
+
+    alignas(LogRecord) char buf[Size];
+};
 
-        if (level >= stderr_level)
-            fprintf(stderr, "%s %s:%d [%s]: %s", get_level_name(level), file,
-                    line, func, (const char *)message);
+static constexpr int align8(int size) { return (size + 7) & ~7; }
 
-        for (const HandlerData & h : handlers)
+static pthread_key_t ring_key;
+static std::once_flag ring_once;
+
+static aud::mutex async_mutex;
+static aud::condvar async_cond;
+static std::thread async_thread;
+static LogRing * rings;
+static bool async_quit;
+
+static std::atomic<bool> async_enabled(false);
+static std::atomic<bool> async_pending(false);
+static std::atomic<int64_t> dropped_count(0);
+static int64_t reported_count; /* protected by async_mutex */
+
+static int64_t get_timestamp()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void wake_logger()
+{
+    if (!async_pending.exchange(true))
+        async_cond.notify_one();
+}
+
+/* called at thread exit; the logger thread frees the ring once drained */
+static void orphan_ring(void * ring)
+{
+    ((LogRing *)ring)->orphaned.store(true, std::memory_order_release);
+    wake_logger();
+}
+
+static void make_ring_key() { pthread_key_create(&ring_key, orphan_ring); }
+
+static LogRing * get_ring()
+{
+    std::call_once(ring_once, make_ring_key);
+
+    auto ring = (LogRing *)pthread_getspecific(ring_key);
+
+    if (!ring)
+    {
+        ring = new LogRing;
+
+        auto mh = async_mutex.take();
+        ring->next = rings;
+        rings = ring;
+        mh.unlock();
+
+        pthread_setspecific(ring_key, ring);
+    }
+
+    return ring;
+}
+
+/* Copies the arguments described by <format> into <out>.  Returns the number
+ * of bytes used, or -1 if the format uses a conversion that cannot be stored
+ * (such as %n) or the arguments do not fit in <avail> bytes. */
+static int pack_args(const char * format, va_list args, char * out, int avail,
+                     int & nargs)
+{
+    int used = 0;
+    nargs = 0;
+
+    auto add_arg = [&](ArgType type, int len) -> LogArg * {
+        int size = sizeof(LogArg) + align8(len);
+        if (used + size > avail)
+            return nullptr;
+
+        auto arg = (LogArg *)(out + used);
+        arg->type = type;
+        arg->len = len;
+        used += size;
+        nargs++;
+        return arg;
+    };
+
+    for (const char * c = strchr(format, '%'); c; c = strchr(c, '%'))
+    {
+        c++;
+        if (*c == '%')
+        {
+            c++;
+            continue;
+        }
+
+        c += strspn(c, "-+ #0'");
+
+        int precision = -1;
+
+        for (int part = 0; part < 2; part++)
         {
-            if (level >= h.level)
-                h.handler(level, file, line, func, message);
+            int val = -1;
+
+            if (*c == '*')
+            {
+                LogArg * arg = add_arg(ArgType::Int, 0);
+                if (!arg)
+                    return -1;
+                val = arg->i = va_arg(args, int);
+                c++;
+            }
+            else if (part)
+            {
+                val = atoi(c);
+                c += strspn(c, "0123456789");
+            }
+            else
+                c += strspn(c, "0123456789");
+
+            if (part)
+                precision = val;
+            else if (*c != '.')
+                break;
+            else
+                c++;
+        }
+
+        int longs = 0, shorts = 0;
+        char size_mod = 0;
+
+        for (;; c++)
+        {
+            if (*c == 'l')
+                longs++;
+            else if (*c == 'h')
+                shorts++;
+            else if (*c == 'q' || *c == 'L')
+                longs = 2;
+            else if (*c == 'j' || *c == 'z' || *c == 't')
+                size_mod = *c;
+            else
+                break;
+        }
+
+        /* wide characters and strings are not supported */
+        if (longs && (*c == 'c' || *c == 's'))
+            return -1;
+
+        LogArg * arg = nullptr;
+        bool is_signed = false;
+
+        switch (*c)
+        {
+        case 'd':
+        case 'i':
+            is_signed = true;
+            /* fall through */
+        case 'u':
+        case 'x':
+        case 'X':
+        case 'o':
+        case 'c':
+            if (!(arg = add_arg(ArgType::Int, 0)))
+                return -1;
+
+            if (size_mod == 'j')
+                arg->i = va_arg(args, intmax_t);
+            else if (size_mod == 'z')
+                arg->i = va_arg(args, size_t);
+            else if (size_mod == 't')
+                arg->i = va_arg(args, ptrdiff_t);
+            else if (longs >= 2)
+                arg->i = va_arg(args, long long);
+            else if (longs == 1)
+                arg->i = is_signed ? va_arg(args, long)
+                                   : (long long)va_arg(args, unsigned long);
+            else
+            {
+                int val = va_arg(args, int);
+                if (shorts >= 2)
+                    arg->i = is_signed ? (signed char)val : (unsigned char)val;
+                else if (shorts == 1)
+                    arg->i = is_signed ? (short)val : (unsigned short)val;
+                else if (is_signed)
+                    arg->i = val;
+                else
+                    arg->i = (unsigned)val;
+            }
+            break;
+
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if (!(arg = add_arg(ArgType::Double, 0)))
+                return -1;
+
+            if (longs >= 2)
+                arg->d = va_arg(args, long double);
+            else
+                arg->d = va_arg(args, double);
+            break;
+
+        case 'p':
+            if (!(arg = add_arg(ArgType::Pointer, 0)))
+                return -1;
+
+            arg->p = va_arg(args, const void *);
+            break;
+
+        case 's':
+        {
+            auto str = va_arg(args, const char *);
+            if (!str)
+                str = "(null)";
+
+            int len = (precision >= 0) ? strnlen(str, precision) : strlen(str);
+
+            if (!(arg = add_arg(ArgType::String, len + 1)))
+                return -1;
+
+            arg->p = str;
+            memcpy(arg + 1, str, len);
+            ((char *)(arg + 1))[len] = 0;
+            break;
+        }
+
+        default:
+            return -1; /* %n, %m, wide strings, etc. */
         }
+
+        c++;
     }
+
+    return used;
+}
+
+/* Reconstructs the message from a packed record (on the logger thread). */
+static StringBuf format_record(const LogRecord * rec)
+{
+    auto arg = (const LogArg *)(rec + 1);
+
+    if (!rec->format)
+        return str_copy((const char *)(arg + 1));
+
+    auto next_arg = [&]() {
+        auto cur = arg;
+        arg = (const LogArg *)((const char *)arg + sizeof(LogArg) +
+                               align8(arg->len));
+        return cur;
+    };
+
+    StringBuf message(0);
+    const char * c = rec->format;
+
+    while (*c)
+    {
+        const char * pct = strchr(c, '%');
+        if (!pct)
+        {
+            message.insert(-1, c);
+            break;
+        }
+
+        message.insert(-1, c, pct - c);
+        c = pct + 1;
+
+        if (*c == '%')
+        {
+            message.insert(-1, "%", 1);
+            c++;
+            continue;
+        }
+
+        /* rebuild the conversion with '*' resolved and a uniform length */
+        char spec[64] = "%";
+        int speclen = 1;
+
+        auto add_spec = [&](const char * s, int len) {
+            len = aud::min(len, (int)sizeof spec - 8 - speclen);
+            memcpy(spec + speclen, s, len);
+            speclen += len;
+        };
+
+        int flags = strspn(c, "-+ #0'");
+        add_spec(c, flags);
+        c += flags;
+
+        for (int part = 0; part < 2; part++)
+        {
+            if (*c == '*')
+            {
+                char num[16];
+                int len = snprintf(num, sizeof num, "%d", (int)next_arg()->i);
+                add_spec(num, len);
+                c++;
+            }
+            else
+            {
+                int digits = strspn(c, "0123456789");
+                add_spec(c, digits);
+                c += digits;
+            }
+
+            if (*c != '.')
+                break;
+
+            add_spec(".", 1);
+            c++;
+        }
+
+        c += strspn(c, "lhqLjzt");
+
+        const LogArg * val = next_arg();
+
+        switch (val->type)
+        {
+        case ArgType::Int:
+            if (*c != 'c')
+                add_spec("ll", 2);
+            add_spec(c, 1);
+            spec[speclen] = 0;
+            if (*c == 'c')
+                str_append_printf(message, spec, (int)val->i);
+            else
+                str_append_printf(message, spec, val->i);
+            break;
+
+        case ArgType::Double:
+            add_spec(c, 1);
+            spec[speclen] = 0;
+            str_append_printf(message, spec, val->d);
+            break;
+
+        case ArgType::Pointer:
+            add_spec(c, 1);
+            spec[speclen] = 0;
+            str_append_printf(message, spec, val->p);
+            break;
+
+        case ArgType::String:
+            add_spec(c, 1);
+            spec[speclen] = 0;
+            str_append_printf(message, spec, (const char *)(val + 1));
+            break;
+        }
+
+        c++;
+    }
+
+    return message;
+}
+
+static bool push_record(Level level, const char * file, int line,
+                        const char * func, const char * format, va_list args)
+{
+    LogRing * ring = get_ring();
+
+    unsigned head = ring->head.load(std::memory_order_relaxed);
+    unsigned tail = ring->tail.load(std::memory_order_acquire);
+
+    /* records are written contiguously; skip the end of the buffer if the
+     * largest possible record would not fit there */
+    int pos = head % LogRing::Size;
+    int contiguous = LogRing::Size - pos;
+    int skip = (contiguous < LogRing::MaxRecord) ? contiguous : 0;
+
+    if ((int)(LogRing::Size - (head - tail)) < skip + LogRing::MaxRecord)
+        return false;
+
+    if (skip)
+    {
+        ((LogRecord *)(ring->buf + pos))->size = 0;
+        pos = 0;
+    }
+
+    auto rec = (LogRecord *)(ring->buf + pos);
+    char * data = (char *)(rec + 1);
+    int avail = LogRing::MaxRecord - sizeof(LogRecord);
+
+    va_list args2;
+    va_copy(args2, args);
+    int used = pack_args(format, args2, data, avail, rec->nargs);
+    va_end(args2);
+
+    if (used < 0)
+    {
+        /* fall back to formatting on this thread */
+        auto arg = (LogArg *)data;
+        arg->type = ArgType::String;
+        arg->p = nullptr;
+
+        int max = avail - sizeof(LogArg);
+        *(char *)(arg + 1) = 0;
+        int len = vsnprintf((char *)(arg + 1), max, format, args);
+        arg->len = aud::clamp(len + 1, 1, max);
+
+        used = sizeof(LogArg) + align8(arg->len);
+        rec->nargs = 1;
+        format = nullptr;
+    }
+
+    rec->size = align8(sizeof(LogRecord) + used);
+    rec->level = level;
+    rec->line = line;
+    rec->time = get_timestamp();
+    rec->file = file;
+    rec->func = func;
+    rec->format = format;
+
+    ring->head.store(head + skip + rec->size, std::memory_order_release);
+    return true;
+}
+
+/* returns the next record in the ring, or nullptr if the ring is empty */
+static const LogRecord * peek_record(LogRing * ring)
+{
+    unsigned tail = ring->tail.load(std::memory_order_relaxed);
+    unsigned head = ring->head.load(std::memory_order_acquire);
+
+    while (tail != head)
+    {
+        int pos = tail % LogRing::Size;
+        auto rec = (const LogRecord *)(ring->buf + pos);
+
+        if (rec->size)
+            return rec;
+
+        /* wrap marker */
+        tail += LogRing::Size - pos;
+        ring->tail.store(tail, std::memory_order_release);
+    }
+
+    return nullptr;
+}
+
+static void pop_record(LogRing * ring, const LogRecord * rec)
+{
+    unsigned tail = ring->tail.load(std::memory_order_relaxed);
+    ring->tail.store(tail + rec->size, std::memory_order_release);
+}
+
+/* caller must hold async_mutex */
+static void drain_rings()
+{
+    while (true)
+    {
+        LogRing * first = nullptr;
+        const LogRecord * first_rec = nullptr;
+
+        for (LogRing * ring = rings; ring; ring = ring->next)
+        {
+            const LogRecord * rec = peek_record(ring);
+            if (rec && (!first_rec || rec->time < first_rec->time))
+            {
+                first = ring;
+                first_rec = rec;
+            }
+        }
+
+        if (!first)
+            break;
+
+        StringBuf message = format_record(first_rec);
+
+        {
+            auto rd = lock.read();
+            dispatch(first_rec->level, first_rec->file, first_rec->line,
+                     first_rec->func, message);
+        }
+
+        pop_record(first, first_rec);
+    }
+
+    /* free rings belonging to threads that have exited */
+    for (LogRing ** link = &rings; *link;)
+    {
+        LogRing * ring = *link;
+
+        if (ring->orphaned.load(std::memory_order_acquire) &&
+            !peek_record(ring))
+        {
+            *link = ring->next;
+            delete ring;
+        }
+        else
+            link = &ring->next;
+    }
+
+    int64_t dropped = dropped_count.load();
+
+    if (dropped > reported_count)
+    {
+        StringBuf message = str_printf(
+            "%" PRId64 " log messages were dropped (buffer full).\n",
+            dropped - reported_count);
+
+        auto rd = lock.read();
+        dispatch(Warning, __FILE__, __LINE__, __FUNCTION__, message);
+
+        reported_count = dropped;
+    }
+}
+
+static void logger_thread()
+{
+    /* handlers may log; make sure that doesn't need async_mutex */
+    get_ring();
+
+    auto mh = async_mutex.take();
+
+    while (!async_quit)
+    {
+        /* the timeout covers the small window in which a wakeup can be lost
+         * (async_pending is set without holding the mutex) */
+        async_cond.wait_for(mh, std::chrono::milliseconds(100), []() {
+            return async_quit || async_pending.load();
+        });
+
+        async_pending.store(false);
+        drain_rings();
+    }
+
+    drain_rings();
+}
+
+EXPORT void set_async(bool enable)
+{
+    auto mh = async_mutex.take();
+
+    if (enable == async_enabled.load())
+        return;
+
+    if (enable)
+    {
+        async_quit = false;
+        async_thread = std::thread(logger_thread);
+        async_enabled.store(true);
+    }
+    else
+    {
+        async_enabled.store(false);
+        async_quit = true;
+        async_cond.notify_one();
+
+        mh.unlock();
+        async_thread.join();
+
+        /* pick up anything logged while the thread was exiting */
+        flush();
+    }
+}
+
+EXPORT void flush()
+{
+    if (async_enabled.load())
+        get_ring();
+
+    auto mh = async_mutex.take();
+    drain_rings();
+}
+
+EXPORT int64_t get_dropped_count() { return dropped_count.load(); }
+
+EXPORT void log(Level level, const char * file, int line, const char * func,
+                const char * format, ...)
+{
+    if (level < min_level.load(std::memory_order_relaxed))
+        return;
+
+    va_list args;
+    va_start(args, format);
+
+    if (async_enabled.load(std::memory_order_acquire))
+    {
+        if (push_record(level, file, line, func, format, args))
+            wake_logger();
+        else
+            dropped_count++;
+    }
+    else
+    {
+        StringBuf message = str_vprintf(format, args);
+
+        auto rd = lock.read();
+        dispatch(level, file, line, func, message);
+    }
+
+    va_end(args);
 }
 
 } // namespace audlog
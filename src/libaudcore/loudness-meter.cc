@@ -0,0 +1,307 @@
+/*
+ * loudness-meter.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "loudness-meter.h"
+
+#include <math.h>
+
+#include "templates.h"
+
+typedef LoudnessMeter::Lanes Lanes;
+typedef LoudnessMeter::PeakLanes PeakLanes;
+
+static constexpr int n_phases = 4;
+static constexpr int n_taps = LoudnessMeter::n_taps;
+
+/* channel weights of BS.1770 for 5.0 and 5.1 (surround channels +1.5 dB,
+ * LFE ignored); all other layouts are weighted equally */
+static constexpr double surround_weight = 1.41;
+
+/* below this, filter state is flushed to zero to avoid denormals */
+static constexpr double denormal_limit = 1e-25;
+
+/* polyphase windowed-sinc filter interpolating by four; phase p of each
+ * output frame is sum(k) taps[p][k] * in[n - k] */
+struct OversampleFilter
+{
+    float taps[n_phases][n_taps];
+
+    OversampleFilter()
+    {
+        constexpr int len = n_phases * n_taps;
+
+        for (int p = 0; p < n_phases; p++)
+        {
+            double sum = 0;
+
+            for (int k = 0; k < n_taps; k++)
+            {
+                int n = n_phases * k + p;
+                double t = (n - (len - 1) * 0.5) / n_phases;
+                double sinc = (t == 0) ? 1 : sin(M_PI * t) / (M_PI * t);
+                double window = 0.5 - 0.5 * cos(2 * M_PI * (n + 0.5) / len);
+
+                taps[p][k] = sinc * window;
+                sum += taps[p][k];
+            }
+
+            /* unity gain at DC for every phase */
+            for (int k = 0; k < n_taps; k++)
+                taps[p][k] /= sum;
+        }
+    }
+};
+
+static const OversampleFilter & get_oversample_filter()
+{
+    static const OversampleFilter filter;
+    return filter;
+}
+
+static Lanes splat(double val) { return Lanes{} + val; }
+
+LoudnessMeter::LoudnessMeter(int channels, int rate)
+    : m_channels(aud::clamp(channels, 1, AUD_MAX_CHANNELS)),
+      m_groups((m_channels + n_lanes - 1) / n_lanes),
+      m_step(aud::max(1, (rate + 5) / 10)),
+      m_step_left(m_step),
+      m_state(),
+      m_sum(),
+      m_steps(),
+      m_n_steps(0),
+      m_oversample(rate < 96000),
+      m_history(),
+      m_history_pos(),
+      m_peak_lanes()
+{
+    /* K-weighting, stage 1: high shelf modeling the acoustic effect of the
+     * head; coefficients derived for any rate as in BS.1770 */
+    double K = tan(M_PI * 1681.974450955533 / rate);
+    double Q = 0.7071752369554196;
+    double Vh = pow(10, 3.999843853973347 / 20);
+    double Vb = pow(Vh, 0.4996667741545416);
+    double a0 = 1 + K / Q + K * K;
+
+    m_shelf.b0 = splat((Vh + Vb * K / Q + K * K) / a0);
+    m_shelf.b1 = splat(2 * (K * K - Vh) / a0);
+    m_shelf.b2 = splat((Vh - Vb * K / Q + K * K) / a0);
+    m_shelf.a1 = splat(2 * (K * K - 1) / a0);
+    m_shelf.a2 = splat((1 - K / Q + K * K) / a0);
+
+    /* stage 2: high pass (the "RLB" curve) */
+    K = tan(M_PI * 38.13547087602444 / rate);
+    Q = 0.5003270373238773;
+    a0 = 1 + K / Q + K * K;
+
+    m_highpass.b0 = splat(1);
+    m_highpass.b1 = splat(-2);
+    m_highpass.b2 = splat(1);
+    m_highpass.a1 = splat(2 * (K * K - 1) / a0);
+    m_highpass.a2 = splat((1 - K / Q + K * K) / a0);
+
+    for (int c = 0; c < n_groups * n_lanes; c++)
+        m_weights[c] = (c < m_channels) ? 1 : 0;
+
+    if (m_channels == 5)
+        m_weights[3] = m_weights[4] = surround_weight;
+    else if (m_channels == 6)
+    {
+        m_weights[3] = 0;
+        m_weights[4] = m_weights[5] = surround_weight;
+    }
+}
+
+/* filters one group of channels, one per vector lane */
+void LoudnessMeter::filter(int group, const float * data, int frames)
+{
+    const OversampleFilter & os = get_oversample_filter();
+
+    int first = group * n_lanes;
+    int count = aud::min(n_lanes, m_channels - first);
+
+    const Biquad & sh = m_shelf;
+    const Biquad & hp = m_highpass;
+
+    Lanes s0 = m_state[group][0], s1 = m_state[group][1];
+    Lanes s2 = m_state[group][2], s3 = m_state[group][3];
+    Lanes sum = m_sum[group];
+
+    PeakLanes * history = m_history[group];
+    int pos = m_history_pos[group];
+    float peaks[n_lanes];
+
+    for (int c = 0; c < n_lanes; c++)
+        peaks[c] = m_peak_lanes[group][c];
+
+    for (const float * in = data + first,
+                     * end = in + (int64_t)frames * m_channels;
+         in < end; in += m_channels)
+    {
+        Lanes x{};
+        PeakLanes xf{};
+
+        for (int c = 0; c < count; c++)
+        {
+            x[c] = in[c];
+            xf[c] = in[c];
+        }
+
+        Lanes y = sh.b0 * x + s0;
+        s0 = sh.b1 * x - sh.a1 * y + s1;
+        s1 = sh.b2 * x - sh.a2 * y;
+
+        Lanes z = hp.b0 * y + s2;
+        s2 = hp.b1 * y - hp.a1 * z + s3;
+        s3 = hp.b2 * y - hp.a2 * z;
+
+        sum += z * z;
+
+        if (m_oversample)
+        {
+            pos = (pos > 0) ? pos - 1 : n_taps - 1;
+            history[pos] = history[pos + n_taps] = xf;
+
+            const PeakLanes * window = history + pos;
+
+            for (int p = 0; p < n_phases; p++)
+            {
+                PeakLanes out{};
+                for (int k = 0; k < n_taps; k++)
+                    out += window[k] * os.taps[p][k];
+
+                for (int c = 0; c < n_lanes; c++)
+                    peaks[c] = aud::max(peaks[c], fabsf(out[c]));
+            }
+        }
+
+        for (int c = 0; c < n_lanes; c++)
+            peaks[c] = aud::max(peaks[c], fabsf(xf[c]));
+    }
+
+    m_state[group][0] = s0;
+    m_state[group][1] = s1;
+    m_state[group][2] = s2;
+    m_state[group][3] = s3;
+    m_sum[group] = sum;
+
+    m_history_pos[group] = pos;
+
+    for (int c = 0; c < n_lanes; c++)
+        m_peak_lanes[group][c] = peaks[c];
+}
+
+void LoudnessMeter::end_step()
+{
+    double energy = 0;
+
+    for (int g = 0; g < m_groups; g++)
+    {
+        for (int c = 0; c < n_lanes; c++)
+        {
+            energy += m_weights[g * n_lanes + c] * m_sum[g][c];
+
+            for (Lanes & state : m_state[g])
+            {
+                if (fabs(state[c]) < denormal_limit)
+                    state[c] = 0;
+            }
+        }
+
+        m_sum[g] = Lanes{};
+    }
+
+    energy /= m_step;
+
+    /* each block spans this step and the three before it */
+    if (m_n_steps == 3)
+        m_blocks.append((m_steps[0] + m_steps[1] + m_steps[2] + energy) / 4);
+    else
+        m_n_steps++;
+
+    m_steps[0] = m_steps[1];
+    m_steps[1] = m_steps[2];
+    m_steps[2] = energy;
+
+    m_step_left = m_step;
+}
+
+void LoudnessMeter::process(const float * data, int frames)
+{
+    while (frames > 0)
+    {
+        int n = aud::min(frames, m_step_left);
+
+        for (int g = 0; g < m_groups; g++)
+            filter(g, data, n);
+
+        data += (int64_t)n * m_channels;
+        frames -= n;
+
+        if (!(m_step_left -= n))
+            end_step();
+    }
+}
+
+float LoudnessMeter::peak() const
+{
+    float peak = 0;
+
+    for (int c = 0; c < m_channels; c++)
+        peak = aud::max(peak, m_peak_lanes[c / n_lanes][c % n_lanes]);
+
+    return peak;
+}
+
+double LoudnessMeter::integrate(const Blocks & blocks)
+{
+    /* -70 LUFS */
+    const double abs_gate = pow(10, (-70 + 0.691) / 10);
+
+    double sum = 0;
+    int n = 0;
+
+    for (double energy : blocks)
+    {
+        if (energy > abs_gate)
+        {
+            sum += energy;
+            n++;
+        }
+    }
+
+    if (!n)
+        return -HUGE_VAL;
+
+    /* -10 LU relative to the blocks above the absolute gate */
+    const double gate = aud::max(abs_gate, sum / n * 0.1);
+
+    sum = 0;
+    n = 0;
+
+    for (double energy : blocks)
+    {
+        if (energy > gate)
+        {
+            sum += energy;
+            n++;
+        }
+    }
+
+    return -0.691 + 10 * log10(sum / n);
+}
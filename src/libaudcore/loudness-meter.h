@@ -0,0 +1,90 @@
+/*
+ * loudness-meter.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_LOUDNESS_METER_H
+#define LIBAUDCORE_LOUDNESS_METER_H
+
+#include "audio.h"
+#include "index.h"
+
+/* Measures loudness as specified by ITU-R BS.1770-4 and EBU R 128: the input
+ * is K-weighted, its mean square is taken over 400 ms blocks overlapping by
+ * 75%, and the blocks are gated at -70 LUFS and then at 10 LU below the
+ * loudness of the remaining blocks.  The true peak is found by oversampling
+ * four times (below 96 kHz). */
+class LoudnessMeter
+{
+public:
+    /* channels are filtered side by side in the lanes of a vector, which
+     * covers stereo exactly and fits in any SIMD register */
+    static constexpr int n_lanes = 2;
+    static constexpr int n_groups = (AUD_MAX_CHANNELS + n_lanes - 1) / n_lanes;
+
+    /* taps of each of the four phases of the oversampling filter */
+    static constexpr int n_taps = 12;
+
+    typedef double Lanes __attribute__((vector_size(n_lanes * sizeof(double))));
+    typedef float PeakLanes
+        __attribute__((vector_size(n_lanes * sizeof(float))));
+
+    /* block energies, which can be combined over several songs (an album) */
+    typedef Index<double> Blocks;
+
+    LoudnessMeter(int channels, int rate);
+
+    /* takes interleaved samples */
+    void process(const float * data, int frames);
+
+    const Blocks & blocks() const { return m_blocks; }
+
+    /* true peak (or sample peak at 96 kHz and above), linear */
+    float peak() const;
+
+    /* gated loudness in LUFS, or -HUGE_VAL if nothing passes the gate */
+    static double integrate(const Blocks & blocks);
+
+private:
+    struct Biquad
+    {
+        Lanes b0, b1, b2, a1, a2;
+    };
+
+    void filter(int group, const float * data, int frames);
+    void end_step();
+
+    int m_channels, m_groups;
+    int m_step, m_step_left; /* frames per 100 ms */
+
+    Biquad m_shelf, m_highpass;
+    Lanes m_state[n_groups][4];
+    Lanes m_sum[n_groups];
+    double m_weights[n_groups * n_lanes];
+
+    double m_steps[3]; /* previous three 100 ms energies */
+    int m_n_steps;
+
+    bool m_oversample;
+    PeakLanes m_history[n_groups][2 * n_taps];
+    int m_history_pos[n_groups];
+    PeakLanes m_peak_lanes[n_groups];
+
+    Blocks m_blocks;
+};
+
+#endif // LIBAUDCORE_LOUDNESS_METER_H
@@ -0,0 +1,693 @@
+/*
+ * loudness.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Loudness analysis, as a fallback for songs without ReplayGain tags.  Songs
+ * are decoded by background workers into a DecodeSink (rather than the output
+ * system) and measured by LoudnessMeter.  Jobs are single songs or whole
+ * albums, the latter measured together so that album loudness can be gated
+ * over all of their blocks.  Upcoming songs jump the queue.
+ *
+ * Results are kept in memory and saved at exit to a small text file, each
+ * tagged with the song file's modification time, so that they survive restarts
+ * but not file changes. */
+
+#define __STDC_FORMAT_MACROS
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <glib.h> /* for g_get_user_cache_dir */
+#include <glib/gstdio.h>
+
+#include "audstrings.h"
+#include "drct.h"
+#include "hook.h"
+#include "internal.h"
+#include "loudness-meter.h"
+#include "mainloop.h"
+#include "multihash.h"
+#include "parse.h"
+#include "plugin.h"
+#include "plugins.h"
+#include "probe.h"
+#include "runtime.h"
+#include "threads.h"
+#include "vfs.h"
+
+#define FORMAT 1
+
+static constexpr int max_workers = 8;
+
+/* ReplayGain 2.0 reference level, in LUFS */
+static constexpr float reference_loudness = -18;
+
+/* URIs longer than this are not saved, since TextParser could not read them
+ * back in one piece */
+static constexpr int max_value_len = 480;
+
+struct CacheEntry
+{
+    int64_t mtime;
+    AudLoudnessInfo info;
+};
+
+struct LoudnessJob
+{
+    Index<String> files;
+    bool album;
+};
+
+struct Measurement
+{
+    String file;
+    int64_t mtime;
+    float loudness, peak;
+};
+
+static aud::mutex mutex;
+static aud::condvar cond;
+static std::thread workers[max_workers];
+static int n_workers;
+static bool quit;
+
+/* incremented to stop the songs being analyzed */
+static std::atomic<int> stop_serial(0);
+
+static SimpleHash<String, CacheEntry> cache;
+static bool cache_loaded, cache_changed;
+
+static Index<LoudnessJob> jobs; /* next job first */
+static Index<String> pending;   /* files of queued or running jobs */
+static AudLoudnessProgress progress;
+static QueuedFunc queued_progress;
+
+static StringBuf get_cache_path()
+{
+    return filename_build({g_get_user_cache_dir(), "audacious", "loudness"});
+}
+
+/* only local song files are analyzed, since results are validated against
+ * the file's modification time */
+static int64_t get_mtime(const char * filename)
+{
+    StringBuf path = uri_to_filename(strip_subtune(filename));
+    GStatBuf st;
+
+    if (!path || g_stat(path, &st) < 0)
+        return -1;
+
+    return st.st_mtime;
+}
+
+static bool read_pair(const TextParser & parser, const char * key,
+                      float & loudness, float & peak)
+{
+    String value = parser.get_str(key);
+    double pair[2];
+
+    if (!value || !str_to_double_array(value, pair, 2))
+        return false;
+
+    loudness = pair[0];
+    peak = pair[1];
+    return true;
+}
+
+static void load_cache(aud::mutex::holder &)
+{
+    if (cache_loaded)
+        return;
+
+    cache_loaded = true;
+
+    FILE * handle = g_fopen(get_cache_path(), "r");
+    if (!handle)
+        return;
+
+    TextParser parser(handle);
+
+    int format;
+    if (!parser.get_int("format", format) || format != FORMAT)
+    {
+        fclose(handle);
+        return;
+    }
+
+    parser.next();
+
+    while (!parser.eof())
+    {
+        String uri = parser.get_str("uri");
+        if (!uri)
+        {
+            parser.next();
+            continue;
+        }
+
+        CacheEntry entry{-1};
+        bool has_track = false, has_album = false;
+
+        for (parser.next(); !parser.eof() && !parser.get_str("uri");
+             parser.next())
+        {
+            String stamp = parser.get_str("stamp");
+            if (stamp)
+                entry.mtime = strtoll(stamp, nullptr, 10);
+            else if (read_pair(parser, "track", entry.info.track_loudness,
+                               entry.info.track_peak))
+                has_track = true;
+            else if (read_pair(parser, "album", entry.info.album_loudness,
+                               entry.info.album_peak))
+                has_album = true;
+        }
+
+        if (entry.mtime < 0 || !has_track)
+            continue;
+
+        if (!has_album)
+        {
+            entry.info.album_loudness = entry.info.track_loudness;
+            entry.info.album_peak = entry.info.track_peak;
+        }
+
+        cache.add(uri, std::move(entry));
+    }
+
+    fclose(handle);
+}
+
+static void write_pair(FILE * handle, const char * key, float loudness,
+                       float peak)
+{
+    double pair[2] = {loudness, peak};
+    fprintf(handle, "%s %s\n", key,
+            (const char *)double_array_to_str(pair, 2));
+}
+
+static void save_cache(aud::mutex::holder &)
+{
+    if (!cache_changed)
+        return;
+
+    StringBuf path = get_cache_path();
+    StringBuf dir = filename_build({g_get_user_cache_dir(), "audacious"});
+
+    if (g_mkdir_with_parents(dir, 0700) < 0)
+    {
+        AUDERR("Error creating %s: %s\n", (const char *)dir, strerror(errno));
+        return;
+    }
+
+    StringBuf temp = str_concat({path, ".XXXXXX"});
+
+    int fd = g_mkstemp(temp);
+    FILE * handle = (fd < 0) ? nullptr : fdopen(fd, "w");
+
+    if (!handle)
+    {
+        AUDERR("Error creating %s: %s\n", (const char *)temp, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return;
+    }
+
+    fprintf(handle, "format %d\n", FORMAT);
+
+    cache.iterate([&](const String & uri, CacheEntry & entry) {
+        if (strlen(uri) > max_value_len)
+            return;
+
+        const AudLoudnessInfo & info = entry.info;
+
+        fprintf(handle, "uri %s\n", (const char *)uri);
+        fprintf(handle, "stamp %" PRId64 "\n", entry.mtime);
+        write_pair(handle, "track", info.track_loudness, info.track_peak);
+
+        if (info.album_loudness != info.track_loudness ||
+            info.album_peak != info.track_peak)
+            write_pair(handle, "album", info.album_loudness, info.album_peak);
+    });
+
+    bool success = !ferror(handle);
+
+    if (fclose(handle) < 0)
+        success = false;
+
+    /* replace any existing file atomically */
+    if (!success || g_rename(temp, path) < 0)
+    {
+        AUDERR("Error writing %s: %s\n", (const char *)path, strerror(errno));
+        g_unlink(temp);
+        return;
+    }
+
+    cache_changed = false;
+}
+
+static const CacheEntry * lookup(aud::mutex::holder & mh, const char * filename,
+                                 int64_t mtime)
+{
+    load_cache(mh);
+
+    const CacheEntry * entry = cache.lookup(String(filename));
+    return (entry && entry->mtime == mtime) ? entry : nullptr;
+}
+
+static void send_progress() { hook_call("loudness progress", nullptr); }
+
+/* decodes a song without output, measuring it on the way */
+class AnalysisSink : public DecodeSink
+{
+public:
+    explicit AnalysisSink(int serial) : m_serial(serial) {}
+
+    void open_audio(int format, int rate, int channels)
+    {
+        /* a change of format in mid-song cannot be measured consistently */
+        if (m_meter || rate < 1 || channels < 1 ||
+            channels > AUD_MAX_CHANNELS)
+        {
+            m_error = true;
+            return;
+        }
+
+        m_format = format;
+        m_rate = rate;
+        m_channels = channels;
+        m_meter.capture(new LoudnessMeter(channels, rate));
+    }
+
+    void write_audio(const void * data, int length)
+    {
+        if (!m_meter || m_error)
+            return;
+
+        int frames = length / (FMT_SIZEOF(m_format) * m_channels);
+        auto samples = (const float *)data;
+
+        if (m_format != FMT_FLOAT)
+        {
+            m_buffer.resize(frames * m_channels);
+            audio_from_int(data, m_format, m_buffer.begin(), m_buffer.len());
+            samples = m_buffer.begin();
+        }
+
+        m_meter->process(samples, frames);
+        throttle(frames);
+    }
+
+    bool check_stop()
+    {
+        return m_error ||
+               stop_serial.load(std::memory_order_relaxed) != m_serial;
+    }
+
+    SmartPtr<LoudnessMeter> take_meter()
+    {
+        return m_error ? SmartPtr<LoudnessMeter>() : std::move(m_meter);
+    }
+
+private:
+    void throttle(int frames);
+
+    int m_serial;
+    bool m_error = false;
+    int m_format = 0, m_rate = 0, m_channels = 0;
+
+    SmartPtr<LoudnessMeter> m_meter;
+    Index<float> m_buffer;
+
+    std::chrono::steady_clock::time_point m_throttle_start;
+    int64_t m_throttle_frames = -1; /* -1 while not throttled */
+};
+
+/* while a song is playing, holds the analysis to a multiple of real time so
+ * that it does not compete with playback for the processor and disk */
+void AnalysisSink::throttle(int frames)
+{
+    using namespace std::chrono;
+
+    int speed = aud_get_int("loudness_max_speed");
+
+    if (speed <= 0 || !aud_drct_get_playing())
+    {
+        m_throttle_frames = -1;
+        return;
+    }
+
+    if (m_throttle_frames < 0)
+    {
+        m_throttle_start = steady_clock::now();
+        m_throttle_frames = 0;
+    }
+
+    m_throttle_frames += frames;
+
+    int64_t rate = (int64_t)m_rate * speed;
+    auto due = m_throttle_start +
+               microseconds(m_throttle_frames * 1000000 / rate);
+
+    auto mh = mutex.take();
+    cond.wait_until(mh, due, [this]() { return check_stop(); });
+}
+
+static SmartPtr<LoudnessMeter> measure(const String & file, int serial)
+{
+    VFSFile handle;
+    PluginHandle * decoder = aud_file_find_decoder(file, false, handle);
+    if (!decoder)
+        return SmartPtr<LoudnessMeter>();
+
+    InputPlugin * ip = load_input_plugin(decoder);
+    if (!ip)
+        return SmartPtr<LoudnessMeter>();
+
+    if (!(ip->input_info.flags & InputPlugin::FlagConcurrentPlay))
+    {
+        AUDINFO("%s cannot decode in the background; not analyzing %s.\n",
+                aud_plugin_get_basename(decoder), (const char *)file);
+        return SmartPtr<LoudnessMeter>();
+    }
+
+    if (!open_input_file(file, "r", ip, handle))
+        return SmartPtr<LoudnessMeter>();
+
+    handle.set_access_hint(VFS_ACCESS_SEQUENTIAL);
+
+    AnalysisSink sink(serial);
+
+    playback_set_decode_sink(&sink);
+    bool success = ip->play(file, handle);
+    playback_set_decode_sink(nullptr);
+
+    if (!success || sink.check_stop())
+        return SmartPtr<LoudnessMeter>();
+
+    return sink.take_meter();
+}
+
+/* songs too short or too quiet to pass the gate are left at reference level */
+static float get_loudness(const LoudnessMeter::Blocks & blocks)
+{
+    double loudness = LoudnessMeter::integrate(blocks);
+    return isfinite(loudness) ? loudness : reference_loudness;
+}
+
+static void run_job(aud::mutex::holder & mh, LoudnessJob & job)
+{
+    int serial = stop_serial.load(std::memory_order_relaxed);
+
+    Index<Measurement> results;
+    LoudnessMeter::Blocks album_blocks;
+    float album_peak = 0;
+
+    for (const String & file : job.files)
+    {
+        mh.unlock();
+        int64_t mtime = get_mtime(file);
+        mh.lock();
+
+        bool skip = (mtime < 0) || (!job.album && lookup(mh, file, mtime));
+
+        if (!skip)
+        {
+            mh.unlock();
+
+            AUDINFO("Analyzing loudness of %s.\n", (const char *)file);
+            audtrace::Span span("loudness_analysis", file);
+
+            auto meter = measure(file, serial);
+
+            if (meter)
+            {
+                results.append(file, mtime, get_loudness(meter->blocks()),
+                               meter->peak());
+
+                if (job.album)
+                {
+                    album_blocks.insert(meter->blocks().begin(), -1,
+                                        meter->blocks().len());
+                    album_peak = aud::max(album_peak, meter->peak());
+                }
+            }
+
+            mh.lock();
+        }
+
+        if (quit || stop_serial.load(std::memory_order_relaxed) != serial)
+            return;
+
+        progress.done++;
+        queued_progress.queue(send_progress);
+    }
+
+    float album_loudness = get_loudness(album_blocks);
+
+    for (Measurement & result : results)
+    {
+        AudLoudnessInfo info{result.loudness, result.peak, result.loudness,
+                             result.peak};
+
+        if (job.album)
+        {
+            info.album_loudness = album_loudness;
+            info.album_peak = album_peak;
+        }
+
+        cache.add(result.file, {result.mtime, info});
+        cache_changed = true;
+    }
+}
+
+static void worker()
+{
+    auto mh = mutex.take();
+
+    while (!quit)
+    {
+        if (!jobs.len())
+        {
+            cond.wait(mh);
+            continue;
+        }
+
+        LoudnessJob job = std::move(jobs[0]);
+        jobs.remove(0, 1);
+
+        run_job(mh, job);
+
+        for (const String & file : job.files)
+            pending.remove(pending.find(file), 1);
+    }
+}
+
+static void start_workers(aud::mutex::holder &)
+{
+    if (n_workers || quit)
+        return;
+
+    n_workers = aud::clamp(aud_get_int("loudness_threads"), 1, max_workers);
+
+    for (int i = 0; i < n_workers; i++)
+        workers[i] = std::thread(worker);
+}
+
+static Index<String> single(const String & file)
+{
+    Index<String> files;
+    files.append(file);
+    return files;
+}
+
+/* adds a job at the front or back of the queue */
+static void add_job(aud::mutex::holder & mh, Index<String> && files,
+                    bool album, bool front)
+{
+    /* start counting anew after the queue has run empty */
+    if (!pending.len())
+        progress = AudLoudnessProgress();
+
+    progress.total += files.len();
+    pending.insert(files.begin(), -1, files.len());
+
+    if (front)
+    {
+        jobs.insert(0, 1);
+        jobs[0] = {std::move(files), album};
+    }
+    else
+        jobs.append(std::move(files), album);
+
+    start_workers(mh);
+    cond.notify_all();
+}
+
+EXPORT void aud_loudness_analyze(const Index<String> & files, bool album)
+{
+    auto mh = mutex.take();
+
+    if (quit || !files.len())
+        return;
+
+    if (album)
+    {
+        Index<String> copy;
+        copy.insert(files.begin(), 0, files.len());
+        add_job(mh, std::move(copy), true, false);
+    }
+    else
+    {
+        for (const String & file : files)
+        {
+            if (pending.find(file) < 0)
+                add_job(mh, single(file), false, false);
+        }
+    }
+}
+
+/* called from the playback thread with the songs likely to be played next */
+void loudness_prioritize(const Index<String> & filenames)
+{
+    Index<int64_t> mtimes;
+    for (const String & file : filenames)
+        mtimes.append(get_mtime(file));
+
+    auto mh = mutex.take();
+
+    if (quit)
+        return;
+
+    /* go backward so that the next song ends up first */
+    for (int i = filenames.len() - 1; i >= 0; i--)
+    {
+        const String & file = filenames[i];
+
+        if (mtimes[i] < 0 || lookup(mh, file, mtimes[i]))
+            continue;
+
+        if (pending.find(file) < 0)
+        {
+            add_job(mh, single(file), false, true);
+            continue;
+        }
+
+        /* move a waiting job (perhaps a whole album) to the front */
+        for (int j = 1; j < jobs.len(); j++)
+        {
+            if (jobs[j].files.find(file) >= 0)
+            {
+                LoudnessJob job = std::move(jobs[j]);
+                jobs.remove(j, 1);
+                jobs.insert(0, 1);
+                jobs[0] = std::move(job);
+                break;
+            }
+        }
+    }
+}
+
+EXPORT void aud_loudness_cancel()
+{
+    auto mh = mutex.take();
+
+    for (const LoudnessJob & job : jobs)
+    {
+        for (const String & file : job.files)
+            pending.remove(pending.find(file), 1);
+    }
+
+    jobs.clear();
+    progress = AudLoudnessProgress();
+
+    stop_serial++;
+    cond.notify_all();
+
+    queued_progress.queue(send_progress);
+}
+
+EXPORT AudLoudnessProgress aud_loudness_get_progress()
+{
+    auto mh = mutex.take();
+    return progress;
+}
+
+EXPORT bool aud_loudness_get(const char * file, AudLoudnessInfo & info)
+{
+    int64_t mtime = get_mtime(file);
+    if (mtime < 0)
+        return false;
+
+    auto mh = mutex.take();
+
+    const CacheEntry * entry = lookup(mh, file, mtime);
+    if (!entry)
+        return false;
+
+    info = entry->info;
+    return true;
+}
+
+bool loudness_get_gain(const char * filename, ReplayGainInfo & gain)
+{
+    AudLoudnessInfo info;
+    if (!aud_loudness_get(filename, info))
+        return false;
+
+    gain.track_gain = reference_loudness - info.track_loudness;
+    gain.track_peak = info.track_peak;
+    gain.album_gain = reference_loudness - info.album_loudness;
+    gain.album_peak = info.album_peak;
+    return true;
+}
+
+void loudness_cleanup()
+{
+    auto mh = mutex.take();
+
+    quit = true;
+    stop_serial++;
+    cond.notify_all();
+
+    if (n_workers)
+    {
+        mh.unlock();
+
+        for (int i = 0; i < n_workers; i++)
+            workers[i].join();
+
+        mh.lock();
+        n_workers = 0;
+    }
+
+    queued_progress.stop();
+
+    jobs.clear();
+    pending.clear();
+
+    save_cache(mh);
+    cache.clear();
+    cache_loaded = false;
+}
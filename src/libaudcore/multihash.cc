@@ -26,6 +26,8 @@ EXPORT void HashBase::add(Node * node, unsigned hash)
         buckets = new Node *[InitialSize]();
         size = InitialSize;
     }
+    else
+        step_resize();
 
     unsigned b = hash & (size - 1);
     node->next = buckets[b];
@@ -37,27 +39,40 @@ EXPORT void HashBase::add(Node * node, unsigned hash)
         resize(size << 1);
 }
 
+static HashBase::Node ** find_in_chain(HashBase::Node ** node_ptr,
+                                       HashBase::MatchFunc match,
+                                       const void * data, unsigned hash)
+{
+    for (HashBase::Node * node; (node = *node_ptr); node_ptr = &node->next)
+    {
+        if (node->hash == hash && match(node, data))
+            return node_ptr;
+    }
+
+    return nullptr;
+}
+
 EXPORT HashBase::Node * HashBase::lookup(MatchFunc match, const void * data,
                                          unsigned hash, NodeLoc * loc) const
 {
     if (!buckets)
         return nullptr;
 
-    unsigned b = hash & (size - 1);
-    Node ** node_ptr = &buckets[b];
-    Node * node = *node_ptr;
+    Node ** node_ptr = find_in_chain(&buckets[hash & (size - 1)], match, data,
+                                     hash);
 
-    while (1)
+    /* during a resize, the node may not have been moved yet */
+    if (!node_ptr && old_buckets)
     {
-        if (!node)
-            return nullptr;
+        unsigned b = hash & (old_size - 1);
+        if (b >= migrated)
+            node_ptr = find_in_chain(&old_buckets[b], match, data, hash);
+    }
 
-        if (node->hash == hash && match(node, data))
-            break;
+    if (!node_ptr)
+        return nullptr;
 
-        node_ptr = &node->next;
-        node = *node_ptr;
-    }
+    Node * node = *node_ptr;
 
     if (loc)
     {
@@ -72,6 +87,8 @@ EXPORT void HashBase::remove(const NodeLoc & loc)
 {
     *loc.ptr = loc.next;
 
+    step_resize();
+
     used--;
     if (used<size>> 2 && size > InitialSize)
         resize(size >> 1);
@@ -79,6 +96,8 @@ EXPORT void HashBase::remove(const NodeLoc & loc)
 
 EXPORT void HashBase::iterate(FoundFunc func, void * state)
 {
+    finish_resize();
+
     for (unsigned b = 0; b < size; b++)
     {
         Node ** ptr = &buckets[b];
@@ -104,42 +123,123 @@ EXPORT void HashBase::iterate(FoundFunc func, void * state)
         resize(size >> 1);
 }
 
-void HashBase::resize(unsigned new_size)
+EXPORT void HashBase::step_resize()
+{
+    if (old_buckets)
+        migrate(MigrateStep);
+}
+
+EXPORT void HashBase::get_stats(HashStats & stats) const
 {
-    Node ** new_buckets = new Node *[new_size]();
+    auto count_chain = [&](const Node * node) {
+        int len = 0;
+        for (; node; node = node->next)
+            len++;
+
+        if (len)
+            stats.used_buckets++;
+        if (len > stats.max_chain)
+            stats.max_chain = len;
+    };
+
+    for (unsigned b = 0; b < size; b++)
+        count_chain(buckets[b]);
 
-    for (unsigned b1 = 0; b1 < size; b1++)
+    if (old_buckets)
     {
-        Node * node = buckets[b1];
+        for (unsigned b = migrated; b < old_size; b++)
+            count_chain(old_buckets[b]);
 
-        while (node)
-        {
-            Node * next = node->next;
+        stats.resizing++;
+    }
 
-            unsigned b2 = node->hash & (new_size - 1);
-            node->next = new_buckets[b2];
-            new_buckets[b2] = node;
+    stats.items += used;
+    stats.buckets += size;
+}
 
-            node = next;
-        }
+void HashBase::move_chain(Node * node)
+{
+    while (node)
+    {
+        Node * next = node->next;
+
+        unsigned b = node->hash & (size - 1);
+        node->next = buckets[b];
+        buckets[b] = node;
+
+        node = next;
     }
+}
 
-    delete[] buckets;
-    buckets = new_buckets;
+void HashBase::migrate(unsigned n_chains)
+{
+    unsigned end = aud::min(migrated + n_chains, old_size);
+
+    for (; migrated < end; migrated++)
+        move_chain(old_buckets[migrated]);
+
+    if (migrated == old_size)
+    {
+        delete[] old_buckets;
+        old_buckets = nullptr;
+        old_size = migrated = 0;
+    }
+}
+
+void HashBase::finish_resize()
+{
+    if (old_buckets)
+        migrate(old_size);
+}
+
+void HashBase::resize(unsigned new_size)
+{
+    /* only one resize can be in progress at a time */
+    finish_resize();
+
+    old_buckets = buckets;
+    old_size = size;
+    migrated = 0;
+
+    buckets = new Node *[new_size]();
     size = new_size;
+
+    if (used < MinIncremental)
+        finish_resize();
 }
 
+/* Takes a channel lock, counting the times it was already held. */
+class MultiHash::ChannelLock
+{
+public:
+    explicit ChannelLock(Channel & channel) : m_channel(channel)
+    {
+        if (!channel.lock.try_lock())
+        {
+            channel.lock.lock();
+            channel.contended++;
+        }
+    }
+
+    ~ChannelLock() { m_channel.lock.unlock(); }
+
+private:
+    Channel & m_channel;
+};
+
 EXPORT int MultiHash::lookup(const void * data, unsigned hash, AddFunc add,
                              FoundFunc found, void * state)
 {
-    const unsigned c = (hash >> Shift) & (Channels - 1);
-    HashBase & channel = channels[c];
+    const unsigned c = (hash >> Shift) & (n_channels - 1);
+    Channel & channel = channels[c];
 
     int status = 0;
-    auto lh = locks[c].take();
+    ChannelLock lh(channel);
+
+    channel.lookups++;
 
     HashBase::NodeLoc loc;
-    Node * node = channel.lookup(match, data, hash, &loc);
+    Node * node = channel.table.lookup(match, data, hash, &loc);
 
     if (node)
     {
@@ -147,13 +247,15 @@ EXPORT int MultiHash::lookup(const void * data, unsigned hash, AddFunc add,
         if (found && found(node, state))
         {
             status |= Removed;
-            channel.remove(loc);
+            channel.table.remove(loc);
         }
+        else
+            channel.table.step_resize();
     }
     else if (add && (node = add(data, state)))
     {
         status |= Added;
-        channel.add(node, hash);
+        channel.table.add(node, hash);
     }
 
     return status;
@@ -167,13 +269,38 @@ EXPORT void MultiHash::iterate(FoundFunc func, void * state)
 EXPORT void MultiHash::iterate(FoundFunc func, void * state, FinalFunc final,
                                void * fstate)
 {
-    aud::spinlock::holder lh[Channels];
-    for (int i = 0; i < Channels; i++)
-        lh[i] = locks[i].take();
+    aud::spinlock::holder lh[MaxChannels];
+    for (int i = 0; i < n_channels; i++)
+        lh[i] = channels[i].lock.take();
 
-    for (HashBase & channel : channels)
-        channel.iterate(func, state);
+    for (int i = 0; i < n_channels; i++)
+        channels[i].table.iterate(func, state);
 
     if (final)
         final(fstate);
 }
+
+EXPORT void MultiHash::iterate_by_channel(FoundFunc func, void * state)
+{
+    for (int i = 0; i < n_channels; i++)
+    {
+        ChannelLock lh(channels[i]);
+        channels[i].table.iterate(func, state);
+    }
+}
+
+EXPORT HashStats MultiHash::get_stats()
+{
+    HashStats stats;
+    stats.channels = n_channels;
+
+    for (int i = 0; i < n_channels; i++)
+    {
+        ChannelLock lh(channels[i]);
+        channels[i].table.get_stats(stats);
+        stats.lookups += channels[i].lookups;
+        stats.contended += channels[i].contended;
+    }
+
+    return stats;
+}
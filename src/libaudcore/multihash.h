@@ -21,10 +21,34 @@
 #define LIBAUDCORE_MULTIHASH_H
 
 #include <libaudcore/threads.h>
+#include <stdint.h>
 #include <utility>
 
+/* Statistics gathered from a hash table, for tuning purposes. */
+
+struct HashStats
+{
+    int channels = 0;
+    int items = 0;
+    int buckets = 0;
+    int used_buckets = 0; /* buckets containing at least one node */
+    int max_chain = 0;    /* length of the longest bucket chain */
+    int resizing = 0;     /* channels with an incremental resize in progress */
+    int64_t lookups = 0;
+    int64_t contended = 0; /* lookups that had to wait for a channel lock */
+
+    float load_factor() const { return buckets ? (float)items / buckets : 0; }
+    float avg_chain() const
+    {
+        return used_buckets ? (float)items / used_buckets : 0;
+    }
+};
+
 /* HashBase is a low-level hash table implementation.  It is used as a backend
- * for SimpleHash as well as for a single channel of MultiHash. */
+ * for SimpleHash as well as for a single channel of MultiHash.  Large tables
+ * are resized incrementally: the old bucket array is kept alongside the new
+ * one and its chains are moved over a few at a time, so that no single
+ * operation has to rehash the entire table. */
 
 class HashBase
 {
@@ -53,11 +77,16 @@ public:
      * removed, otherwise false. */
     typedef bool (*FoundFunc)(Node * node, void * state);
 
-    constexpr HashBase() : buckets(nullptr), size(0), used(0) {}
+    constexpr HashBase()
+        : buckets(nullptr), old_buckets(nullptr), size(0), old_size(0),
+          migrated(0), used(0)
+    {
+    }
 
     void clear() // use as destructor
     {
         delete[] buckets;
+        delete[] old_buckets;
         *this = HashBase();
     }
 
@@ -78,13 +107,30 @@ public:
     /* Iterates over all nodes in the table, removing them as desired. */
     void iterate(FoundFunc func, void * state);
 
+    /* Moves a few more bucket chains if a resize is in progress.  Called
+     * automatically by add() and remove(); callers doing mostly lookups may
+     * call it to complete a resize sooner. */
+    void step_resize();
+
+    /* Adds the statistics of this table to <stats>. */
+    void get_stats(HashStats & stats) const;
+
 private:
     static constexpr unsigned InitialSize = 16;
+    static constexpr unsigned MigrateStep = 8;     /* chains moved per step */
+    static constexpr unsigned MinIncremental = 256; /* smaller tables are
+                                                      resized all at once */
 
     void resize(unsigned new_size);
+    void migrate(unsigned n_chains);
+    void finish_resize();
+    void move_chain(Node * node);
 
     Node ** buckets;
-    unsigned size, used;
+    Node ** old_buckets; /* non-null while a resize is in progress */
+    unsigned size, old_size;
+    unsigned migrated; /* number of old buckets already moved */
+    unsigned used;
 };
 
 /* MultiHash is a generic, thread-safe hash table.  It scales well to multiple
@@ -111,7 +157,14 @@ public:
      * table.  Returns the new node or null. */
     typedef Node * (*AddFunc)(const void * data, void * state);
 
-    MultiHash(MatchFunc match) : match(match), locks(), channels() {}
+    static constexpr int DefaultChannels = 16;
+    static constexpr int MaxChannels = 64;
+
+    /* <n_channels> is rounded up to a power of two, at most MaxChannels. */
+    constexpr MultiHash(MatchFunc match, int n_channels = DefaultChannels)
+        : match(match), n_channels(round_channels(n_channels)), channels()
+    {
+    }
 
     /* There is no destructor.  In some instances, such as the string pool, it
      * is never safe to destroy the hash table, since it can be referenced from
@@ -138,13 +191,42 @@ public:
      * operation needs to be performed with the table in a known state. */
     void iterate(FoundFunc func, void * state, FinalFunc final, void * fstate);
 
+    /* Variant of iterate() which locks only one channel at a time, so that
+     * lookups in the rest of the table can proceed during the iteration.  The
+     * table is not frozen: nodes added to or removed from other channels while
+     * the iteration is running may or may not be visited. */
+    void iterate_by_channel(FoundFunc func, void * state);
+
+    /* Returns statistics for the whole table.  Each channel is locked briefly
+     * in turn, so the result is not an exact snapshot. */
+    HashStats get_stats();
+
 private:
-    static constexpr int Channels = 16; /* must be a power of two */
-    static constexpr int Shift = 24;    /* bit shift for channel selection */
+    static constexpr int Shift = 24; /* bit shift for channel selection */
+
+    static constexpr int round_channels(int n)
+    {
+        int rounded = 1;
+        while (rounded < n && rounded < MaxChannels)
+            rounded <<= 1;
+        return rounded;
+    }
+
+    /* Each channel gets its own cache line(s) to avoid false sharing between
+     * processors working on different channels. */
+    struct alignas(64) Channel
+    {
+        aud::spinlock lock;
+        HashBase table;
+        int64_t lookups = 0;
+        int64_t contended = 0;
+    };
+
+    class ChannelLock;
 
     const MatchFunc match;
-    aud::spinlock locks[Channels];
-    HashBase channels[Channels];
+    const int n_channels;
+    Channel channels[MaxChannels];
 };
 
 /* Type-safe version using templates. */
@@ -166,7 +248,10 @@ public:
     //     bool found (Node_T * node);
     // };
 
-    MultiHash_T() : MultiHash(match_cb) {}
+    constexpr MultiHash_T(int n_channels = DefaultChannels)
+        : MultiHash(match_cb, n_channels)
+    {
+    }
 
     void clear() { MultiHash::iterate(remove_cb, nullptr); }
 
@@ -190,6 +275,14 @@ public:
                            &final);
     }
 
+    template<class F>
+    void iterate_by_channel(F func)
+    {
+        MultiHash::iterate_by_channel(WrapIterate<F>::run, &func);
+    }
+
+    using MultiHash::get_stats;
+
 private:
     static bool match_cb(const Node * node, const void * data)
     {
@@ -218,9 +218,10 @@ public:
     // Resizes to <len> bytes (not counting the terminating null byte) by
     // appended uninitialized bytes or truncating.  The resized string will be
     // null-terminated unless <len> is -1.  A length of -1 means to make the
-    // string as large as possible.  This can be useful when the required length
-    // is not known in advance.  However, it will be impossible to create any
-    // further StringBufs until resize() is called again.
+    // string as large as possible (at least half a megabyte).  This can be
+    // useful when the required length is not known in advance.  However, it
+    // will be impossible to create any further StringBufs until resize() is
+    // called again.
     void resize(int len);
 
     // Inserts the substring <s> at the given position, or appends it if <pos>
@@ -24,6 +24,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <chrono>
+
 #include "equalizer.h"
 #include "hook.h"
 #include "i18n.h"
@@ -31,6 +33,7 @@
 #include "internal.h"
 #include "plugin.h"
 #include "plugins.h"
+#include "resampler.h"
 #include "runtime.h"
 #include "threads.h"
 
@@ -161,6 +164,21 @@ static bool gain_info_valid;
 
 static Index<float> buffer1;
 static Index<char> buffer2;
+static Index<float> buffer3;
+
+/* converts from effect_rate to out_rate when the two differ */
+static SmartPtr<Resampler> resampler;
+
+/* when the last audio of the previous song was written (in microseconds), or
+ * -1; used to measure the gap before the first audio of the next song */
+static int64_t song_end_time = -1;
+
+static int64_t get_timestamp()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch())
+        .count();
+}
 
 static inline int get_format(bool & automatic)
 {
@@ -212,6 +230,8 @@ static void cleanup_output(UnsafeLock & lock)
 
     buffer1.clear();
     buffer2.clear();
+    buffer3.clear();
+    resampler.clear();
 
     cop->close_audio();
     vis_runner_start_stop(false, false);
@@ -248,6 +268,23 @@ static bool open_audio_with_info(OutputPlugin * op, const char * filename,
     return op->open_audio(format, rate, chans, error);
 }
 
+/* With resampling enabled, the output stays open at a fixed rate: either the
+ * configured one or else the one it was first opened at. */
+static int get_output_rate()
+{
+    if (!aud_get_bool("resample_output"))
+        return effect_rate;
+
+    int rate = aud_get_int("resample_rate");
+    if (rate > 0)
+        return aud::clamp(rate, 8000, 768000);
+
+    return state.output() ? out_rate : effect_rate;
+}
+
+static void setup_resampler(UnsafeLock & lock);
+static void finish_resampler(UnsafeLock & lock);
+
 static void setup_output(UnsafeLock & lock, bool new_input, bool pause)
 {
     assert(state.input());
@@ -257,24 +294,26 @@ static void setup_output(UnsafeLock & lock, bool new_input, bool pause)
 
     bool automatic;
     int format = get_format(automatic);
+    int rate = get_output_rate();
 
     if (state.output() && effect_channels == out_channels &&
-        effect_rate == out_rate && !(new_input && cop->force_reopen))
+        rate == out_rate && !(new_input && cop->force_reopen))
     {
-        AUDINFO("Reuse output, %d channels, %d Hz.\n", effect_channels,
-                effect_rate);
+        AUDINFO("Reuse output, %d channels, %d Hz.\n", effect_channels, rate);
+        setup_resampler(lock);
         apply_pause(lock, pause);
         return;
     }
 
     AUDINFO("Setup output, format %d, %d channels, %d Hz.\n", format,
-            effect_channels, effect_rate);
+            effect_channels, rate);
 
+    finish_resampler(lock);
     cleanup_output(lock);
 
     String error;
-    while (!open_audio_with_info(cop, in_filename, in_tuple, format,
-                                 effect_rate, effect_channels, error))
+    while (!open_audio_with_info(cop, in_filename, in_tuple, format, rate,
+                                 effect_channels, error))
     {
         if (automatic && format == FMT_FLOAT)
             format = FMT_S32_NE;
@@ -297,12 +336,13 @@ static void setup_output(UnsafeLock & lock, bool new_input, bool pause)
 
     out_format = format;
     out_channels = effect_channels;
-    out_rate = effect_rate;
+    out_rate = rate;
 
     out_bytes_per_sec = FMT_SIZEOF(format) * out_channels * out_rate;
     out_bytes_held = 0;
     out_bytes_written = 0;
 
+    setup_resampler(lock);
     apply_pause(lock, pause, true);
 }
 
@@ -355,6 +395,9 @@ static void flush_output(SafeLock &)
     out_bytes_held = 0;
     out_bytes_written = 0;
 
+    if (resampler)
+        resampler->reset();
+
     cop->flush();
     vis_runner_flush();
 }
@@ -405,25 +448,22 @@ static void write_secondary(SafeLock &, const Index<float> & data)
         begin += sop->write_audio(begin, end - begin);
 }
 
-static void write_output(UnsafeLock & lock, Index<float> & data)
+/* audio held in the resampler, in milliseconds */
+static int get_resampler_delay(SafeLock &)
 {
-    assert(state.output());
+    if (!resampler)
+        return 0;
 
+    return aud::rescale<int64_t>(resampler->pending(), resampler->in_rate(),
+                                 1000);
+}
+
+/* writes audio at the output rate */
+static void write_device(UnsafeLock & lock, Index<float> & data)
+{
     if (!data.len())
         return;
 
-    if (state.secondary() && record_stream == OutputStream::AfterEffects)
-        write_secondary(lock, data);
-
-    int out_time =
-        aud::rescale<int64_t>(out_bytes_written, out_bytes_per_sec, 1000);
-    vis_runner_pass_audio(out_time, data, out_channels, out_rate);
-
-    eq_filter(data.begin(), data.len());
-
-    if (state.secondary() && record_stream == OutputStream::AfterEqualizer)
-        write_secondary(lock, data);
-
     if (aud_get_bool("software_volume_control"))
     {
         StereoVolume v = {aud_get_int("sw_volume_left"),
@@ -473,6 +513,78 @@ static void write_output(UnsafeLock & lock, Index<float> & data)
     }
 }
 
+static void write_output(UnsafeLock & lock, Index<float> & data)
+{
+    assert(state.output());
+
+    if (!data.len())
+        return;
+
+    if (state.secondary() && record_stream == OutputStream::AfterEffects)
+        write_secondary(lock, data);
+
+    int out_time =
+        aud::rescale<int64_t>(out_bytes_written, out_bytes_per_sec, 1000) +
+        get_resampler_delay(lock);
+    vis_runner_pass_audio(out_time, data, effect_channels, effect_rate);
+
+    eq_filter(data.begin(), data.len());
+
+    if (state.secondary() && record_stream == OutputStream::AfterEqualizer)
+        write_secondary(lock, data);
+
+    if (resampler)
+    {
+        resampler->process(data.begin(), data.len() / effect_channels,
+                           buffer3);
+        write_device(lock, buffer3);
+    }
+    else
+        write_device(lock, data);
+}
+
+static void setup_resampler(UnsafeLock & lock)
+{
+    assert(state.output());
+
+    auto quality = (ResampleQuality)aud::clamp(
+        aud_get_int("resample_quality"), 0, Resampler::n_qualities - 1);
+
+    if (resampler && resampler->channels() == out_channels &&
+        resampler->in_rate() == effect_rate &&
+        resampler->out_rate() == out_rate && resampler->quality() == quality)
+        return;
+
+    finish_resampler(lock);
+
+    if (effect_rate != out_rate)
+    {
+        AUDINFO("Resampling from %d to %d Hz, quality %d.\n", effect_rate,
+                out_rate, (int)quality);
+        resampler.capture(
+            new Resampler(out_channels, effect_rate, out_rate, quality));
+    }
+    else
+        resampler.clear();
+}
+
+/* writes out the end of the previous song before the resampler is replaced */
+static void finish_resampler(UnsafeLock & lock)
+{
+    if (!resampler)
+        return;
+
+    // a paused write would block until the input thread itself unpauses, so
+    // the little audio held back is dropped instead
+    if (state.output() && !state.paused())
+    {
+        resampler->finish(buffer3);
+        write_device(lock, buffer3);
+    }
+    else
+        resampler->reset();
+}
+
 static bool process_audio(UnsafeLock & lock, const void * data, int size,
                           int stop_time)
 {
@@ -481,6 +593,13 @@ static bool process_audio(UnsafeLock & lock, const void * data, int size,
     int samples = size / FMT_SIZEOF(in_format);
     bool stopped = false;
 
+    if (song_end_time >= 0)
+    {
+        AUDINFO("Gap between songs: %.1f ms\n",
+                (get_timestamp() - song_end_time) / 1000.0);
+        song_end_time = -1;
+    }
+
     if (stop_time != -1)
     {
         int64_t frames_left =
@@ -523,6 +642,9 @@ static void finish_effects(UnsafeLock & lock, bool end_of_playlist)
 
     buffer1.resize(0);
     write_output(lock, effect_finish(buffer1, end_of_playlist));
+
+    if (end_of_playlist)
+        finish_resampler(lock);
 }
 
 bool output_open_audio(const String & filename, const Tuple & tuple, int format,
@@ -617,6 +739,9 @@ void output_flush(int time, bool force)
         seek_time = time;
         in_frames = 0;
     }
+
+    /* a flush means the song was not played through */
+    song_end_time = -1;
 }
 
 void output_resume()
@@ -647,6 +772,7 @@ int output_get_time()
             delay = cop->get_delay();
             delay +=
                 aud::rescale<int64_t>(out_bytes_held, out_bytes_per_sec, 1000);
+            delay += get_resampler_delay(lock);
         }
 
         delay = effect_adjust_delay(delay);
@@ -678,6 +804,11 @@ void output_close_audio()
 
     if (state.input())
     {
+        /* only a song that played to the end is followed by a gapless
+         * transition; ignore songs that were flushed or never written */
+        if (state.output() && !state.flushed() && in_frames > 0)
+            song_end_time = get_timestamp();
+
         state.set_input(lock, false);
         in_filename = String();
         in_tuple = Tuple();
@@ -693,6 +824,8 @@ void output_drain()
 
     if (!state.input())
     {
+        song_end_time = -1;
+
         if (state.output())
             finish_effects(lock, true); /* second time for end of playlist */
 
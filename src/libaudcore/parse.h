@@ -32,6 +32,7 @@ public:
 
     void next();
     bool eof() const { return !m_val; }
+    const char * key() const { return m_val ? m_key : nullptr; }
 
     bool get_int(const char * key, int & val) const;
     String get_str(const char * key) const;
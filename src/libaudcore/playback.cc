@@ -38,6 +38,8 @@
 #include "internal.h"
 
 #include <assert.h>
+#include <pthread.h>
+#include <mutex>
 
 #include "audstrings.h"
 #include "hook.h"
@@ -118,6 +120,25 @@ static bool is_ready(aud::mutex::holder & mh)
     return in_sync(mh) && pb_info.ready;
 }
 
+// decode sinks are per thread, since the InputPlugin API gives no other way to
+// tell a background decode apart from playback
+static pthread_key_t sink_key;
+static std::once_flag sink_once;
+
+static void make_sink_key() { pthread_key_create(&sink_key, nullptr); }
+
+void playback_set_decode_sink(DecodeSink * sink)
+{
+    std::call_once(sink_once, make_sink_key);
+    pthread_setspecific(sink_key, sink);
+}
+
+static DecodeSink * get_decode_sink()
+{
+    std::call_once(sink_once, make_sink_key);
+    return (DecodeSink *)pthread_getspecific(sink_key);
+}
+
 // called by playback_entry_set_tuple() to ensure that the tuple still applies
 // to the current song from the perspective of the main/playlist thread; the
 // check is necessary because playback_entry_set_tuple() is itself called from
@@ -306,6 +327,32 @@ static bool setup_playback(const DecodeInfo & dec)
     return true;
 }
 
+// playback thread helper
+static void check_measured_gain()
+{
+    auto mh = mutex.take();
+
+    // measured loudness applies to whole files, not cuesheet entries
+    if (pb_info.gain_valid || pb_info.tuple.get_str(Tuple::AudioFile))
+        return;
+
+    String filename = pb_info.filename;
+    mh.unlock();
+
+    // the cache may stat the file, so don't hold the mutex
+    ReplayGainInfo gain;
+    if (!loudness_get_gain(filename, gain))
+        return;
+
+    mh.lock();
+
+    if (in_sync(mh) && !pb_info.gain_valid)
+    {
+        pb_info.gain = gain;
+        pb_info.gain_valid = true;
+    }
+}
+
 // playback thread helper
 static bool check_playback_repeat()
 {
@@ -342,6 +389,12 @@ static void run_playback()
     if (!setup_playback(dec))
         return;
 
+    // fall back to measured loudness if there are no ReplayGain tags
+    check_measured_gain();
+
+    // decoding reads the file front to back
+    dec.file.set_access_hint(VFS_ACCESS_SEQUENTIAL);
+
     while (1)
     {
         // hand off control to input plugin
@@ -497,6 +550,12 @@ EXPORT void aud_drct_seek(int time)
 
 EXPORT void InputPlugin::open_audio(int format, int rate, int channels)
 {
+    if (DecodeSink * sink = get_decode_sink())
+    {
+        sink->open_audio(format, rate, channels);
+        return;
+    }
+
     // don't open audio if playback thread is lagging
     auto mh = mutex.take();
     if (!in_sync(mh))
@@ -527,6 +586,9 @@ EXPORT void InputPlugin::open_audio(int format, int rate, int channels)
 
 EXPORT void InputPlugin::set_replay_gain(const ReplayGainInfo & gain)
 {
+    if (get_decode_sink())
+        return;
+
     auto mh = mutex.take();
 
     pb_info.gain = gain;
@@ -538,6 +600,12 @@ EXPORT void InputPlugin::set_replay_gain(const ReplayGainInfo & gain)
 
 EXPORT void InputPlugin::write_audio(const void * data, int length)
 {
+    if (DecodeSink * sink = get_decode_sink())
+    {
+        sink->write_audio(data, length);
+        return;
+    }
+
     auto mh = mutex.take();
     if (!in_sync(mh))
         return;
@@ -574,6 +642,9 @@ EXPORT void InputPlugin::write_audio(const void * data, int length)
 
 EXPORT Tuple InputPlugin::get_playback_tuple()
 {
+    if (get_decode_sink())
+        return Tuple();
+
     auto mh = mutex.take();
     Tuple tuple = pb_info.tuple.ref();
 
@@ -585,6 +656,9 @@ EXPORT Tuple InputPlugin::get_playback_tuple()
 
 EXPORT void InputPlugin::set_playback_tuple(Tuple && tuple)
 {
+    if (get_decode_sink())
+        return;
+
     // due to mutex ordering, we cannot call into the playlist while locked;
     // instead, playback_entry_set_tuple() calls back into first
     // playback_check_serial() and then eventually playback_set_info()
@@ -593,6 +667,9 @@ EXPORT void InputPlugin::set_playback_tuple(Tuple && tuple)
 
 EXPORT void InputPlugin::set_stream_bitrate(int bitrate)
 {
+    if (get_decode_sink())
+        return;
+
     auto mh = mutex.take();
     pb_info.bitrate = bitrate;
 
@@ -602,12 +679,18 @@ EXPORT void InputPlugin::set_stream_bitrate(int bitrate)
 
 EXPORT bool InputPlugin::check_stop()
 {
+    if (DecodeSink * sink = get_decode_sink())
+        return sink->check_stop();
+
     auto mh = mutex.take();
     return !is_ready(mh) || pb_info.ended || pb_info.error;
 }
 
 EXPORT int InputPlugin::check_seek()
 {
+    if (get_decode_sink())
+        return -1;
+
     auto mh = mutex.take();
     int seek = -1;
 
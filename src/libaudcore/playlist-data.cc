@@ -957,6 +957,67 @@ bool PlaylistData::change_position_to_next(bool repeat, int hint_pos)
     return true;
 }
 
+Index<PlaylistEntry *> PlaylistData::upcoming_entries(int count)
+{
+    bool shuffle = aud_get_bool("shuffle");
+    bool by_album = aud_get_bool("album_shuffle");
+
+    Index<PlaylistEntry *> entries;
+    int pos = position();
+
+    for (auto entry : m_queued)
+    {
+        if (entries.len() >= count)
+            return entries;
+
+        entries.append(entry);
+        pos = entry->number;
+    }
+
+    // random shuffle choices cannot be predicted, so stop short of them
+    while (pos >= 0 && entries.len() < count)
+    {
+        if (shuffle)
+            pos = shuffle_pos_after(pos, by_album).new_pos;
+        else
+            pos = (pos + 1 < m_entries.len()) ? pos + 1 : -1;
+
+        if (pos >= 0)
+            entries.append(m_entries[pos].get());
+    }
+
+    return entries;
+}
+
+Index<String> PlaylistData::upcoming_filenames(int count)
+{
+    Index<String> filenames;
+
+    // for cuesheet entries, use the underlying audio file
+    for (auto entry : upcoming_entries(count))
+    {
+        String audio_file = entry->tuple.get_str(Tuple::AudioFile);
+        filenames.append(audio_file ? audio_file : entry->filename);
+    }
+
+    return filenames;
+}
+
+Index<String> PlaylistData::upcoming_without_gain(int count)
+{
+    Index<String> filenames;
+
+    // cuesheet entries cover only part of the audio file
+    for (auto entry : upcoming_entries(count))
+    {
+        if (!entry->tuple.has_replay_gain() &&
+            !entry->tuple.get_str(Tuple::AudioFile))
+            filenames.append(entry->filename);
+    }
+
+    return filenames;
+}
+
 void PlaylistData::shuffle_reset()
 {
     m_last_shuffle_num = 0;
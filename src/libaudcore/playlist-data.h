@@ -102,6 +102,12 @@ public:
 
     bool prev_song();
     bool next_song(bool repeat);
+
+    /* entries likely to be played next (for preloading and prefetching) */
+    Index<PlaylistEntry *> upcoming_entries(int count);
+    Index<String> upcoming_filenames(int count);
+    /* same, but only whole files without ReplayGain tags */
+    Index<String> upcoming_without_gain(int count);
     bool prev_album();
     bool next_album(bool repeat);
 
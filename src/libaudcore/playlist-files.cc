@@ -47,6 +47,7 @@ bool playlist_load(const char * filename, String & title,
                    Index<PlaylistAddItem> & items)
 {
     AUDINFO("Loading playlist %s.\n", filename);
+    audtrace::Span span("playlist_load", filename);
 
     StringBuf ext = uri_get_extension(filename);
     bool plugin_found = false;
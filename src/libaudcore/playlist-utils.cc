@@ -416,7 +416,11 @@ static void state_cb(void * data, void * user) { state_changed = true; }
 void load_playlists()
 {
     load_playlists_real();
-    playlist_load_state();
+
+    {
+        audtrace::Span span("playlist_load_state");
+        playlist_load_state();
+    }
 
     state_changed = false;
 
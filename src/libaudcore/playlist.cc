@@ -138,6 +138,30 @@ static bool scan_enabled_nominal, scan_enabled;
 static int scan_playlist, scan_row;
 static List<ScanItem> scan_list;
 
+/* for tracing the time from startup until all playlists are scanned */
+static int64_t first_scan_start = -1;
+static bool first_scan_done;
+
+/* look-ahead for the entry expected to play after the current one; the file
+ * is opened and probed while the current song plays, so that the playback
+ * thread can hand over to the next song without waiting */
+struct PreloadState
+{
+    PlaylistEntry * entry = nullptr;
+    ScanRequest * request = nullptr; /* in progress, owned by the scanner */
+    bool done = false;
+
+    PluginHandle * decoder = nullptr;
+    Tuple tuple;
+    InputPlugin * ip = nullptr;
+    VFSFile file;
+    Index<char> image_data;
+    String image_file;
+    String error;
+};
+
+static PreloadState preload;
+
 static void scan_finish(ScanRequest * request);
 static void scan_cancel(PlaylistEntry * entry);
 static void scan_restart();
@@ -384,6 +408,13 @@ static void scan_schedule()
         if (++scheduled >= SCAN_THREADS)
             return;
     }
+
+    if (!scheduled && first_scan_start >= 0)
+    {
+        audtrace::add("first_scan", nullptr, first_scan_start, audtrace::now());
+        first_scan_start = -1;
+        first_scan_done = true;
+    }
 }
 
 static void scan_finish(ScanRequest * request)
@@ -435,6 +466,78 @@ static void scan_restart()
     scan_schedule();
 }
 
+static void preload_finish(ScanRequest * request)
+{
+    auto mh = mutex.take();
+
+    /* discard the results if the look-ahead was canceled meanwhile */
+    if (request != preload.request)
+        return;
+
+    preload.request = nullptr;
+    preload.done = true;
+
+    preload.decoder = request->decoder;
+    preload.tuple = std::move(request->tuple);
+    preload.ip = request->ip;
+    preload.file = std::move(request->file);
+    preload.image_data = std::move(request->image_data);
+    preload.image_file = std::move(request->image_file);
+    preload.error = std::move(request->error);
+}
+
+static void preload_cancel() { preload = PreloadState(); }
+
+static void preload_start(PlaylistData * playlist, PlaylistEntry * entry)
+{
+    if (entry == preload.entry)
+        return;
+
+    preload_cancel();
+
+    if (!entry)
+        return;
+
+    auto request = playlist->create_scan_request(entry, preload_finish,
+                                                 SCAN_IMAGE | SCAN_FILE);
+
+    /* don't hold open network streams, which could time out */
+    if (strncmp(request->filename, "file://", 7))
+    {
+        delete request;
+        return;
+    }
+
+    preload.entry = entry;
+    preload.request = request;
+
+    scanner_request(request);
+}
+
+/* fills in a playback scan request from the look-ahead, if it is complete */
+static bool preload_take(PlaylistEntry * entry, ScanRequest * request)
+{
+    bool found = (entry == preload.entry && preload.done);
+
+    if (found)
+    {
+        if (!request->decoder)
+            request->decoder = preload.decoder;
+        if (!request->tuple.valid())
+            request->tuple = std::move(preload.tuple);
+
+        request->ip = preload.ip;
+        request->file = std::move(preload.file);
+        request->image_data = std::move(preload.image_data);
+        request->image_file = std::move(preload.image_file);
+        request->error = std::move(preload.error);
+    }
+
+    /* a look-ahead still in progress is abandoned rather than waited for */
+    preload_cancel();
+    return found;
+}
+
 /* mutex may be unlocked during the call */
 static void wait_for_entry(aud::mutex::holder & mh, PlaylistData * playlist,
                            int entry_num, bool need_decoder, bool need_tuple)
@@ -486,11 +589,18 @@ static void stop_playback_locked()
 {
     art_clear_current();
     scan_reset_playback();
+    preload_cancel();
 
     playback_stop();
 }
 
-void pl_signal_entry_deleted(PlaylistEntry * entry) { scan_cancel(entry); }
+void pl_signal_entry_deleted(PlaylistEntry * entry)
+{
+    scan_cancel(entry);
+
+    if (entry == preload.entry)
+        preload_cancel();
+}
 
 void pl_signal_position_changed(Playlist::ID * id)
 {
@@ -593,6 +703,11 @@ void playlist_enable_scan(bool enable)
 
     scan_enabled_nominal = enable;
     scan_enabled = scan_enabled_nominal && !aud_get_bool("metadata_on_play");
+
+    if (scan_enabled && first_scan_start < 0 && !first_scan_done &&
+        audtrace::enabled())
+        first_scan_start = audtrace::now();
+
     scan_restart();
 }
 
@@ -630,6 +745,8 @@ void playlist_end()
 
     queued_update.stop();
 
+    preload_cancel();
+
     active_id = nullptr;
     resume_playlist = -1;
     resume_paused = false;
@@ -1109,6 +1226,7 @@ DecodeInfo playback_entry_read(int serial)
 {
     auto mh = mutex.take();
     DecodeInfo dec;
+    Index<String> upcoming, unmeasured;
 
     if (playback_check_serial(serial))
     {
@@ -1121,8 +1239,16 @@ DecodeInfo playback_entry_read(int serial)
         ScanRequest * request = item->request;
         item->handled_by_playback = true;
 
+        // if the entry was opened ahead of time, skip straight to the results
+        bool preloaded = preload_take(entry, request);
+
         mh.unlock();
-        request->run();
+
+        if (preloaded)
+            request->callback(request);
+        else
+            request->run();
+
         mh.lock();
 
         if (playback_check_serial(serial))
@@ -1139,11 +1265,30 @@ DecodeInfo playback_entry_read(int serial)
             dec.ip = request->ip;
             dec.file = std::move(request->file);
             dec.error = std::move(request->error);
+
+            upcoming = playlist->upcoming_filenames(
+                aud_get_int("prefetch_tracks"));
+
+            if (aud_get_bool("loudness_analysis"))
+                unmeasured = playlist->upcoming_without_gain(
+                    aud::max(1, aud_get_int("prefetch_tracks")));
+
+            auto next = playlist->upcoming_entries(1);
+            preload_start(playlist, next.len() ? next[0] : nullptr);
         }
 
         delete request;
     }
 
+    mh.unlock();
+
+    // start reading ahead the next tracks while this one plays
+    vfs_prefetch(upcoming);
+
+    // and measure the loudness of those lacking ReplayGain tags
+    if (unmeasured.len())
+        loudness_prioritize(unmeasured);
+
     return dec;
 }
 
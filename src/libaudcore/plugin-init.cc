@@ -192,9 +192,39 @@ static void start_plugins(PluginType type)
     }
 }
 
+/* Input, playlist, and transport plugins are loaded only when first needed.
+ * The other enabled plugins are needed right away; those that are marked
+ * thread-safe are loaded (and initialized, if they are effects) in parallel
+ * beforehand, and are then started in order as usual. */
+static void preload_plugins()
+{
+    Index<PluginHandle *> list;
+
+    for (auto type : {PluginType::Effect, PluginType::Output, PluginType::Vis,
+                      PluginType::General, PluginType::Iface})
+    {
+        if (type == PluginType::Iface && aud_get_headless_mode())
+            continue;
+
+        for (PluginHandle * p : aud_plugin_list(type))
+        {
+            if (plugin_get_enabled(p) != PluginEnabled::Disabled &&
+                (plugin_get_flags(p) & PluginThreadSafe))
+                list.append(p);
+        }
+    }
+
+    if (list.len())
+    {
+        AUDINFO("Loading %d plugins in parallel.\n", list.len());
+        plugin_preload(list);
+    }
+}
+
 void start_plugins_one()
 {
     plugin_system_init();
+    preload_plugins();
 
     start_plugins(PluginType::Transport);
     start_plugins(PluginType::Playlist);
@@ -207,6 +237,8 @@ void start_plugins_two()
 {
     start_plugins(PluginType::Vis);
     start_plugins(PluginType::General);
+
+    audtrace::Span span("interface_startup");
     start_plugins(PluginType::Iface);
 }
 
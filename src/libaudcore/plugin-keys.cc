@@ -0,0 +1,58 @@
+/*
+ * plugin-keys.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "plugin-keys.h"
+#include "audstrings.h"
+
+void PluginKeyIndex::add(PluginHandle * plugin, const Index<String> & keys)
+{
+    for (const String & key : keys)
+    {
+        String lower(str_tolower(key));
+        Index<PluginHandle *> * list = m_table.lookup(lower);
+        if (!list)
+            list = m_table.add(lower, Index<PluginHandle *>());
+
+        /* a plugin may list the same key twice */
+        if (!list->len() || (*list)[list->len() - 1] != plugin)
+            list->append(plugin);
+    }
+}
+
+Index<PluginHandle *> PluginKeyIndex::lookup(const char * key)
+{
+    Index<PluginHandle *> matches;
+
+    Index<PluginHandle *> * list = m_table.lookup(String(str_tolower(key)));
+    if (list)
+        matches.insert(list->begin(), 0, list->len());
+
+    return matches;
+}
+
+bool PluginKeyIndex::has_key(const Index<String> & keys, const char * key)
+{
+    for (const String & s : keys)
+    {
+        if (!strcmp_nocase(s, key))
+            return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,59 @@
+/*
+ * plugin-keys.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_PLUGIN_KEYS_H
+#define LIBAUDCORE_PLUGIN_KEYS_H
+
+#include "index.h"
+#include "multihash.h"
+#include "objects.h"
+
+class PluginHandle;
+
+/* Maps each key of one kind (URI scheme, file extension, or MIME type) to the
+ * input plugins having it, in the order the plugins were added.  Keys are
+ * compared case-insensitively (as ASCII).  Finding the plugins for a file then
+ * costs one hash lookup instead of a string comparison per key of every
+ * plugin (see has_key()).  Not thread-safe; the plugin registry guards its
+ * indexes with a lock. */
+class PluginKeyIndex
+{
+public:
+    /* adds a plugin after those added before; duplicate keys are ignored */
+    void add(PluginHandle * plugin, const Index<String> & keys);
+
+    /* sets the plugins for a key (already in lower case) at once */
+    void set(const String & key, Index<PluginHandle *> && plugins)
+    {
+        m_table.add(key, std::move(plugins));
+    }
+
+    /* returns a copy of the list, which stays valid after the index changes */
+    Index<PluginHandle *> lookup(const char * key);
+
+    void clear() { m_table.clear(); }
+
+    /* the linear search replaced by the index */
+    static bool has_key(const Index<String> & keys, const char * key);
+
+private:
+    SimpleHash<String, Index<PluginHandle *>> m_table;
+};
+
+#endif // LIBAUDCORE_PLUGIN_KEYS_H
@@ -31,6 +31,7 @@
 #include "internal.h"
 #include "plugin.h"
 #include "runtime.h"
+#include "threads.h"
 
 static const char * plugin_dir_list[] = {"Transport",    "Container", "Input",
                                          "Output",       "Effect",    "General",
@@ -40,10 +41,17 @@ struct LoadedModule
 {
     Plugin * header;
     GModule * module;
+    bool initialized;
 };
 
+/* plugins may be loaded by several threads at once */
+static aud::mutex mutex;
 static Index<LoadedModule> loaded_modules;
 
+/* held while initializing plugins that are not marked thread-safe, so that
+ * they are never initialized concurrently with each other */
+static aud::mutex init_mutex;
+
 bool plugin_check_flags(int flags)
 {
     switch (aud_get_mainloop_type())
@@ -56,12 +64,13 @@ bool plugin_check_flags(int flags)
         break;
     }
 
-    return !flags;
+    return !(flags & ~PluginThreadSafe);
 }
 
 Plugin * plugin_load(const char * filename)
 {
     AUDINFO("Loading plugin: %s.\n", filename);
+    audtrace::Span span("plugin_load", filename);
 
     GModule * module = g_module_open(filename, G_MODULE_BIND_LOCAL);
 
@@ -91,35 +100,61 @@ Plugin * plugin_load(const char * filename)
         return nullptr;
     }
 
-    if (plugin_check_flags(header->info.flags) &&
-        (header->type == PluginType::Transport ||
-         header->type == PluginType::Playlist ||
-         header->type == PluginType::Input ||
-         header->type == PluginType::Effect))
+    auto mh = mutex.take();
+    loaded_modules.append(header, module, false);
+
+    return header;
+}
+
+static bool needs_init(Plugin * header)
+{
+    return plugin_check_flags(header->info.flags) &&
+           (header->type == PluginType::Transport ||
+            header->type == PluginType::Playlist ||
+            header->type == PluginType::Input ||
+            header->type == PluginType::Effect);
+}
+
+bool plugin_init(Plugin * header)
+{
+    if (!needs_init(header))
+        return true;
+
+    audtrace::Span span("plugin_init", header->info.name);
+    bool success;
+
+    if (header->info.flags & PluginThreadSafe)
+        success = header->init();
+    else
     {
-        if (!header->init())
-        {
-            AUDERR("%s failed to initialize.\n", filename);
-            g_module_close(module);
-            return nullptr;
-        }
+        auto mh = init_mutex.take();
+        success = header->init();
     }
 
-    loaded_modules.append(header, module);
+    if (!success)
+    {
+        AUDERR("%s failed to initialize.\n", header->info.name);
+        return false;
+    }
 
-    return header;
+    auto mh = mutex.take();
+
+    for (LoadedModule & loaded : loaded_modules)
+    {
+        if (loaded.header == header)
+            loaded.initialized = true;
+    }
+
+    return true;
 }
 
 static void plugin_unload(LoadedModule & loaded)
 {
-    if (plugin_check_flags(loaded.header->info.flags) &&
-        (loaded.header->type == PluginType::Transport ||
-         loaded.header->type == PluginType::Playlist ||
-         loaded.header->type == PluginType::Input ||
-         loaded.header->type == PluginType::Effect))
-    {
+    if (loaded.initialized)
         loaded.header->cleanup();
-    }
+
+    /* queued log messages point to strings in the module */
+    audlog::flush();
 
 #ifndef VALGRIND_FRIENDLY
     g_module_close(loaded.module);
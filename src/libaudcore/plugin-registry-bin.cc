@@ -0,0 +1,208 @@
+/*
+ * plugin-registry-bin.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "plugin-registry-bin.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "audstrings.h"
+
+static constexpr char bin_magic[8] = "AUDPREG";
+static constexpr uint32_t bin_byte_order = 0x01020304;
+
+static uint32_t bin_checksum(const char * data, int64_t len)
+{
+    uint32_t hash = 2166136261u; /* FNV-1a */
+
+    for (int64_t i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+
+    return hash;
+}
+
+StringBuf plugin_path_basename(const char * path)
+{
+    const char * slash = strrchr(path, G_DIR_SEPARATOR);
+    const char * dot = slash ? strrchr(slash + 1, '.') : nullptr;
+
+    return dot ? str_copy(slash + 1, dot - (slash + 1)) : StringBuf();
+}
+
+uint32_t BinWriter::add_string(const char * str)
+{
+    if (!str || !str[0])
+        return 0;
+
+    String key(str);
+    uint32_t * offset = offsets.lookup(key);
+    if (offset)
+        return *offset;
+
+    uint32_t pos = strings.len();
+    strings.insert(str, -1, strlen(str) + 1);
+    offsets.add(key, std::move(pos));
+    return pos;
+}
+
+BinList BinWriter::add_strings(const Index<String> & list)
+{
+    BinList range = {(uint32_t)refs.len(), (uint32_t)list.len()};
+    for (const String & str : list)
+        refs.append(add_string(str));
+
+    return range;
+}
+
+Index<char> BinWriter::finish(const char * locale, const BinStamp & stamp)
+{
+    BinHeader header{};
+    memcpy(header.magic, bin_magic, sizeof bin_magic);
+    header.byte_order = bin_byte_order;
+    header.bin_format = BIN_FORMAT;
+    header.format = stamp.format;
+    header.locale = add_string(locale);
+    header.n_plugins = plugins.len();
+    header.n_refs = refs.len();
+    header.strings_len = strings.len();
+    header.text_mtime = stamp.mtime;
+    header.text_size = stamp.size;
+
+    for (auto k : aud::range<InputKey>())
+        header.n_keys[(int)k] = keys[k].len();
+
+    Index<char> data;
+    data.insert((const char *)&header, -1, sizeof header);
+    data.insert((const char *)plugins.begin(), -1,
+                plugins.len() * sizeof(BinPlugin));
+
+    for (auto & list : keys)
+        data.insert((const char *)list.begin(), -1, list.len() * sizeof(BinKey));
+
+    data.insert((const char *)refs.begin(), -1, refs.len() * sizeof(uint32_t));
+    data.insert(strings.begin(), -1, strings.len());
+
+    auto out = (BinHeader *)data.begin();
+    out->size = data.len();
+    out->checksum =
+        bin_checksum(data.begin() + sizeof header, data.len() - sizeof header);
+
+    return data;
+}
+
+bool BinReader::check(const BinStamp & stamp)
+{
+    if (len < (int64_t)sizeof(BinHeader))
+        return false;
+
+    m_header = (const BinHeader *)data;
+
+    if (memcmp(m_header->magic, bin_magic, sizeof bin_magic) ||
+        m_header->byte_order != bin_byte_order ||
+        m_header->bin_format != BIN_FORMAT || m_header->size != len)
+        return false;
+
+    /* written for a different text registry */
+    if (m_header->format != stamp.format ||
+        m_header->text_mtime != stamp.mtime ||
+        m_header->text_size != stamp.size)
+        return false;
+
+    uint64_t n_keys = 0;
+    for (auto k : aud::range<InputKey>())
+        n_keys += m_header->n_keys[(int)k];
+
+    uint64_t needed = sizeof(BinHeader) +
+                      (uint64_t)m_header->n_plugins * sizeof(BinPlugin) +
+                      n_keys * sizeof(BinKey) +
+                      (uint64_t)m_header->n_refs * sizeof(uint32_t) +
+                      m_header->strings_len;
+
+    if (needed != (uint64_t)len || !m_header->strings_len)
+        return false;
+
+    if (m_header->checksum !=
+        bin_checksum(data + sizeof(BinHeader), len - sizeof(BinHeader)))
+        return false;
+
+    const char * pos = data + sizeof(BinHeader);
+    m_plugins = (const BinPlugin *)pos;
+    pos += m_header->n_plugins * sizeof(BinPlugin);
+
+    for (auto k : aud::range<InputKey>())
+    {
+        m_keys[k] = (const BinKey *)pos;
+        pos += m_header->n_keys[(int)k] * sizeof(BinKey);
+    }
+
+    m_refs = (const uint32_t *)pos;
+    pos += m_header->n_refs * sizeof(uint32_t);
+    m_strings = pos;
+
+    if (m_strings[m_header->strings_len - 1] ||
+        !check_string(m_header->locale))
+        return false;
+
+    for (uint32_t i = 0; i < m_header->n_plugins; i++)
+    {
+        const BinPlugin & bin = m_plugins[i];
+
+        if (!check_string(bin.path) || !check_string(bin.name) ||
+            !check_string(bin.domain) || bin.type < 0 ||
+            bin.type >= (int)PluginType::count || bin.enabled < 0 ||
+            bin.enabled > (int)PluginEnabled::Secondary)
+            return false;
+
+        if (!plugin_path_basename(m_strings + bin.path))
+            return false;
+
+        for (const BinList & list : bin.lists)
+        {
+            if (!check_list(list))
+                return false;
+
+            for (uint32_t j = 0; j < list.count; j++)
+            {
+                if (!check_string(m_refs[list.first + j]))
+                    return false;
+            }
+        }
+    }
+
+    for (auto k : aud::range<InputKey>())
+    {
+        for (uint32_t i = 0; i < m_header->n_keys[(int)k]; i++)
+        {
+            const BinKey & bin = m_keys[k][i];
+            if (!check_string(bin.key) || !check_list(bin.plugins))
+                return false;
+
+            for (uint32_t j = 0; j < bin.plugins.count; j++)
+            {
+                uint32_t number = m_refs[bin.plugins.first + j];
+                if (number >= m_header->n_plugins ||
+                    m_plugins[number].type != (int)PluginType::Input)
+                    return false;
+            }
+        }
+    }
+
+    return true;
+}
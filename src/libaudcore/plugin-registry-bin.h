@@ -0,0 +1,172 @@
+/*
+ * plugin-registry-bin.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_PLUGIN_REGISTRY_BIN_H
+#define LIBAUDCORE_PLUGIN_REGISTRY_BIN_H
+
+#include <stdint.h>
+
+#include "index.h"
+#include "multihash.h"
+#include "objects.h"
+#include "plugin.h"
+#include "plugins-internal.h"
+
+/* The binary registry holds the same data as the text one, plus the order of
+ * the plugins by translated name and the input key tables.  It is mapped into
+ * memory as a whole and used in place, so that startup costs neither parsing
+ * nor sorting.  All numbers are in native byte order; strings are stored once,
+ * as offsets into a string table whose first entry is an empty string (used
+ * for null strings).  The file is laid out as follows:
+ *
+ *   BinHeader
+ *   BinPlugin[n_plugins]     (in the order of aud_plugin_list())
+ *   BinKey[n_keys]           (for each InputKey in turn)
+ *   uint32_t[n_refs]         (string offsets or plugin numbers)
+ *   char[strings_len]        (null-terminated strings) */
+
+/* Increment this when the layout of the binary registry changes. */
+#define BIN_FORMAT 2
+
+enum
+{
+    ListSchemes,
+    ListExts,
+    ListKeys, /* one list per InputKey */
+    n_lists = ListKeys + (int)InputKey::count
+};
+
+/* The text registry that a binary one was written together with.  The binary
+ * registry is discarded if the text one has since been changed or replaced
+ * (e.g. by an older version of Audacious, which knows only the text one). */
+struct BinStamp
+{
+    uint32_t format;     /* FORMAT of the text registry */
+    int64_t mtime, size; /* of the text registry file, or -1 if missing */
+};
+
+struct BinHeader
+{
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t bin_format, format;
+    uint32_t size, checksum; /* checksum covers everything after the header */
+    uint32_t n_plugins, n_refs, strings_len;
+    uint32_t n_keys[(int)InputKey::count];
+    uint32_t locale; /* language list that name_rank was computed for */
+    int64_t text_mtime, text_size;
+};
+
+/* a range in the refs array */
+struct BinList
+{
+    uint32_t first, count;
+};
+
+struct BinPlugin
+{
+    uint32_t path, name, domain;
+    int32_t type, timestamp, version, flags, priority, enabled, name_rank;
+    int32_t has_about, has_configure, can_save, has_subtunes, writes_tag;
+    BinList lists[n_lists]; /* string offsets */
+};
+
+/* an input key (lower case) and the plugins having it, in priority order */
+struct BinKey
+{
+    uint32_t key;
+    BinList plugins; /* plugin numbers */
+};
+
+class BinWriter
+{
+public:
+    Index<BinPlugin> plugins;
+    aud::array<InputKey, Index<BinKey>> keys;
+    Index<uint32_t> refs;
+
+    BinWriter() { strings.append(0); }
+
+    uint32_t add_string(const char * str);
+    BinList add_strings(const Index<String> & list);
+
+    Index<char> finish(const char * locale, const BinStamp & stamp);
+
+private:
+    Index<char> strings;
+    SimpleHash<String, uint32_t> offsets;
+};
+
+class BinReader
+{
+public:
+    BinReader(const char * data, int64_t len) : data(data), len(len) {}
+
+    /* verifies every offset and count in the file, so that the accessors
+     * below cannot fail; the file must also match the given text registry */
+    bool check(const BinStamp & stamp);
+
+    const BinHeader & header() const { return *m_header; }
+    const BinPlugin & plugin(uint32_t i) const { return m_plugins[i]; }
+    const BinKey & key(InputKey k, uint32_t i) const { return m_keys[k][i]; }
+    uint32_t ref(uint32_t i) const { return m_refs[i]; }
+
+    const char * raw_string(uint32_t offset) const
+    {
+        return m_strings + offset;
+    }
+
+    String get_string(uint32_t offset) const
+    {
+        return offset ? String(m_strings + offset) : String();
+    }
+
+    void get_strings(const BinList & list, Index<String> & out) const
+    {
+        for (uint32_t i = 0; i < list.count; i++)
+            out.append(get_string(m_refs[list.first + i]));
+    }
+
+private:
+    const char * data;
+    int64_t len;
+
+    const BinHeader * m_header = nullptr;
+    const BinPlugin * m_plugins = nullptr;
+    aud::array<InputKey, const BinKey *> m_keys{};
+    const uint32_t * m_refs = nullptr;
+    const char * m_strings = nullptr;
+
+    bool check_string(uint32_t offset) const
+    {
+        return offset < m_header->strings_len;
+    }
+
+    bool check_list(const BinList & list) const
+    {
+        return list.first <= m_header->n_refs &&
+               list.count <= m_header->n_refs - list.first;
+    }
+};
+
+/* the basename of a plugin module, i.e. without directory and extension
+ * (empty if the path has neither) */
+StringBuf plugin_path_basename(const char * path);
+
+#endif // LIBAUDCORE_PLUGIN_REGISTRY_BIN_H
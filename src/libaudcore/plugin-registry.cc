@@ -22,22 +22,30 @@
 #include <errno.h>
 #include <string.h>
 
+#include <atomic>
+#include <thread>
+
+#include <glib.h>
 #include <glib/gstdio.h>
 
 #include "audstrings.h"
 #include "i18n.h"
 #include "interface.h"
+#include "multihash.h"
 #include "parse.h"
+#include "plugin-keys.h"
+#include "plugin-registry-bin.h"
 #include "plugin.h"
 #include "runtime.h"
 #include "threads.h"
 
 #define FILENAME "plugin-registry"
+#define BIN_FILENAME "plugin-registry.bin"
 
 /* Increment this when the format of the plugin-registry file changes.
  * Add 10 if the format changes in a way that will break
  * parse_plugins_fallback(). */
-#define FORMAT 11
+#define FORMAT 12
 
 /* Oldest file format supported by parse_plugins_fallback() */
 #define MIN_FORMAT 2 // "enabled" flag was added in Audacious 2.4
@@ -52,7 +60,8 @@ class PluginHandle
 {
 public:
     String basename, path;
-    bool loaded;
+    bool loaded;  /* header is final (nullptr if loading failed) */
+    bool loading; /* being loaded by some thread right now */
     int timestamp, version, flags;
     PluginType type;
     Plugin * header;
@@ -60,6 +69,7 @@ public:
     int priority;
     int has_about, has_configure;
     PluginEnabled enabled;
+    int name_rank; /* position in sorted order, from the binary registry */
     Index<PluginWatch> watches;
 
     /* for transport plugins */
@@ -72,18 +82,20 @@ public:
     /* for input plugins */
     aud::array<InputKey, Index<String>> keys;
     int has_subtunes, writes_tag;
+    std::atomic<int64_t> probes{0}, probe_matches{0}, probe_bytes{0};
 
     PluginHandle(const char * basename, const char * path, bool loaded,
                  int timestamp, int version, int flags, PluginType type,
                  Plugin * header)
-        : basename(basename), path(path), loaded(loaded), timestamp(timestamp),
+        : basename(basename), path(path), loaded(loaded), loading(false),
+          timestamp(timestamp),
           version(version), flags(flags), type(type), header(header),
           priority(0), has_about(false), has_configure(false),
           enabled((type == PluginType::Transport ||
                    type == PluginType::Playlist || type == PluginType::Input)
                       ? PluginEnabled::Primary
                       : PluginEnabled::Disabled),
-          can_save(false), has_subtunes(false), writes_tag(false)
+          name_rank(-1), can_save(false), has_subtunes(false), writes_tag(false)
     {
     }
 
@@ -105,19 +117,30 @@ static aud::array<PluginType, Index<PluginHandle *>> plugins;
 static aud::array<PluginType, Index<PluginHandle *>> compatible;
 static aud::array<PluginType, Index<PluginHandle *>> sorted; /* by name */
 static aud::mutex mutex;
+static aud::condvar loaded_cond;
 static bool modified = false;
 
-static StringBuf get_basename(const char * path)
-{
-    const char * slash = strrchr(path, G_DIR_SEPARATOR);
-    const char * dot = slash ? strrchr(slash + 1, '.') : nullptr;
+/* set if the binary registry needs to be rewritten even though the text
+ * registry is current (e.g. because the binary one was missing) */
+static bool bin_stale = false;
+
+/* set if the plugin order and key tables were taken from the binary registry
+ * and are still valid, i.e. no plugins were added, rescanned, or removed */
+static bool bin_order_valid = false;
 
-    return dot ? str_copy(slash + 1, dot - (slash + 1)) : StringBuf();
+/* maps each input plugin key to the enabled plugins having it, in the same
+ * priority order as aud_plugin_list() */
+static aud::array<InputKey, PluginKeyIndex> key_index;
+static aud::spinlock_rw key_index_lock;
+
+static StringBuf get_text_path()
+{
+    return filename_build({aud_get_path(AudPath::UserDir), FILENAME});
 }
 
 static FILE * open_registry_file(const char * mode)
 {
-    StringBuf path = filename_build({aud_get_path(AudPath::UserDir), FILENAME});
+    StringBuf path = get_text_path();
     FILE * handle = g_fopen(path, mode);
 
     if (!handle && errno != ENOENT)
@@ -177,25 +200,252 @@ static void plugin_save(PluginHandle * plugin, FILE * handle)
         input_plugin_save(plugin, handle);
 }
 
-void plugin_registry_save()
+/* dgettext() depends on the language list, so the stored name order is only
+ * valid as long as it stays the same */
+static StringBuf get_locale_id()
 {
-    if (!modified)
-        return;
+    Index<String> names;
+    for (auto name = g_get_language_names(); *name; name++)
+        names.append(String(*name));
 
-    FILE * handle = open_registry_file("w");
-    if (!handle)
+    return index_to_str_list(names, ":");
+}
+
+static StringBuf get_bin_path()
+{
+    return filename_build({aud_get_path(AudPath::UserDir), BIN_FILENAME});
+}
+
+/* the binary registry is saved after the text one and stamped with its size
+ * and modification time, so that it is not used after the text registry was
+ * rewritten without it (by an older version or after a crash) */
+static BinStamp get_text_stamp()
+{
+    BinStamp stamp = {FORMAT, -1, -1};
+    GStatBuf info;
+
+    if (g_stat(get_text_path(), &info) == 0)
+    {
+        stamp.mtime = info.st_mtime;
+        stamp.size = info.st_size;
+    }
+
+    return stamp;
+}
+
+static void plugin_registry_save_binary()
+{
+    BinWriter writer;
+    uint32_t first_input = 0; /* number of the first input plugin */
+
+    for (auto type : aud::range<PluginType>())
+    {
+        /* all plugins are ranked, whether compatible or not; the order is
+         * filtered again at startup */
+        Index<PluginHandle *> by_name;
+        by_name.insert(plugins[type].begin(), 0, plugins[type].len());
+        by_name.sort([](PluginHandle * a, PluginHandle * b) {
+            return str_compare(aud_plugin_get_name(a), aud_plugin_get_name(b));
+        });
+
+        for (int i = 0; i < by_name.len(); i++)
+            by_name[i]->name_rank = i;
+
+        if (type == PluginType::Input)
+            first_input = writer.plugins.len();
+
+        for (PluginHandle * plugin : plugins[type])
+        {
+            BinPlugin & bin = writer.plugins.append();
+            bin.path = writer.add_string(plugin->path);
+            bin.name = writer.add_string(plugin->name);
+            bin.domain = writer.add_string(plugin->domain);
+            bin.type = (int)plugin->type;
+            bin.timestamp = plugin->timestamp;
+            bin.version = plugin->version;
+            bin.flags = plugin->flags;
+            bin.priority = plugin->priority;
+            bin.enabled = (int)plugin->enabled;
+            bin.name_rank = plugin->name_rank;
+            bin.has_about = plugin->has_about;
+            bin.has_configure = plugin->has_configure;
+            bin.can_save = plugin->can_save;
+            bin.has_subtunes = plugin->has_subtunes;
+            bin.writes_tag = plugin->writes_tag;
+
+            bin.lists[ListSchemes] = writer.add_strings(plugin->schemes);
+            bin.lists[ListExts] = writer.add_strings(plugin->exts);
+
+            for (auto k : aud::range<InputKey>())
+                bin.lists[ListKeys + (int)k] =
+                    writer.add_strings(plugin->keys[k]);
+        }
+    }
+
+    /* same as rebuild_key_index(), but for all input plugins */
+    for (auto k : aud::range<InputKey>())
+    {
+        SimpleHash<String, Index<uint32_t>> table;
+        Index<String> order;
+
+        auto & inputs = plugins[PluginType::Input];
+        for (int i = 0; i < inputs.len(); i++)
+        {
+            PluginHandle * plugin = inputs[i];
+            uint32_t number = first_input + i;
+
+            for (const String & key : plugin->keys[k])
+            {
+                String lower(str_tolower(key));
+                Index<uint32_t> * list = table.lookup(lower);
+                if (!list)
+                {
+                    list = table.add(lower, Index<uint32_t>());
+                    order.append(lower);
+                }
+
+                if (!list->len() || (*list)[list->len() - 1] != number)
+                    list->append(number);
+            }
+        }
+
+        for (const String & key : order)
+        {
+            Index<uint32_t> * list = table.lookup(key);
+            BinKey & bin = writer.keys[k].append();
+            bin.key = writer.add_string(key);
+            bin.plugins = {(uint32_t)writer.refs.len(), (uint32_t)list->len()};
+            writer.refs.insert(list->begin(), -1, list->len());
+        }
+    }
+
+    Index<char> data = writer.finish(get_locale_id(), get_text_stamp());
+    StringBuf path = get_bin_path();
+    GError * error = nullptr;
+
+    if (!g_file_set_contents(path, data.begin(), data.len(), &error))
+    {
+        AUDWARN("%s: %s\n", (const char *)path, error->message);
+        g_error_free(error);
+    }
+}
+
+static void load_from_binary(const BinReader & reader)
+{
+    const BinHeader & header = reader.header();
+    Index<PluginHandle *> handles;
+
+    for (uint32_t i = 0; i < header.n_plugins; i++)
+    {
+        const BinPlugin & bin = reader.plugin(i);
+        auto type = (PluginType)bin.type;
+
+        auto plugin = new PluginHandle(
+            plugin_path_basename(reader.raw_string(bin.path)), String(), false,
+            bin.timestamp, bin.version, bin.flags, type, nullptr);
+
+        plugins[type].append(plugin);
+        handles.append(plugin);
+
+        plugin->name = reader.get_string(bin.name);
+        plugin->domain = reader.get_string(bin.domain);
+        plugin->priority = bin.priority;
+        plugin->enabled = (PluginEnabled)bin.enabled;
+        plugin->name_rank = bin.name_rank;
+        plugin->has_about = bin.has_about;
+        plugin->has_configure = bin.has_configure;
+        plugin->can_save = bin.can_save;
+        plugin->has_subtunes = bin.has_subtunes;
+        plugin->writes_tag = bin.writes_tag;
+
+        reader.get_strings(bin.lists[ListSchemes], plugin->schemes);
+        reader.get_strings(bin.lists[ListExts], plugin->exts);
+
+        for (auto k : aud::range<InputKey>())
+            reader.get_strings(bin.lists[ListKeys + (int)k], plugin->keys[k]);
+    }
+
+    bin_order_valid =
+        !strcmp(reader.raw_string(header.locale), get_locale_id());
+
+    if (!bin_order_valid)
+    {
+        bin_stale = true;
         return;
+    }
 
-    fprintf(handle, "format %d\n", FORMAT);
+    /* the key tables are only filtered here; plugin_registry_prune() throws
+     * them away again if any plugin turns out to be missing or changed */
+    auto wr = key_index_lock.write();
 
-    for (auto & list : plugins)
+    for (auto k : aud::range<InputKey>())
     {
-        for (PluginHandle * plugin : list)
-            plugin_save(plugin, handle);
+        for (uint32_t i = 0; i < header.n_keys[(int)k]; i++)
+        {
+            const BinKey & bin = reader.key(k, i);
+            Index<PluginHandle *> list;
+
+            for (uint32_t j = 0; j < bin.plugins.count; j++)
+            {
+                uint32_t number = reader.ref(bin.plugins.first + j);
+                PluginHandle * plugin = handles[number];
+                if (plugin->enabled != PluginEnabled::Disabled &&
+                    plugin_check_flags(plugin->flags))
+                    list.append(plugin);
+            }
+
+            if (list.len())
+                key_index[k].set(String(reader.raw_string(bin.key)),
+                                 std::move(list));
+        }
     }
+}
 
-    fclose(handle);
-    modified = false;
+static bool plugin_registry_load_binary()
+{
+    GMappedFile * mapped = g_mapped_file_new(get_bin_path(), false, nullptr);
+    if (!mapped)
+        return false;
+
+    BinReader reader(g_mapped_file_get_contents(mapped),
+                     g_mapped_file_get_length(mapped));
+
+    bool valid = reader.check(get_text_stamp());
+    if (valid)
+        load_from_binary(reader);
+    else
+        AUDWARN("Ignoring invalid or outdated %s.\n", BIN_FILENAME);
+
+    g_mapped_file_unref(mapped);
+    return valid;
+}
+
+void plugin_registry_save()
+{
+    if (!modified && !bin_stale)
+        return;
+
+    if (modified)
+    {
+        FILE * handle = open_registry_file("w");
+        if (!handle)
+            return;
+
+        fprintf(handle, "format %d\n", FORMAT);
+
+        for (auto & list : plugins)
+        {
+            for (PluginHandle * plugin : list)
+                plugin_save(plugin, handle);
+        }
+
+        fclose(handle);
+        modified = false;
+    }
+
+    /* the text registry is kept for older versions and as a fallback */
+    plugin_registry_save_binary();
+    bin_stale = false;
 }
 
 void plugin_registry_cleanup()
@@ -213,6 +463,27 @@ void plugin_registry_cleanup()
 
     for (auto & list : sorted)
         list.clear();
+
+    auto wr = key_index_lock.write();
+    for (auto & index : key_index)
+        index.clear();
+}
+
+static void rebuild_key_index()
+{
+    auto wr = key_index_lock.write();
+
+    for (auto & index : key_index)
+        index.clear();
+
+    for (PluginHandle * plugin : compatible[PluginType::Input])
+    {
+        if (plugin->enabled == PluginEnabled::Disabled)
+            continue;
+
+        for (auto k : aud::range<InputKey>())
+            key_index[k].add(plugin, plugin->keys[k]);
+    }
 }
 
 static void transport_plugin_parse(PluginHandle * plugin, TextParser & parser)
@@ -280,7 +551,7 @@ static bool plugin_parse(TextParser & parser)
     if (!path)
         return false;
 
-    StringBuf basename = get_basename(path);
+    StringBuf basename = plugin_path_basename(path);
     if (!basename)
         return false;
 
@@ -354,7 +625,7 @@ static void parse_plugins_fallback(TextParser & parser)
         if (!path)
             continue;
 
-        StringBuf basename = get_basename(path);
+        StringBuf basename = plugin_path_basename(path);
         if (!basename)
             continue;
 
@@ -379,6 +650,12 @@ static void parse_plugins_fallback(TextParser & parser)
 
 void plugin_registry_load()
 {
+    if (plugin_registry_load_binary())
+        return;
+
+    /* write the binary registry at the next opportunity */
+    bin_stale = true;
+
     FILE * handle = open_registry_file("r");
     if (!handle)
         return;
@@ -430,6 +707,7 @@ void plugin_registry_prune()
 
         AUDINFO("Plugin not found: %s\n", (const char *)plugin->basename);
         delete plugin;
+        bin_order_valid = false;
         return true;
     };
 
@@ -443,18 +721,39 @@ void plugin_registry_prune()
     };
 
     for (auto type : aud::range<PluginType>())
-    {
         plugins[type].remove_if(check_not_found);
-        plugins[type].sort(plugin_compare);
+
+    /* new and rescanned plugins set the modified flag */
+    bool use_bin_order = bin_order_valid && !modified;
+    if (!use_bin_order)
+        bin_stale = true;
+
+    for (auto type : aud::range<PluginType>())
+    {
+        /* the binary registry is already in this order */
+        if (!use_bin_order)
+            plugins[type].sort(plugin_compare);
 
         compatible[type].insert(plugins[type].begin(), 0, plugins[type].len());
         compatible[type].remove_if(check_incompatible);
 
         sorted[type].insert(compatible[type].begin(), 0, compatible[type].len());
-        sorted[type].sort([](PluginHandle * a, PluginHandle * b) {
-            return str_compare(aud_plugin_get_name(a), aud_plugin_get_name(b));
-        });
+
+        if (use_bin_order)
+            sorted[type].sort([](PluginHandle * a, PluginHandle * b) {
+                return a->name_rank - b->name_rank;
+            });
+        else
+            sorted[type].sort([](PluginHandle * a, PluginHandle * b) {
+                return str_compare(aud_plugin_get_name(a),
+                                   aud_plugin_get_name(b));
+            });
     }
+
+    if (!use_bin_order)
+        rebuild_key_index();
+
+    bin_order_valid = false;
 }
 
 /* Note: If there are multiple plugins with the same basename, this returns only
@@ -545,7 +844,7 @@ static void plugin_get_info(PluginHandle * plugin, bool is_new)
 
 void plugin_register(const char * path, int timestamp)
 {
-    StringBuf basename = get_basename(path);
+    StringBuf basename = plugin_path_basename(path);
     if (!basename)
         return;
 
@@ -563,7 +862,8 @@ void plugin_register(const char * path, int timestamp)
             if (!header || header->type != plugin->type)
                 return;
 
-            plugin->loaded = true;
+            /* only the metadata is needed now; the plugin is initialized
+             * when it is first used */
             plugin->header = header;
             plugin->timestamp = timestamp;
 
@@ -579,7 +879,7 @@ void plugin_register(const char * path, int timestamp)
             return;
 
         plugin =
-            new PluginHandle(basename, path, true, timestamp, header->version,
+            new PluginHandle(basename, path, false, timestamp, header->version,
                              header->info.flags, header->type, header);
         plugins[plugin->type].append(plugin);
 
@@ -598,22 +898,66 @@ EXPORT const char * aud_plugin_get_basename(PluginHandle * plugin)
     return plugin->basename;
 }
 
+/* Plugins are loaded and initialized on first use, from the metadata in the
+ * registry.  The lock is not held meanwhile, so that different plugins can be
+ * loaded by different threads at once (plugin_init() still serializes the
+ * initialization of plugins not marked thread-safe). */
 EXPORT const void * aud_plugin_get_header(PluginHandle * plugin)
 {
     auto mh = mutex.take();
 
+    while (plugin->loading)
+        loaded_cond.wait(mh);
+
     if (!plugin->loaded)
     {
-        Plugin * header = plugin_load(plugin->path);
-        if (header && header->type == plugin->type)
-            plugin->header = header;
+        /* the module may already be open after a rescan */
+        Plugin * header = plugin->header;
+        plugin->loading = true;
+        mh.unlock();
+
+        if (!header)
+        {
+            header = plugin_load(plugin->path);
+            if (header && header->type != plugin->type)
+                header = nullptr;
+        }
 
+        if (header && !plugin_init(header))
+            header = nullptr;
+
+        mh.lock();
+        plugin->header = header;
         plugin->loaded = true;
+        plugin->loading = false;
+        loaded_cond.notify_all();
     }
 
     return plugin->header;
 }
 
+/* loads plugins that are needed right away in parallel */
+void plugin_preload(const Index<PluginHandle *> & list)
+{
+    static constexpr int max_threads = 4;
+
+    std::atomic<int> next{0};
+    auto worker = [&]() {
+        int i;
+        while ((i = next++) < list.len())
+            aud_plugin_get_header(list[i]);
+    };
+
+    std::thread threads[max_threads];
+    int n_threads = aud::min(list.len(), max_threads);
+
+    for (int i = 0; i < n_threads; i++)
+        threads[i] = std::thread(worker);
+
+    for (int i = 0; i < n_threads; i++)
+        threads[i].join();
+}
+
 EXPORT PluginHandle * aud_plugin_by_header(const void * header)
 {
     for (auto & list : compatible)
@@ -672,6 +1016,11 @@ int plugin_get_priority(PluginHandle * plugin)
     return plugin->priority;
 }
 
+int plugin_get_flags(PluginHandle * plugin)
+{
+    return plugin->flags;
+}
+
 PluginEnabled plugin_get_enabled(PluginHandle * plugin)
 {
     return plugin->enabled;
@@ -680,6 +1029,10 @@ PluginEnabled plugin_get_enabled(PluginHandle * plugin)
 void plugin_set_enabled(PluginHandle * plugin, PluginEnabled enabled)
 {
     plugin->enabled = enabled;
+
+    if (plugin->type == PluginType::Input)
+        rebuild_key_index();
+
     plugin_call_watches(plugin);
     modified = true;
 }
@@ -746,13 +1099,28 @@ bool playlist_plugin_has_ext(PluginHandle * plugin, const char * ext)
 bool input_plugin_has_key(PluginHandle * plugin, InputKey key,
                           const char * value)
 {
-    for (String & s : plugin->keys[key])
-    {
-        if (!strcmp_nocase(s, value))
-            return true;
-    }
+    return PluginKeyIndex::has_key(plugin->keys[key], value);
+}
 
-    return false;
+Index<PluginHandle *> input_plugin_lookup_key(InputKey key, const char * value)
+{
+    auto rd = key_index_lock.read();
+    return key_index[key].lookup(value);
+}
+
+void input_plugin_add_probe(PluginHandle * plugin, int64_t bytes_read,
+                            bool matched)
+{
+    plugin->probes++;
+    plugin->probe_bytes += bytes_read;
+
+    if (matched)
+        plugin->probe_matches++;
+}
+
+EXPORT PluginProbeStats aud_plugin_get_probe_stats(PluginHandle * plugin)
+{
+    return {plugin->probes, plugin->probe_matches, plugin->probe_bytes};
 }
 
 bool input_plugin_has_subtunes(PluginHandle * plugin)
@@ -48,7 +48,7 @@ struct PluginPreferences;
  * _AUD_PLUGIN_VERSION_MIN to the same value. */
 
 #define _AUD_PLUGIN_VERSION_MIN 48 /* 3.8-devel */
-#define _AUD_PLUGIN_VERSION 48     /* 3.8-devel */
+#define _AUD_PLUGIN_VERSION 49     /* 3.8-devel */
 
 /* Default priority. */
 #define _AUD_PLUGIN_DEFAULT_PRIO 5
@@ -104,7 +104,9 @@ struct PluginPreferences;
 enum
 {
     PluginGLibOnly = 0x1, // plugin requires GLib main loop
-    PluginQtOnly = 0x2    // plugin requires Qt main loop
+    PluginQtOnly = 0x2,   // plugin requires Qt main loop
+    PluginThreadSafe = 0x4 // plugin can be loaded (and, if applicable,
+                           // initialized) in any thread, alongside others
 };
 
 struct PluginInfo
@@ -163,6 +165,12 @@ public:
     {
         return Index<String>();
     }
+
+    /* added in API version 49; the default implementation calls read_folder()
+     * and then test_file() for each entry, and leaves size/mtime unknown */
+    virtual Index<VFSFolderEntry> read_folder_entries(const char * filename,
+                                                      String & error,
+                                                      bool get_stat);
 };
 
 class LIBAUDCORE_PUBLIC PlaylistPlugin : public Plugin
@@ -349,7 +357,12 @@ public:
          * to the second song in the file "somefile.sid".
          * 3. When one of the songs is played, Audacious opens the file and
          * calls play() with a file name modified in this way. */
-        FlagSubtunes = (1 << 1)
+        FlagSubtunes = (1 << 1),
+
+        /* Indicates that play() may run in more than one thread at once, so
+         * that files can be decoded in the background (e.g. for loudness
+         * analysis) while another song is playing. */
+        FlagConcurrentPlay = (1 << 2)
     };
 
     struct InputInfo
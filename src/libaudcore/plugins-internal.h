@@ -45,7 +45,8 @@ bool plugin_enable_secondary(PluginHandle * plugin, bool enable);
 void plugin_system_init();
 void plugin_system_cleanup();
 bool plugin_check_flags(int flags);
-Plugin * plugin_load(const char * path);
+Plugin * plugin_load(const char * path); /* does not call init() */
+bool plugin_init(Plugin * header);
 
 /* plugin-registry.c */
 void plugin_registry_load();
@@ -54,7 +55,9 @@ void plugin_registry_save();
 void plugin_registry_cleanup();
 
 void plugin_register(const char * path, int timestamp);
+void plugin_preload(const Index<PluginHandle *> & list);
 int plugin_get_priority(PluginHandle * plugin);
+int plugin_get_flags(PluginHandle * plugin);
 PluginEnabled plugin_get_enabled(PluginHandle * plugin);
 void plugin_set_enabled(PluginHandle * plugin, PluginEnabled enabled);
 void plugin_set_failed(PluginHandle * plugin);
@@ -66,6 +69,9 @@ const Index<String> & playlist_plugin_get_exts(PluginHandle * plugin);
 bool playlist_plugin_has_ext(PluginHandle * plugin, const char * ext);
 bool input_plugin_has_key(PluginHandle * plugin, InputKey key,
                           const char * value);
+Index<PluginHandle *> input_plugin_lookup_key(InputKey key, const char * value);
+void input_plugin_add_probe(PluginHandle * plugin, int64_t bytes_read,
+                            bool matched);
 bool input_plugin_has_subtunes(PluginHandle * plugin);
 bool input_plugin_can_write_tuple(PluginHandle * plugin);
 
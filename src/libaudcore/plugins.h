@@ -73,4 +73,15 @@ void aud_plugin_remove_watch(PluginHandle * plugin, PluginWatchFunc func,
 
 Index<const char *> aud_plugin_get_supported_mime_types();
 
+/* statistics on the content probes (InputPlugin::is_our_file) of an input
+ * plugin, e.g. for ordering plugins by cost; safe to call from any thread */
+struct PluginProbeStats
+{
+    int64_t probes;     /* files probed */
+    int64_t matches;    /* files claimed by the plugin */
+    int64_t bytes_read; /* total bytes read while probing */
+};
+
+PluginProbeStats aud_plugin_get_probe_stats(PluginHandle * plugin);
+
 #endif
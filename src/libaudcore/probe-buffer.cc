@@ -20,9 +20,85 @@
 #include "probe-buffer.h"
 #include "runtime.h"
 
+#include <pthread.h>
 #include <string.h>
 
+#include <mutex>
+
+/* The buffer starts small and doubles as needed, since most probes read only a
+ * few hundred bytes.  Each thread keeps one released buffer of each size for
+ * reuse, since the scanner and adder threads probe many files in a row. */
+static constexpr int MINBUF = 4 * 1024;
 static constexpr int MAXBUF = 256 * 1024;
+static constexpr int N_SIZES = 7; /* MINBUF << (N_SIZES - 1) == MAXBUF */
+
+struct BufferPool
+{
+    char * spare[N_SIZES];
+};
+
+static pthread_key_t key;
+static std::once_flag once;
+
+static void free_pool(void * pool_)
+{
+    auto pool = (BufferPool *)pool_;
+    if (!pool)
+        return;
+
+    for (char * buf : pool->spare)
+        delete[] buf;
+
+    delete pool;
+}
+
+static void make_key() { pthread_key_create(&key, free_pool); }
+
+static BufferPool * get_pool()
+{
+    std::call_once(once, make_key);
+
+    auto pool = (BufferPool *)pthread_getspecific(key);
+
+    if (!pool)
+    {
+        pool = new BufferPool();
+        pthread_setspecific(key, pool);
+    }
+
+    return pool;
+}
+
+static int size_index(int size)
+{
+    int idx = 0;
+    while ((MINBUF << idx) < size)
+        idx++;
+
+    return idx;
+}
+
+static char * alloc_buffer(int idx)
+{
+    BufferPool * pool = get_pool();
+    char * buf = pool->spare[idx];
+
+    if (!buf)
+        return new char[MINBUF << idx];
+
+    pool->spare[idx] = nullptr;
+    return buf;
+}
+
+static void free_buffer(char * buf, int idx)
+{
+    BufferPool * pool = get_pool();
+
+    if (pool->spare[idx])
+        delete[] buf;
+    else
+        pool->spare[idx] = buf;
+}
 
 ProbeBuffer::ProbeBuffer(const char * filename, VFSImpl * file)
     : m_filename(filename), m_file(file)
@@ -30,7 +106,11 @@ ProbeBuffer::ProbeBuffer(const char * filename, VFSImpl * file)
     AUDINFO("<%p> buffering enabled for %s\n", this, (const char *)m_filename);
 }
 
-ProbeBuffer::~ProbeBuffer() { delete[] m_buffer; }
+ProbeBuffer::~ProbeBuffer()
+{
+    if (m_buffer)
+        free_buffer(m_buffer, size_index(m_size));
+}
 
 void ProbeBuffer::increase_buffer(int64_t size)
 {
@@ -38,8 +118,20 @@ void ProbeBuffer::increase_buffer(int64_t size)
 
     if (m_filled < size)
     {
-        if (!m_buffer)
-            m_buffer = new char[MAXBUF];
+        if (m_size < size)
+        {
+            int idx = size_index(size);
+            char * buf = alloc_buffer(idx);
+
+            if (m_buffer)
+            {
+                memcpy(buf, m_buffer, m_filled);
+                free_buffer(m_buffer, size_index(m_size));
+            }
+
+            m_buffer = buf;
+            m_size = MINBUF << idx;
+        }
 
         m_filled += m_file->fread(m_buffer + m_filled, 1, size - m_filled);
     }
@@ -48,8 +140,12 @@ void ProbeBuffer::increase_buffer(int64_t size)
 void ProbeBuffer::release_buffer()
 {
     AUDINFO("<%p> buffering disabled for %s\n", this, (const char *)m_filename);
-    delete[] m_buffer;
+
+    if (m_buffer)
+        free_buffer(m_buffer, size_index(m_size));
+
     m_buffer = nullptr;
+    m_size = 0;
     m_filled = 0;
     m_at = -1;
 }
@@ -84,6 +180,7 @@ int64_t ProbeBuffer::fread(void * buffer, int64_t size, int64_t count)
             total += m_file->fread(buffer, 1, remain);
     }
 
+    m_bytes_read += total;
     return (size > 0) ? total / size : 0;
 }
 
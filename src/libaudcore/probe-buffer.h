@@ -55,7 +55,10 @@ public:
 
     String get_metadata(const char * field);
 
+    VFSImpl * file() { return m_file.get(); }
+
     void set_limit_to_buffer(bool limit) { m_limited = limit; }
+    int64_t bytes_read() const { return m_bytes_read; }
 
 private:
     void increase_buffer(int64_t size);
@@ -64,7 +67,8 @@ private:
     String m_filename;
     SmartPtr<VFSImpl> m_file;
     char * m_buffer = nullptr;
-    int m_filled = 0, m_at = 0;
+    int m_size = 0, m_filled = 0, m_at = 0;
+    int64_t m_bytes_read = 0;
     bool m_limited = false;
 };
 
@@ -20,8 +20,13 @@
 #include "probe.h"
 #include "internal.h"
 
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <pthread.h>
 #include <string.h>
 
+#include <mutex>
+
 #include "audstrings.h"
 #include "i18n.h"
 #include "playlist.h"
@@ -60,25 +65,23 @@ InputPlugin * load_input_plugin(PluginHandle * decoder, String * error)
 int probe_by_filename(const char * filename)
 {
     int flags = 0;
-    auto & list = aud_plugin_list(PluginType::Input);
 
     StringBuf scheme = uri_get_scheme(filename);
     StringBuf ext = uri_get_extension(filename);
 
-    for (PluginHandle * plugin : list)
-    {
-        if (!aud_plugin_get_enabled(plugin))
-            continue;
-
-        if ((scheme &&
-             input_plugin_has_key(plugin, InputKey::Scheme, scheme)) ||
-            (ext && input_plugin_has_key(plugin, InputKey::Ext, ext)))
+    auto check = [&](InputKey key, const char * value) {
+        for (PluginHandle * plugin : input_plugin_lookup_key(key, value))
         {
             flags |= PROBE_FLAG_HAS_DECODER;
             if (input_plugin_has_subtunes(plugin))
                 flags |= PROBE_FLAG_MIGHT_HAVE_SUBTUNES;
         }
-    }
+    };
+
+    if (scheme)
+        check(InputKey::Scheme, scheme);
+    if (ext)
+        check(InputKey::Ext, ext);
 
     return flags;
 }
@@ -95,21 +98,20 @@ EXPORT PluginHandle * aud_file_find_decoder(const char * filename, bool fast,
     Index<PluginHandle *> ext_matches;
     Index<PluginHandle *> mime_matches;
 
-    for (PluginHandle * plugin : list)
+    if (scheme)
     {
-        if (!aud_plugin_get_enabled(plugin))
-            continue;
-
-        if (scheme && input_plugin_has_key(plugin, InputKey::Scheme, scheme))
+        auto scheme_matches = input_plugin_lookup_key(InputKey::Scheme, scheme);
+        if (scheme_matches.len())
         {
-            AUDINFO("Matched %s by URI scheme.\n", aud_plugin_get_name(plugin));
-            return plugin;
+            AUDINFO("Matched %s by URI scheme.\n",
+                    aud_plugin_get_name(scheme_matches[0]));
+            return scheme_matches[0];
         }
-
-        if (ext && input_plugin_has_key(plugin, InputKey::Ext, ext))
-            ext_matches.append(plugin);
     }
 
+    if (ext)
+        ext_matches = input_plugin_lookup_key(InputKey::Ext, ext);
+
     if (ext_matches.len() == 1)
     {
         AUDINFO("Matched %s by extension.\n",
@@ -134,14 +136,13 @@ EXPORT PluginHandle * aud_file_find_decoder(const char * filename, bool fast,
 
     if (mime)
     {
-        for (PluginHandle * plugin : (ext_matches.len() ? ext_matches : list))
-        {
-            if (!aud_plugin_get_enabled(plugin))
-                continue;
+        mime_matches = input_plugin_lookup_key(InputKey::MIME, mime);
 
-            if (input_plugin_has_key(plugin, InputKey::MIME, mime))
-                mime_matches.append(plugin);
-        }
+        /* narrow down the extension matches, if there were any */
+        if (ext_matches.len())
+            mime_matches.remove_if([&](PluginHandle * plugin) {
+                return ext_matches.find(plugin) < 0;
+            });
     }
 
     if (mime_matches.len() == 1)
@@ -166,7 +167,15 @@ EXPORT PluginHandle * aud_file_find_decoder(const char * filename, bool fast,
         if (!ip)
             continue;
 
-        if (ip->is_our_file(filename, file))
+        int64_t start = file.bytes_read();
+        bool matched = ip->is_our_file(filename, file);
+        int64_t used = (start >= 0) ? file.bytes_read() - start : 0;
+
+        AUDDBG("%s read %" PRId64 " bytes.\n", aud_plugin_get_name(plugin),
+               used);
+        input_plugin_add_probe(plugin, used, matched);
+
+        if (matched)
         {
             AUDINFO("Matched %s by content.\n", aud_plugin_get_name(plugin));
             file.set_limit_to_buffer(false);
@@ -192,9 +201,45 @@ EXPORT PluginHandle * aud_file_find_decoder(const char * filename, bool fast,
     return nullptr;
 }
 
+// the wanted fields are passed to tag readers through thread-local storage,
+// since the input plugin API has no parameter for them; the value stored is a
+// pointer to the mask on the stack of aud_file_read_tag()
+static pthread_key_t wanted_fields_key;
+
+static void make_wanted_fields_key()
+{
+    pthread_key_create(&wanted_fields_key, nullptr);
+}
+
+static const uint64_t * swap_wanted_fields(const uint64_t * fields)
+{
+    static std::once_flag once;
+    std::call_once(once, make_wanted_fields_key);
+
+    auto prev = (const uint64_t *)pthread_getspecific(wanted_fields_key);
+    pthread_setspecific(wanted_fields_key, fields);
+    return prev;
+}
+
+EXPORT uint64_t aud_file_get_wanted_fields()
+{
+    auto fields = swap_wanted_fields(nullptr);
+    swap_wanted_fields(fields);
+    return fields ? *fields : AUD_TAG_ALL_FIELDS;
+}
+
 EXPORT bool aud_file_read_tag(const char * filename, PluginHandle * decoder,
                               VFSFile & file, Tuple & tuple,
                               Index<char> * image, String * error)
+{
+    return aud_file_read_tag(filename, decoder, file, tuple, image, error,
+                             AUD_TAG_ALL_FIELDS);
+}
+
+EXPORT bool aud_file_read_tag(const char * filename, PluginHandle * decoder,
+                              VFSFile & file, Tuple & tuple,
+                              Index<char> * image, String * error,
+                              uint64_t fields)
 {
     auto ip = load_input_plugin(decoder, error);
     if (!ip)
@@ -203,10 +248,24 @@ EXPORT bool aud_file_read_tag(const char * filename, PluginHandle * decoder,
     if (!open_input_file(filename, "r", ip, file, error))
         return false;
 
+    // tags may be read from anywhere in the file
+    file.set_access_hint(VFS_ACCESS_RANDOM);
+
     Tuple new_tuple;
     new_tuple.set_filename(filename);
 
-    if (ip->read_tag(filename, file, new_tuple, image))
+    int64_t bytes_before = file.bytes_read();
+
+    auto prev_fields = swap_wanted_fields(&fields);
+    bool success = ip->read_tag(filename, file, new_tuple, image);
+    swap_wanted_fields(prev_fields);
+
+    int64_t bytes_after = file.bytes_read();
+    if (bytes_before >= 0 && bytes_after >= 0)
+        AUDDBG("Read %" PRId64 " bytes for tag of %s.\n",
+               bytes_after - bytes_before, filename);
+
+    if (success)
     {
         // cleanly replace existing tuple
         new_tuple.set_state(Tuple::Valid);
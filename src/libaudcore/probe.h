@@ -26,6 +26,7 @@
 class PluginHandle;
 class Tuple;
 class VFSFile;
+struct PlaylistAddItem;
 
 /* ====== ALBUM ART API ====== */
 
@@ -76,6 +77,46 @@ public:
 AudArtPtr aud_art_request(const char * file, int format,
                           bool * queued = nullptr);
 
+/* ====== ALBUM ART THUMBNAIL API ====== */
+
+/* decoded album art, scaled down to a requested size */
+struct AudArtThumbnail
+{
+    int width = 0, height = 0;
+    Index<char> pixels; /* RGBA, 4 bytes per pixel, rows not padded */
+};
+
+/* Decodes <image> (JPEG, PNG, etc.) and scales it to fit within <size> x <size>
+ * pixels.  Called from a background thread.  Since libaudcore does not decode
+ * images itself, the interface library (libaudqt or libaudgui) registers this
+ * function at startup, and thumbnails are unavailable until it does. */
+typedef AudArtThumbnail (*AudArtScaleFunc)(const Index<char> & image,
+                                           int size);
+
+/* Waits for any calls to the previous function to return. */
+void aud_art_set_scale_func(AudArtScaleFunc func);
+/* Unregisters <func> if it is still the registered function, and waits for any
+ * calls to return, so that it can be unloaded. */
+void aud_art_unset_scale_func(AudArtScaleFunc func);
+
+/*
+ * Gets a thumbnail of the album art for <file> (the URI of a song file), scaled
+ * to fit within <size> x <size> pixels.  Thumbnails are kept in memory (up to
+ * "art_thumbnail_cache_size" MB) and, for local files, on disk (up to
+ * "art_thumbnail_disk_size" MB) until the song file is modified.
+ *
+ * This is a non-blocking call.  If the thumbnail is not in memory, it sets
+ * *queued to true, returns an empty thumbnail, and begins to load it in the
+ * background (most recent requests first), without decoding or scaling any
+ * image in the calling thread.  On completion, the "art thumbnail ready" hook
+ * is called, with <file> as a parameter.
+ *
+ * If the file has no album art, an empty thumbnail is returned and *queued is
+ * set to false.
+ */
+AudArtThumbnail aud_art_request_thumbnail(const char * file, int size,
+                                          bool * queued = nullptr);
+
 /* ====== GENERAL PROBING API ====== */
 
 /* The following two functions take an additional VFSFile parameter to allow
@@ -89,9 +130,74 @@ bool aud_file_read_tag(const char * filename, PluginHandle * decoder,
                        VFSFile & file, Tuple & tuple,
                        Index<char> * image = nullptr, String * error = nullptr);
 
+/* Masks of Tuple fields, used to read only part of the song metadata.  Each
+ * bit corresponds to one Tuple::Field; see aud_tag_field(). */
+constexpr uint64_t aud_tag_field(int field) { return (uint64_t)1 << field; }
+constexpr uint64_t AUD_TAG_ALL_FIELDS = ~(uint64_t)0;
+
+/* Like the above, but asks for only the fields in <fields>.  Tag readers may
+ * skip reading (and even seek past) the rest; they are not required to, so
+ * the tuple may still contain other fields.  Pass 0 together with <image> to
+ * read only the album art. */
+bool aud_file_read_tag(const char * filename, PluginHandle * decoder,
+                       VFSFile & file, Tuple & tuple, Index<char> * image,
+                       String * error, uint64_t fields);
+
+/* For use by tag readers: returns the fields asked for by the call to
+ * aud_file_read_tag() in progress in the calling thread.  Outside of such a
+ * call, returns AUD_TAG_ALL_FIELDS. */
+uint64_t aud_file_get_wanted_fields();
+
 bool aud_file_can_write_tuple(const char * filename, PluginHandle * decoder);
 bool aud_file_write_tuple(const char * filename, PluginHandle * decoder,
                           const Tuple & tuple);
+
+/* Writes the song info of several files in the background, on a small pool of
+ * worker threads (each file as by aud_file_write_tuple).  <callback> is called
+ * in the main thread once all the files have been written, with the number of
+ * files that could not be written. */
+typedef void (*AudTagBatchCallback)(int failed, void * user);
+void aud_file_write_tuples(Index<PlaylistAddItem> && items,
+                           AudTagBatchCallback callback = nullptr,
+                           void * user = nullptr);
 bool aud_custom_infowin(const char * filename, PluginHandle * decoder);
 
+/* ====== LOUDNESS ANALYSIS API ====== */
+
+/* results of loudness analysis (EBU R 128); the album values equal the track
+ * values unless the song was analyzed as part of an album */
+struct AudLoudnessInfo
+{
+    float track_loudness; /* integrated loudness, LUFS */
+    float track_peak;     /* true peak, linear (1.0 = full scale) */
+    float album_loudness;
+    float album_peak;
+};
+
+struct AudLoudnessProgress
+{
+    int done;  /* songs finished (or skipped) since the queue was last idle */
+    int total; /* songs finished plus songs still waiting */
+};
+
+/*
+ * Queues <files> (URIs of local song files) for loudness analysis.  Songs are
+ * decoded in the background (by input plugins which allow it) on up to
+ * "loudness_threads" worker threads; while a song is playing, each worker is
+ * held to "loudness_max_speed" times real time.  Results are kept on disk
+ * until the song file is modified, and are used for ReplayGain if the song has
+ * no ReplayGain tags.  If <album> is true, the files are measured together and
+ * album loudness is computed as well; otherwise songs already analyzed are
+ * skipped.  The "loudness progress" hook is called after each song.
+ *
+ * If "loudness_analysis" is enabled, upcoming songs without ReplayGain tags are
+ * also queued automatically, ahead of everything else.
+ */
+void aud_loudness_analyze(const Index<String> & files, bool album);
+void aud_loudness_cancel();
+AudLoudnessProgress aud_loudness_get_progress();
+
+/* Returns false if <file> has not been analyzed or has changed since. */
+bool aud_loudness_get(const char * file, AudLoudnessInfo & info);
+
 #endif
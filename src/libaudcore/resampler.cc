@@ -0,0 +1,263 @@
+/*
+ * resampler.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "resampler.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "templates.h"
+
+typedef Resampler::Lanes Lanes;
+
+static constexpr int n_lanes = Resampler::n_lanes;
+
+/* ratios needing more phases than this are interpolated */
+static constexpr int max_phases = 256;
+static constexpr int max_taps = 4096;
+
+/* taps per phase (for upsampling), and the edges of the passband and stopband
+ * as fractions of the lower of the two Nyquist frequencies; the stopband may
+ * start above Nyquist, since what aliases from there falls in the transition
+ * band, above the passband */
+static const struct
+{
+    int taps;
+    double pass, stop;
+} qualities[Resampler::n_qualities] = {
+    {16, 0.75, 1.05}, /* Low */
+    {48, 0.86, 1.02}, /* Medium */
+    {96, 0.91, 1.01}, /* High */
+    {192, 0.94, 1.0}  /* Best */
+};
+
+/* modified Bessel function of the first kind, order zero */
+static double bessel_i0(double x)
+{
+    double sum = 1, term = 1;
+
+    for (int k = 1; term > sum * 1e-12; k++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+/* GCC vector types may be unaligned in memory, but must be loaded as such */
+static inline Lanes load(const float * data)
+{
+    Lanes vec;
+    memcpy(&vec, data, sizeof vec);
+    return vec;
+}
+
+static inline float dot(const float * data, const float * taps, int n_taps)
+{
+    /* two sums hide the latency of the additions */
+    Lanes sum1{}, sum2{};
+
+    for (int k = 0; k < n_taps; k += 2 * n_lanes)
+    {
+        sum1 += load(data + k) * load(taps + k);
+        sum2 += load(data + k + n_lanes) * load(taps + k + n_lanes);
+    }
+
+    sum1 += sum2;
+
+    float sum = 0;
+    for (int c = 0; c < n_lanes; c++)
+        sum += sum1[c];
+
+    return sum;
+}
+
+static int gcd(int a, int b)
+{
+    while (b)
+    {
+        int c = a % b;
+        a = b;
+        b = c;
+    }
+
+    return a;
+}
+
+Resampler::Resampler(int channels, int in_rate, int out_rate,
+                     ResampleQuality quality)
+    : m_channels(aud::clamp(channels, 1, AUD_MAX_CHANNELS)),
+      m_in_rate(aud::max(1, in_rate)),
+      m_out_rate(aud::max(1, out_rate)),
+      m_quality(quality)
+{
+    int div = gcd(m_in_rate, m_out_rate);
+    m_phases_exact = m_out_rate / div;
+    m_step = m_in_rate / div;
+    m_phases = aud::min(m_phases_exact, max_phases);
+
+    auto & q = qualities[aud::clamp((int)quality, 0, n_qualities - 1)];
+
+    /* when downsampling, the cutoff is lower relative to the input rate, and
+     * the filter longer by the same factor */
+    double scale = aud::min(1.0, (double)m_out_rate / m_in_rate);
+    int taps = aud::min((int)ceil(q.taps / scale), max_taps);
+    m_taps = (taps + 2 * n_lanes - 1) / (2 * n_lanes) * (2 * n_lanes);
+
+    /* Kaiser's estimate of the attenuation for this length and transition
+     * band, and the window shape achieving it */
+    double width = M_PI * (q.stop - q.pass) * scale;
+    double atten = 8 + 2.285 * width * m_taps;
+    double beta = (atten > 50) ? 0.1102 * (atten - 8.7)
+                               : 0.5842 * pow(atten - 21, 0.4) +
+                                     0.07886 * (atten - 21);
+
+    double cutoff = 0.5 * (q.pass + q.stop) * scale;
+    double half = 0.5 * m_taps;
+    double norm = 1 / bessel_i0(beta);
+
+    m_filter.resize((m_phases + 1) * m_taps);
+
+    for (int p = 0; p <= m_phases; p++)
+    {
+        float * row = &m_filter[p * m_taps];
+        double sum = 0;
+
+        for (int k = 0; k < m_taps; k++)
+        {
+            /* distance from the output frame, which falls between taps
+             * half - 1 and half */
+            double t = k - (half - 1) - (double)p / m_phases;
+            double x = M_PI * cutoff * t;
+            double sinc = (x == 0) ? 1 : sin(x) / x;
+            double r = t / half;
+            double window = bessel_i0(beta * sqrt(aud::max(0.0, 1 - r * r)));
+
+            row[k] = sinc * window * norm;
+            sum += row[k];
+        }
+
+        /* unity gain at DC for every phase */
+        for (int k = 0; k < m_taps; k++)
+            row[k] /= sum;
+    }
+
+    reset();
+}
+
+void Resampler::reset()
+{
+    /* the first output frame falls on the first input frame */
+    for (int c = 0; c < m_channels; c++)
+    {
+        m_history[c].clear();
+        m_history[c].insert(0, m_taps / 2 - 1);
+    }
+
+    m_index = 0;
+    m_frac = 0;
+}
+
+int Resampler::pending() const
+{
+    return m_history[0].len() - m_index - (m_taps / 2 - 1) -
+           (m_frac ? 1 : 0);
+}
+
+void Resampler::process(const float * data, int frames, Index<float> & out)
+{
+    int have = m_history[0].len();
+
+    for (int c = 0; c < m_channels; c++)
+    {
+        m_history[c].resize(have + frames);
+
+        float * history = &m_history[c][have];
+        const float * in = data + c;
+
+        for (int i = 0; i < frames; i++, in += m_channels)
+            history[i] = *in;
+    }
+
+    /* frames past m_index that the next output frame may start at */
+    int room = have + frames - m_taps - m_index;
+    int count = 0;
+
+    if (room >= 0)
+        count = ((int64_t)(room + 1) * m_phases_exact - 1 - m_frac) / m_step +
+                1;
+
+    out.resize(count * m_channels);
+
+    float * o = out.begin();
+    bool exact = (m_phases == m_phases_exact);
+
+    for (int n = 0; n < count; n++)
+    {
+        const float * row;
+        float blend = 0;
+
+        if (exact)
+            row = &m_filter[m_frac * m_taps];
+        else
+        {
+            int64_t pos = (int64_t)m_frac * m_phases;
+            row = &m_filter[pos / m_phases_exact * m_taps];
+            blend = (float)(pos % m_phases_exact) / m_phases_exact;
+        }
+
+        for (int c = 0; c < m_channels; c++)
+        {
+            const float * in = &m_history[c][m_index];
+            float y = dot(in, row, m_taps);
+
+            if (blend)
+                y += blend * (dot(in, row + m_taps, m_taps) - y);
+
+            *o++ = y;
+        }
+
+        m_frac += m_step;
+        m_index += m_frac / m_phases_exact;
+        m_frac %= m_phases_exact;
+    }
+
+    for (int c = 0; c < m_channels; c++)
+        m_history[c].remove(0, m_index);
+
+    m_index = 0;
+}
+
+void Resampler::finish(Index<float> & out)
+{
+    if (pending() <= 0)
+    {
+        out.resize(0);
+        reset();
+        return;
+    }
+
+    /* enough silence to bring the last input frame past the filter center */
+    Index<float> silence;
+    silence.insert(0, (m_taps / 2) * m_channels);
+
+    process(silence.begin(), m_taps / 2, out);
+    reset();
+}
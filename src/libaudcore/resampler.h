@@ -0,0 +1,84 @@
+/*
+ * resampler.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_RESAMPLER_H
+#define LIBAUDCORE_RESAMPLER_H
+
+#include "audio.h"
+#include "index.h"
+#include "runtime.h"
+
+/* Converts the sample rate of interleaved float audio with a polyphase
+ * windowed-sinc (Kaiser) filter.  For a ratio of small integers, such as
+ * 44.1 to 48 kHz, each output frame uses one of the exact phases of the
+ * filter; otherwise it is interpolated between the two nearest of a fixed
+ * number of phases.  The output is aligned with the input (the first output
+ * frame falls on the first input frame); audio is held back by half the filter
+ * length until more input or finish() arrives. */
+class Resampler
+{
+public:
+    /* filter taps are multiplied four at a time, which fits in any SIMD
+     * register; each phase has a multiple of 2 * n_lanes taps */
+    static constexpr int n_lanes = 4;
+    static constexpr int n_qualities = (int)ResampleQuality::Best + 1;
+
+    typedef float Lanes __attribute__((vector_size(n_lanes * sizeof(float))));
+
+    Resampler(int channels, int in_rate, int out_rate, ResampleQuality quality);
+
+    int channels() const { return m_channels; }
+    int in_rate() const { return m_in_rate; }
+    int out_rate() const { return m_out_rate; }
+    ResampleQuality quality() const { return m_quality; }
+
+    /* takes interleaved samples; <out> is replaced by the frames that could
+     * be computed so far */
+    void process(const float * data, int frames, Index<float> & out);
+
+    /* computes the frames still held back and resets */
+    void finish(Index<float> & out);
+
+    /* discards the frames held back */
+    void reset();
+
+    /* input frames that have gone in but not yet come out */
+    int pending() const;
+
+private:
+    int m_channels, m_in_rate, m_out_rate;
+    ResampleQuality m_quality;
+
+    /* the rate ratio in lowest terms: each output frame advances the input
+     * position by m_step / m_phases_exact frames */
+    int m_phases_exact, m_step;
+    int m_phases; /* phases in the table (m_phases_exact at most) */
+    int m_taps;
+
+    /* m_phases + 1 rows of m_taps coefficients; row p is offset by
+     * p / m_phases of a frame, so that interpolation can use row p + 1 */
+    Index<float> m_filter;
+
+    /* one planar history per channel; the next output frame is computed
+     * from m_taps frames starting at m_index */
+    Index<float> m_history[AUD_MAX_CHANNELS];
+    int m_index, m_frac; /* plus m_frac / m_phases_exact of a frame */
+};
+
+#endif // LIBAUDCORE_RESAMPLER_H
@@ -64,6 +64,7 @@
 #endif
 
 size_t misc_bytes_allocated;
+size_t misc_allocations;
 
 static bool headless_mode;
 static int instance_number = 1;
@@ -298,9 +299,14 @@ EXPORT void aud_init_i18n()
 
 EXPORT void aud_init()
 {
+    audtrace::Span span("aud_init");
+
     g_thread_pool_set_max_idle_time(100);
 
-    config_load();
+    {
+        audtrace::Span span("config_load");
+        config_load();
+    }
 
     if (!mainloop_type_set)
     {
@@ -312,16 +318,31 @@ EXPORT void aud_init()
             aud_set_mainloop_type(MainloopType::GLib);
     }
 
-    chardet_init();
+    {
+        audtrace::Span span("chardet_init");
+        chardet_init();
+    }
+
     eq_init();
     output_init();
-    playlist_init();
 
-    start_plugins_one();
+    {
+        audtrace::Span span("playlist_init");
+        playlist_init();
+    }
+
+    {
+        audtrace::Span span("start_plugins_one");
+        start_plugins_one();
+    }
 
     record_init();
     scanner_init();
-    load_playlists();
+
+    {
+        audtrace::Span span("load_playlists");
+        load_playlists();
+    }
 }
 
 static void do_autosave()
@@ -339,7 +360,11 @@ EXPORT void aud_run()
      * it can be scanned more efficiently (album art read in the same pass). */
     playlist_enable_scan(true);
     playlist_clear_updates();
-    start_plugins_two();
+
+    {
+        audtrace::Span span("start_plugins_two");
+        start_plugins_two();
+    }
 
     static QueuedFunc autosave;
     autosave.start(AUTOSAVE_INTERVAL, do_autosave);
@@ -349,41 +374,82 @@ EXPORT void aud_run()
 
     autosave.stop();
 
-    stop_plugins_two();
+    {
+        audtrace::Span span("stop_plugins_two");
+        stop_plugins_two();
+    }
     playlist_enable_scan(false);
 }
 
-EXPORT void aud_cleanup()
+static void cleanup_real()
 {
-    save_playlists(true);
+    {
+        audtrace::Span span("save_playlists");
+        save_playlists(true);
+    }
 
-    aud_drct_stop();
-    playback_stop(true);
+    {
+        audtrace::Span span("playback_stop");
+        aud_drct_stop();
+        playback_stop(true);
+    }
 
-    adder_cleanup();
-    scanner_cleanup();
-    record_cleanup();
+    {
+        audtrace::Span span("stop_workers");
+        adder_cleanup();
+        scanner_cleanup();
+        record_cleanup();
+        vfs_async_cleanup();
+        art_thumbnail_cleanup();
+        loudness_cleanup();
+        tag_writer_cleanup();
+    }
 
     /* In Qt mode, this deletes the QApplication. This must be done
      * after shutting down any GUI plugins but before unloading plugin
      * modules (which will indirectly unload Qt shared libraries). */
-    mainloop_cleanup();
-    stop_plugins_one();
+    {
+        audtrace::Span span("mainloop_cleanup");
+        mainloop_cleanup();
+    }
+
+    /* deliver queued log messages while the plugin modules (whose strings they
+     * point to) are still loaded */
+    audlog::flush();
+
+    {
+        audtrace::Span span("stop_plugins_one");
+        stop_plugins_one();
+    }
 
     art_cleanup();
+    art_search_cleanup();
+    cue_cache_cleanup();
     chardet_cleanup();
     eq_cleanup();
     output_cleanup();
     playlist_end();
+    vfs_prefetch_cleanup();
 
     event_queue_cancel_all();
     hook_cleanup();
     timer_cleanup();
 
+    audtrace::Span span("config_save");
     config_save();
     config_cleanup();
 }
 
+EXPORT void aud_cleanup()
+{
+    {
+        audtrace::Span span("aud_cleanup");
+        cleanup_real();
+    }
+
+    audtrace::write();
+}
+
 EXPORT void aud_leak_check()
 {
     for (String & path : aud_paths)
@@ -393,4 +459,6 @@ EXPORT void aud_leak_check()
 
     if (misc_bytes_allocated)
         AUDWARN("Bytes allocated at exit: %ld\n", (long)misc_bytes_allocated);
+
+    AUDDBG("Index allocations: %ld\n", (long)misc_allocations);
 }
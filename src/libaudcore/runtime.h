@@ -20,6 +20,8 @@
 #ifndef LIBAUDCORE_RUNTIME_H
 #define LIBAUDCORE_RUNTIME_H
 
+#include <stdint.h>
+
 #include <libaudcore/objects.h>
 
 enum class AudPath
@@ -63,6 +65,14 @@ enum class ReplayGainMode
     Automatic
 };
 
+enum class ResampleQuality
+{
+    Low,
+    Medium,
+    High,
+    Best
+};
+
 namespace audlog
 {
 enum Level
@@ -91,6 +101,15 @@ void log(Level level, const char * file, int line, const char * func,
 #endif
 
 const char * get_level_name(Level level);
+
+/* In asynchronous mode, log() only copies the message arguments into a
+ * per-thread ring buffer; formatting and delivery to stderr and the handlers
+ * happen on a background thread.  The format string must be a literal. */
+void set_async(bool enable);
+/* Delivers all pending messages before returning. */
+void flush();
+/* Number of messages lost because a ring buffer was full. */
+int64_t get_dropped_count();
 } // namespace audlog
 
 #define AUDERR(...)                                                            \
@@ -118,6 +137,57 @@ const char * get_level_name(Level level);
                     __VA_ARGS__);                                              \
     } while (0)
 
+/* Tracing of startup, shutdown, and other coarse-grained phases.  When enabled,
+ * each span is recorded with monotonic timestamps, the calling thread, and its
+ * nesting depth; at the end of aud_cleanup() the spans are written to a file in
+ * the Chrome trace-event format (viewable in chrome://tracing or Perfetto). */
+namespace audtrace
+{
+/* Starts recording.  If <filename> is null, the trace is written to
+ * ~/.cache/audacious/trace.json.  Should be called before aud_init(). */
+void enable(const char * filename);
+bool enabled();
+
+/* microseconds since tracing was enabled */
+int64_t now();
+
+/* Records a span that is not bound to a scope (such as one started in one
+ * callback and finished in another).  <detail> is copied. */
+void add(const char * name, const char * detail, int64_t start, int64_t end);
+
+/* Writes and discards the recorded spans; called by aud_cleanup(). */
+void write();
+
+/* used by Span; begin() returns -1 if tracing is disabled */
+int64_t begin();
+void end(const char * name, const char * detail, int64_t start);
+
+/* Records the time from construction to destruction.  <name> must be a string
+ * literal; <detail> (e.g. a file name) need only be valid until destruction. */
+class Span
+{
+public:
+    explicit Span(const char * name, const char * detail = nullptr)
+        : m_name(name), m_detail(detail), m_start(begin())
+    {
+    }
+
+    ~Span()
+    {
+        if (m_start >= 0)
+            end(m_name, m_detail, m_start);
+    }
+
+    Span(const Span &) = delete;
+    Span & operator=(const Span &) = delete;
+
+private:
+    const char * m_name;
+    const char * m_detail;
+    int64_t m_start;
+};
+} // namespace audtrace
+
 const char * aud_get_path(AudPath id);
 
 void aud_set_headless_mode(bool headless);
@@ -142,6 +212,12 @@ void aud_config_set_defaults(const char * section,
 
 void aud_set_str(const char * section, const char * name, const char * value);
 String aud_get_str(const char * section, const char * name);
+
+/* Sets several values at once; <entries> is a null-terminated list of name and
+ * value pairs, as for aud_config_set_defaults().  Rather than a "set <name>"
+ * hook for each changed value in the main section, a single "set" hook is
+ * called, whose data is a (const Index<String> *) listing the changed names. */
+void aud_set_strs(const char * section, const char * const * entries);
 void aud_set_bool(const char * section, const char * name, bool value);
 bool aud_get_bool(const char * section, const char * name);
 void aud_toggle_bool(const char * section, const char * name);
@@ -159,6 +235,10 @@ static inline String aud_get_str(const char * name)
 {
     return aud_get_str(nullptr, name);
 }
+static inline void aud_set_strs(const char * const * entries)
+{
+    aud_set_strs(nullptr, entries);
+}
 static inline void aud_set_bool(const char * name, bool value)
 {
     aud_set_bool(nullptr, name, value);
@@ -188,6 +268,20 @@ static inline double aud_get_double(const char * name)
     return aud_get_double(nullptr, name);
 }
 
+/* Usage of the stack from which StringBufs are allocated.  The first four
+ * fields refer to the calling thread; the last two to all threads. */
+struct StringBufStats
+{
+    int64_t in_use;     /* bytes currently spanned by live strings */
+    int64_t high_water; /* peak value of in_use */
+    int64_t overflows;  /* times the stack grew beyond its first segment */
+    int segments;       /* segments currently mapped, including the first */
+    int64_t all_high_water;
+    int64_t all_overflows;
+};
+
+StringBufStats aud_get_stringbuf_stats();
+
 void aud_init();
 void aud_resume();
 void aud_run();
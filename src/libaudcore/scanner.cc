@@ -87,8 +87,9 @@ void ScanRequest::run()
         /* don't overwrite tuple if already valid (e.g. from a cuesheet) */
         Tuple & rtuple = need_tuple ? tuple : dummy_tuple;
         Index<char> * pimage = need_image ? &image_data : nullptr;
+        /* when only the image is needed, let tag readers skip the rest */
         if (!aud_file_read_tag(audio_file, decoder, file, rtuple, pimage,
-                               &error))
+                               &error, need_tuple ? fields : 0))
             goto err;
 
         if (need_image && !image_data.len())
@@ -23,6 +23,7 @@
 #include "cue-cache.h"
 #include "index.h"
 #include "objects.h"
+#include "probe.h"
 #include "tuple.h"
 #include "vfs.h"
 
@@ -43,6 +44,9 @@ struct ScanRequest
     const int flags;
     const Callback callback;
 
+    /* song info wanted with SCAN_TUPLE (see aud_file_read_tag) */
+    uint64_t fields = AUD_TAG_ALL_FIELDS;
+
     PluginHandle * decoder;
     Tuple tuple;
 
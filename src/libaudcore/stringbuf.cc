@@ -17,14 +17,17 @@
  * the use of this software.
  */
 
+#include <limits.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <atomic>
 #include <new>
 
 #include "objects.h"
+#include "runtime.h"
 #include "threads.h"
 
 #ifdef _WIN32
@@ -36,34 +39,72 @@
 #endif
 #endif
 
+/*
+ * Each thread has a stack of strings, allocated in LIFO order.  The stack is
+ * made up of one or more segments: the first is mapped together with the
+ * StringStack itself when the thread first uses a StringBuf, and further
+ * segments are mapped (and chained) only when it fills up.  Segments above the
+ * topmost string are released again as strings are freed, except that one
+ * spare segment is kept to avoid mapping and unmapping repeatedly.
+ */
+
+struct StringSegment;
+
 struct StringHeader
 {
     StringHeader *next, *prev;
+    StringSegment * segment;
     int len;
 };
 
+struct StringSegment
+{
+    StringSegment * prev;
+    size_t size;  /* total size of the segment, including this header */
+    int64_t below; /* total size of the segments below this one */
+
+    char * base() { return (char *)(this + 1); }
+    char * limit() { return (char *)this + size; }
+};
+
+/* The StringStack is placed at the start of a Size-byte mapping; the rest of
+ * the mapping is taken up by the first segment. */
 struct StringStack
 {
-    static constexpr int Size = 1048576; // 1 MB
+    static constexpr int Size = 1048576;     // 1 MB
+    static constexpr int ExtraAlign = 65536; // 64 KB
+    static constexpr int MinMaxLen = Size / 2;
 
     StringHeader * top;
-    char buf[Size - sizeof top];
+    StringSegment * segment; /* segment containing the top (or above it) */
+    StringSegment * spare;
+
+    int64_t high_water;
+    int64_t overflows;
+    int n_segments;
+
+    StringSegment first;
 };
 
+static std::atomic<int64_t> all_high_water(0);
+static std::atomic<int64_t> all_overflows(0);
+
 static constexpr intptr_t align(intptr_t ptr, intptr_t size)
 {
     return (ptr + (size - 1)) / size * size;
 }
 
-static StringHeader * align_after(StringStack * stack,
+/* returns the location for a new string following <prev_header>, which may be
+ * in a lower segment */
+static StringHeader * align_after(StringSegment * segment,
                                   StringHeader * prev_header)
 {
     char * base;
-    if (prev_header)
+    if (prev_header && prev_header->segment == segment)
         base =
             (char *)prev_header + sizeof(StringHeader) + prev_header->len + 1;
     else
-        base = stack->buf;
+        base = segment->base();
 
     return (StringHeader *)align((intptr_t)base, alignof(StringHeader));
 }
@@ -75,13 +116,52 @@ static std::once_flag once;
 static HANDLE mapping;
 #endif
 
-static void free_stack(void * stack)
+static void * map_segment(size_t size)
 {
-    if (stack)
 #ifdef _WIN32
-        UnmapViewOfFile(stack);
+    void * mem = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE,
+                              PAGE_READWRITE);
+    if (!mem)
+        throw std::bad_alloc();
+#else
+    void * mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        throw std::bad_alloc();
+#endif
+
+    return mem;
+}
+
+static void unmap_segment(StringSegment * segment)
+{
+#ifdef _WIN32
+    VirtualFree(segment, 0, MEM_RELEASE);
 #else
-        munmap(stack, sizeof(StringStack));
+    munmap(segment, segment->size);
+#endif
+}
+
+static void free_stack(void * stack_)
+{
+    auto stack = (StringStack *)stack_;
+    if (!stack)
+        return;
+
+    for (StringSegment * seg = stack->segment; seg != &stack->first;)
+    {
+        StringSegment * prev = seg->prev;
+        unmap_segment(seg);
+        seg = prev;
+    }
+
+    if (stack->spare)
+        unmap_segment(stack->spare);
+
+#ifdef _WIN32
+    UnmapViewOfFile(stack);
+#else
+    munmap(stack, StringStack::Size);
 #endif
 }
 
@@ -91,7 +171,7 @@ static void make_key()
 
 #ifdef _WIN32
     mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
-                                 0, sizeof(StringStack), nullptr);
+                                 0, StringStack::Size, nullptr);
 
     if (!mapping)
         throw std::bad_alloc();
@@ -108,12 +188,12 @@ static StringStack * get_stack()
     {
 #ifdef _WIN32
         stack = (StringStack *)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0,
-                                             sizeof(StringStack));
+                                             StringStack::Size);
 
         if (!stack)
             throw std::bad_alloc();
 #else
-        stack = (StringStack *)mmap(nullptr, sizeof(StringStack),
+        stack = (StringStack *)mmap(nullptr, StringStack::Size,
                                     PROT_READ | PROT_WRITE,
                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
@@ -122,12 +202,97 @@ static StringStack * get_stack()
 #endif
 
         stack->top = nullptr;
+        stack->segment = &stack->first;
+        stack->spare = nullptr;
+        stack->high_water = 0;
+        stack->overflows = 0;
+        stack->n_segments = 1;
+
+        stack->first.prev = nullptr;
+        stack->first.size =
+            (char *)stack + StringStack::Size - (char *)&stack->first;
+        stack->first.below = 0;
+
         pthread_setspecific(key, stack);
     }
 
     return stack;
 }
 
+/* maps a new segment with room for a string of at least <min_len> bytes; the
+ * size is doubled so that a string growing by repeated appends does not need a
+ * new segment each time (untouched pages cost only address space) */
+static StringSegment * push_segment(StringStack * stack, int min_len)
+{
+    size_t needed = sizeof(StringSegment) + alignof(StringHeader) +
+                    sizeof(StringHeader) + min_len + 1;
+    size_t size = aud::max((size_t)StringStack::Size,
+                           (size_t)align(2 * needed, StringStack::ExtraAlign));
+
+    StringSegment * seg;
+
+    if (stack->spare && stack->spare->size >= size)
+    {
+        seg = stack->spare;
+        stack->spare = nullptr;
+    }
+    else
+    {
+        seg = (StringSegment *)map_segment(size);
+        seg->size = size;
+    }
+
+    seg->prev = stack->segment;
+    seg->below = stack->segment->below + stack->segment->size;
+
+    stack->segment = seg;
+    stack->n_segments++;
+    stack->overflows++;
+    all_overflows++;
+
+    return seg;
+}
+
+/* releases any segments above the one containing the topmost string */
+static void pop_segments(StringStack * stack)
+{
+    StringSegment * keep = stack->top ? stack->top->segment : &stack->first;
+
+    while (stack->segment != keep)
+    {
+        StringSegment * seg = stack->segment;
+        stack->segment = seg->prev;
+        stack->n_segments--;
+
+        if (!stack->spare)
+            stack->spare = seg;
+        else if (seg->size > stack->spare->size)
+        {
+            unmap_segment(stack->spare);
+            stack->spare = seg;
+        }
+        else
+            unmap_segment(seg);
+    }
+}
+
+/* records the end of the topmost string for the high-water mark */
+static void note_usage(StringStack * stack, StringHeader * top)
+{
+    StringSegment * seg = top->segment;
+    int64_t used =
+        seg->below + ((char *)(top + 1) + top->len + 1 - seg->base());
+
+    if (used > stack->high_water)
+    {
+        stack->high_water = used;
+
+        int64_t all = all_high_water.load(std::memory_order_relaxed);
+        while (used > all && !all_high_water.compare_exchange_weak(all, used))
+            ;
+    }
+}
+
 EXPORT void StringBuf::resize(int len)
 {
     if (!stack)
@@ -141,39 +306,59 @@ EXPORT void StringBuf::resize(int len)
         header = (StringHeader *)(m_data - sizeof(StringHeader));
 
         /* check if there is enough space in the current location */
-        char * limit = header->next ? (char *)header->next
-                                    : (char *)stack + sizeof(StringStack);
-        int max_len = limit - 1 - m_data;
-
-        if ((len < 0 && !header->next) || (len >= 0 && len < max_len))
+        StringSegment * seg = header->segment;
+        char * limit = (header->next && header->next->segment == seg)
+                           ? (char *)header->next
+                           : seg->limit();
+        int64_t max_len = limit - 1 - m_data;
+
+        if ((len < 0 && !header->next && max_len >= StringStack::MinMaxLen) ||
+            (len >= 0 && len < max_len))
         {
-            m_len = header->len = (len < 0) ? max_len : len;
+            m_len = header->len =
+                (len < 0) ? aud::min(max_len, (int64_t)INT_MAX) : len;
             need_alloc = false;
+
+            if (len >= 0 && !header->next)
+                note_usage(stack, header);
         }
     }
 
     if (need_alloc)
     {
         /* allocate a new string at the top of the stack */
-        StringHeader * new_header = align_after(stack, stack->top);
+        StringSegment * seg = stack->segment;
+        StringHeader * new_header = align_after(seg, stack->top);
         char * new_data = (char *)new_header + sizeof(StringHeader);
-        char * limit = (char *)stack + sizeof(StringStack);
-        int max_len = limit - 1 - new_data;
+        int64_t max_len = seg->limit() - 1 - new_data;
 
-        if (max_len < aud::max(len, 0))
-            throw std::bad_alloc();
+        /* "as large as possible" should still leave room for a sizable
+         * string; if the current segment is nearly full, move on to the next */
+        int min_len = (len < 0) ? StringStack::MinMaxLen : len;
 
-        int new_len = (len < 0) ? max_len : len;
+        if (max_len < min_len)
+        {
+            seg = push_segment(stack, min_len);
+            new_header = align_after(seg, nullptr);
+            new_data = (char *)new_header + sizeof(StringHeader);
+            max_len = seg->limit() - 1 - new_data;
+        }
+
+        int new_len = (len < 0) ? aud::min(max_len, (int64_t)INT_MAX) : len;
 
         if (stack->top)
             stack->top->next = new_header;
 
         new_header->prev = stack->top;
         new_header->next = nullptr;
+        new_header->segment = seg;
         new_header->len = new_len;
 
         stack->top = new_header;
 
+        if (len >= 0)
+            note_usage(stack, new_header);
+
         /* move the old data, if any */
         if (m_data)
         {
@@ -192,7 +377,7 @@ EXPORT void StringBuf::resize(int len)
     }
 
     /* Null-terminate the string except when the maximum length was requested
-     * (to avoid paging in the entire 1 MB stack prematurely).  The caller is
+     * (to avoid paging in the entire segment prematurely).  The caller is
      * expected to follow up with a more realistic resize() in this case. */
     if (len >= 0)
         m_data[len] = 0;
@@ -208,12 +393,37 @@ EXPORT StringBuf::~StringBuf()
             header->prev->next = header->next;
 
         if (header == stack->top)
+        {
             stack->top = header->prev;
+            pop_segments(stack);
+        }
         else
             header->next->prev = header->prev;
     }
 }
 
+EXPORT StringBufStats aud_get_stringbuf_stats()
+{
+    StringStack * stack = get_stack();
+    StringBufStats stats = StringBufStats();
+
+    if (stack->top)
+    {
+        StringHeader * top = stack->top;
+        StringSegment * seg = top->segment;
+        stats.in_use =
+            seg->below + ((char *)(top + 1) + top->len + 1 - seg->base());
+    }
+
+    stats.high_water = stack->high_water;
+    stats.overflows = stack->overflows;
+    stats.segments = stack->n_segments;
+    stats.all_high_water = all_high_water.load();
+    stats.all_overflows = all_overflows.load();
+
+    return stats;
+}
+
 EXPORT void StringBuf::steal(StringBuf && other)
 {
     (*this = std::move(other)).settle();
@@ -225,7 +435,7 @@ EXPORT StringBuf && StringBuf::settle()
     {
         /* collapse any space preceding this string */
         auto header = (StringHeader *)(m_data - sizeof(StringHeader));
-        StringHeader * new_header = align_after(stack, header->prev);
+        StringHeader * new_header = align_after(header->segment, header->prev);
 
         if (new_header != header)
         {
@@ -177,7 +177,13 @@ EXPORT void String::raw_unref(char * str)
 
 void string_leak_check()
 {
-    strpool_table.iterate([](const StrNode * node) {
+    HashStats stats = strpool_table.get_stats();
+    AUDDBG("String pool: %d strings in %d buckets (load %.2f, longest chain "
+           "%d), %ld of %ld lookups contended\n",
+           stats.items, stats.buckets, stats.load_factor(), stats.max_chain,
+           (long)stats.contended, (long)stats.lookups);
+
+    strpool_table.iterate_by_channel([](const StrNode * node) {
         AUDWARN("String leaked: %s\n", node->str());
         return false;
     });
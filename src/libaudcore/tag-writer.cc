@@ -0,0 +1,185 @@
+/*
+ * tag-writer.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Batch tag writing.  Songs are written by a small pool of worker threads, in
+ * the order they were submitted; the callback of each batch is called in the
+ * main thread once all of its songs have been written.  Writes to the same
+ * file are never run at once, so that a later one cannot be overwritten by an
+ * earlier one.  Writes still queued at exit are completed before the plugins
+ * are unloaded. */
+
+#include "internal.h"
+#include "probe.h"
+
+#include <thread>
+
+#include "mainloop.h"
+#include "runtime.h"
+#include "threads.h"
+#include "tuple.h"
+
+static constexpr int n_workers = 4;
+
+struct TagWriteBatch
+{
+    int remaining, failed;
+    AudTagBatchCallback callback;
+    void * user;
+};
+
+struct TagWriteJob
+{
+    PlaylistAddItem item;
+    TagWriteBatch * batch;
+};
+
+static aud::mutex mutex;
+static aud::condvar cond;
+static std::thread workers[n_workers];
+static bool workers_running, quit;
+
+static Index<TagWriteJob> jobs;          /* oldest first */
+static Index<String> active;            /* files being written */
+static Index<TagWriteBatch *> finished; /* waiting for the main thread */
+static QueuedFunc queued_finished;
+
+static void send_finished()
+{
+    auto mh = mutex.take();
+    auto batches = std::move(finished);
+    mh.unlock();
+
+    for (TagWriteBatch * batch : batches)
+    {
+        if (batch->callback)
+            batch->callback(batch->failed, batch->user);
+
+        delete batch;
+    }
+}
+
+static void worker()
+{
+    auto mh = mutex.take();
+
+    /* at exit, finish the writes already queued rather than losing them */
+    while (jobs.len() || !quit)
+    {
+        /* the oldest job for a file not being written by another worker */
+        int pos = 0;
+        while (pos < jobs.len() && active.find(jobs[pos].item.filename) >= 0)
+            pos++;
+
+        if (pos == jobs.len())
+        {
+            cond.wait(mh);
+            continue;
+        }
+
+        TagWriteJob job = std::move(jobs[pos]);
+        jobs.remove(pos, 1);
+        active.append(job.item.filename);
+
+        mh.unlock();
+
+        bool success = aud_file_write_tuple(job.item.filename, job.item.decoder,
+                                            job.item.tuple);
+        if (!success)
+            AUDERR("Error writing tag for %s\n",
+                   (const char *)job.item.filename);
+
+        mh.lock();
+
+        active.remove(active.find(job.item.filename), 1);
+        cond.notify_all();
+
+        if (!success)
+            job.batch->failed++;
+
+        if (!--job.batch->remaining)
+        {
+            if (!finished.len())
+                queued_finished.queue(send_finished);
+
+            finished.append(job.batch);
+        }
+    }
+}
+
+EXPORT void aud_file_write_tuples(Index<PlaylistAddItem> && items,
+                                  AudTagBatchCallback callback, void * user)
+{
+    auto batch = new TagWriteBatch{items.len(), 0, callback, user};
+    auto mh = mutex.take();
+
+    if (!items.len() || quit)
+    {
+        /* report back asynchronously all the same */
+        batch->failed = items.len();
+        batch->remaining = 0;
+
+        if (!finished.len())
+            queued_finished.queue(send_finished);
+
+        finished.append(batch);
+        return;
+    }
+
+    for (auto & item : items)
+        jobs.append(TagWriteJob{std::move(item), batch});
+
+    items.clear();
+
+    if (!workers_running)
+    {
+        for (std::thread & thread : workers)
+            thread = std::thread(worker);
+
+        workers_running = true;
+    }
+
+    cond.notify_all();
+}
+
+void tag_writer_cleanup()
+{
+    auto mh = mutex.take();
+
+    quit = true;
+    cond.notify_all();
+
+    if (workers_running)
+    {
+        mh.unlock();
+
+        for (std::thread & thread : workers)
+            thread.join();
+
+        mh.lock();
+        workers_running = false;
+    }
+
+    queued_finished.stop();
+
+    /* the callbacks are not called anymore */
+    for (TagWriteBatch * batch : finished)
+        delete batch;
+
+    finished.clear();
+}
@@ -1,14 +1,81 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "hook.h"
 #include "internal.h"
 #include "vfs.h"
 
-extern "C" const char * libguess_determine_encoding(const char *, int,
-                                                    const char *)
+/* there is no main loop running during the tests */
+void event_queue(const char * name, void * data, EventDestroyFunc destroy)
 {
-    return nullptr;
+    hook_call(name, data);
+
+    if (destroy)
+        destroy(data);
 }
 
-bool aud_get_bool(const char *, const char *) { return false; }
-String aud_get_str(const char *, const char *) { return String(""); }
+/* local files only, for config_load() and config_save() */
+class StdioFile : public VFSImpl
+{
+public:
+    StdioFile(FILE * handle) : m_handle(handle) {}
+    ~StdioFile() { fclose(m_handle); }
+
+    int64_t fread(void * ptr, int64_t size, int64_t nmemb)
+    {
+        return ::fread(ptr, size, nmemb, m_handle);
+    }
+
+    int fseek(int64_t offset, VFSSeekType whence) { return -1; }
+    int64_t ftell() { return -1; }
+    int64_t fsize() { return -1; }
+    bool feof() { return ::feof(m_handle); }
+
+    int64_t fwrite(const void * ptr, int64_t size, int64_t nmemb)
+    {
+        return ::fwrite(ptr, size, nmemb, m_handle);
+    }
+
+    int ftruncate(int64_t length) { return -1; }
+    int fflush() { return ::fflush(m_handle); }
+
+private:
+    FILE * m_handle;
+};
+
+VFSFile::VFSFile(const char * filename, const char * mode)
+{
+    FILE * handle = fopen(filename, mode);
+
+    if (handle)
+    {
+        m_filename = String(filename);
+        m_impl.capture(new StdioFile(handle));
+    }
+    else
+        m_error = String(strerror(errno));
+}
+
+int64_t VFSFile::fread(void * ptr, int64_t size, int64_t nmemb)
+{
+    return m_impl->fread(ptr, size, nmemb);
+}
+
+int64_t VFSFile::fwrite(const void * ptr, int64_t size, int64_t nmemb)
+{
+    return m_impl->fwrite(ptr, size, nmemb);
+}
+
+int VFSFile::fflush() { return m_impl->fflush(); }
 String VFSFile::get_metadata(const char *) { return String(); }
 
+bool VFSFile::test_file(const char * filename, VFSFileTest test)
+{
+    return (test == VFS_EXISTS) && g_file_test(filename, G_FILE_TEST_EXISTS);
+}
+
 size_t misc_bytes_allocated;
+size_t misc_allocations;
@@ -19,7 +19,14 @@
 
 #include "audio.h"
 #include "audstrings.h"
+#include "hook.h"
+#include "index.h"
 #include "internal.h"
+#include "loudness-meter.h"
+#include "multihash.h"
+#include "plugin-keys.h"
+#include "plugin-registry-bin.h"
+#include "resampler.h"
 #include "ringbuf.h"
 #include "runtime.h"
 #include "tuple-compiler.h"
@@ -27,10 +34,14 @@
 #include "vfs.h"
 
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <glib.h>
+#include <glib/gstdio.h>
+
 static bool use_qt = false;
 
 MainloopType aud_get_mainloop_type()
@@ -38,6 +49,10 @@ MainloopType aud_get_mainloop_type()
     return use_qt ? MainloopType::Qt : MainloopType::GLib;
 }
 
+static String user_dir; /* for test_config() */
+
+const char * aud_get_path(AudPath) { return user_dir; }
+
 extern void test_mainloop();
 
 static void test_audio_conversion()
@@ -131,6 +146,31 @@ static void test_case_conversion()
     assert(strstr_nocase_utf8(hi_utf8, "OOoo") == nullptr);
 }
 
+static void test_utf8_validation()
+{
+    static const char * valid[] = {
+        "", "ASCII only, longer than one word", "AÄaäEÊeêIÌiìOÕoõUÚuú",
+        "桜の花びら", "Группа крови", "\xf0\x9f\x8e\xb5 music \xf4\x8f\xbf\xbf"};
+
+    static const char * invalid[] = {
+        "\x8e\x8d\x82\xcc\x89\xd4",   /* Shift-JIS */
+        "\xd4\xc2\xc1\xc1\xb4\xfa",   /* GBK */
+        "\xc3\xf0\xf3\xef\xef\xe0",   /* CP1251 */
+        "overlong \xc0\xaf", "overlong \xe0\x80\xaf",
+        "surrogate \xed\xa0\x80", "too large \xf4\x90\x80\x80",
+        "truncated at the end \xe6\xa1", "stray continuation \x80 byte"};
+
+    for (const char * str : valid)
+        assert(str_is_utf8(str) && str_is_utf8(str, strlen(str)));
+    for (const char * str : invalid)
+        assert(!str_is_utf8(str) && !str_is_utf8(str, strlen(str)));
+
+    /* a null byte within the given length is not valid */
+    assert(str_is_utf8("12345678\0abc", 8));
+    assert(!str_is_utf8("12345678\0abc", 12));
+    assert(!str_is_utf8("1234\0abc", 8));
+}
+
 static void test_numeric_conversion()
 {
     static const char * in[] = {
@@ -541,6 +581,30 @@ static void test_stringbuf()
     assert(!strcmp(str1, expect));
 }
 
+static void test_stringbuf_growth()
+{
+    StringBufStats stats0 = aud_get_stringbuf_stats();
+
+    {
+        StringBuf small = str_copy("small");
+        StringBuf big(3 * 1048576);
+        memset(big, 'x', big.len());
+
+        /* larger than the first stack segment */
+        StringBufStats stats = aud_get_stringbuf_stats();
+        assert(stats.overflows > stats0.overflows);
+        assert(stats.segments > 1);
+        assert(stats.high_water >= big.len());
+
+        StringBuf after = str_printf("%s-%d", (const char *)small, big.len());
+        assert(!strcmp(after, "small-3145728"));
+        assert(big[big.len() - 1] == 'x' && !big[big.len()]);
+    }
+
+    /* extra segments are released again */
+    assert(aud_get_stringbuf_stats().segments == 1);
+}
+
 static void test_str_printf()
 {
     StringBuf problem = str_printf("%d", 6);
@@ -557,6 +621,764 @@ static void test_str_printf()
     assert(!strcmp(problem, "6 * 7 = 42"));
 }
 
+struct TestNode : public MultiHash::Node
+{
+    int key;
+    bool match(const int * data) const { return *data == key; }
+};
+
+struct TestOp
+{
+    bool remove;
+
+    TestNode * add(const int * data)
+    {
+        if (remove)
+            return nullptr;
+
+        auto node = new TestNode;
+        node->key = *data;
+        return node;
+    }
+
+    bool found(TestNode * node)
+    {
+        if (remove)
+            delete node;
+        return remove;
+    }
+};
+
+static void test_multihash()
+{
+    MultiHash_T<TestNode, int> table(4);
+
+    /* enough nodes to trigger several incremental resizes */
+    for (int i = 0; i < 20000; i++)
+    {
+        TestOp op = {false};
+        assert(table.lookup(&i, int32_hash(i), op) == MultiHash::Added);
+    }
+
+    HashStats stats = table.get_stats();
+    assert(stats.channels == 4);
+    assert(stats.items == 20000);
+    assert(stats.load_factor() > 0.25f && stats.load_factor() <= 1.0f);
+
+    for (int i = 0; i < 20000; i += 2)
+    {
+        TestOp op = {true};
+        assert(table.lookup(&i, int32_hash(i), op) ==
+               (MultiHash::Found | MultiHash::Removed));
+    }
+
+    int count = 0;
+    table.iterate_by_channel([&](TestNode * node) {
+        assert(node->key % 2);
+        count++;
+        return false;
+    });
+
+    assert(count == 10000);
+
+    for (int i = 0; i < 20000; i++)
+    {
+        TestOp op = {false};
+        table.lookup(&i, int32_hash(i), op);
+    }
+
+    assert(table.get_stats().items == 20000);
+    table.clear();
+    assert(table.get_stats().items == 0);
+}
+
+static String last_log_message;
+
+static void log_handler(audlog::Level level, const char * file, int line,
+                        const char * func, const char * message)
+{
+    last_log_message = String(message);
+}
+
+static void test_async_log()
+{
+    const char text[] = "abcdef";
+
+    audlog::subscribe(log_handler, audlog::Debug);
+    audlog::set_async(true);
+
+    AUDDBG("%d %5.2f %.*s %s %c%%%lu\n", -42, 3.14159, 3, text,
+           (const char *)nullptr, 'x', 7ul);
+    audlog::flush();
+
+    assert(!strcmp(last_log_message, "-42  3.14 abc (null) x%7\n"));
+
+    audlog::set_async(false);
+    audlog::unsubscribe(log_handler);
+
+    assert(audlog::get_dropped_count() == 0);
+    last_log_message = String();
+}
+
+static void test_trace()
+{
+    StringBuf path = filename_build({g_get_tmp_dir(), "audacious-test-trace"});
+
+    audtrace::enable(path);
+    assert(audtrace::enabled());
+
+    {
+        audtrace::Span outer("outer");
+        audtrace::Span inner("inner", "a \"quoted\" detail");
+    }
+
+    audtrace::write();
+    assert(!audtrace::enabled());
+
+    FILE * handle = fopen(path, "r");
+    assert(handle);
+
+    char buf[4096];
+    size_t len = fread(buf, 1, sizeof buf - 1, handle);
+    buf[len] = 0;
+
+    fclose(handle);
+    remove(path);
+
+    const char * outer = strstr(buf, "\"name\":\"outer\"");
+    const char * inner = strstr(buf, "\"name\":\"inner\"");
+
+    /* parent span first, child one level deeper */
+    assert(outer && inner && outer < inner);
+    assert(strstr(outer, "\"depth\":0"));
+    assert(strstr(inner, "\"depth\":1,\"detail\":\"a \\\"quoted\\\""));
+}
+
+static void test_loudness()
+{
+    /* EBU Tech 3341: a 997 Hz sine at -20 dBFS in both channels of a stereo
+     * signal measures -20 LUFS */
+    constexpr int rate = 48000, seconds = 5;
+    Index<float> data;
+    data.resize(2 * rate * seconds);
+
+    for (int i = 0; i < rate * seconds; i++)
+        data[2 * i] = data[2 * i + 1] = 0.1 * sin(2 * M_PI * 997 * i / rate);
+
+    LoudnessMeter meter(2, rate);
+    meter.process(data.begin(), rate * seconds);
+
+    assert(fabs(LoudnessMeter::integrate(meter.blocks()) + 20) < 0.1);
+
+    /* a quarter-rate sine sampled between its peaks: the sample peak is -3 dB,
+     * the true peak 0 dB */
+    LoudnessMeter meter2(1, rate);
+
+    for (int i = 0; i < rate; i++)
+        data[i] = sin(M_PI / 2 * i + M_PI / 4);
+
+    meter2.process(data.begin(), rate);
+    assert(meter2.peak() > 0.98 && meter2.peak() < 1.02);
+
+    /* silence does not pass the gate */
+    LoudnessMeter meter3(6, 44100);
+    data.clear();
+    data.insert(0, 6 * 44100);
+
+    /* ten 100 ms steps make seven overlapping blocks */
+    meter3.process(data.begin(), 44100);
+    assert(meter3.blocks().len() == 7);
+    assert(isinf(LoudnessMeter::integrate(meter3.blocks())));
+}
+
+/* resamples one second of a sine, in pieces of <chunk> frames */
+static void resample_sine(Resampler & resampler, double freq, int chunk,
+                          Index<float> & out)
+{
+    int channels = resampler.channels();
+    int rate = resampler.in_rate();
+
+    Index<float> data, part;
+    data.resize(channels * rate);
+
+    for (int i = 0; i < rate; i++)
+    {
+        for (int c = 0; c < channels; c++)
+            data[channels * i + c] = 0.5 * sin(2 * M_PI * freq * i / rate);
+    }
+
+    out.clear();
+
+    for (int i = 0; i < rate; i += chunk)
+    {
+        resampler.process(&data[channels * i], aud::min(chunk, rate - i),
+                          part);
+        out.insert(part.begin(), -1, part.len());
+    }
+
+    assert(resampler.pending() > 0);
+    resampler.finish(part);
+    out.insert(part.begin(), -1, part.len());
+    assert(resampler.pending() == 0);
+}
+
+static void test_resampler()
+{
+    Index<float> out;
+
+    /* 44.1 to 48 kHz (160 exact phases): the output is complete and in phase
+     * with the input, apart from the edges where the sine starts and stops */
+    Resampler up(2, 44100, 48000, ResampleQuality::High);
+    resample_sine(up, 1000, 1000, out);
+    assert(out.len() == 2 * 48000);
+
+    for (int i = 480; i < 48000 - 480; i++)
+    {
+        float ref = 0.5 * sin(2 * M_PI * 1000 * i / 48000);
+        assert(fabsf(out[2 * i] - ref) < 1e-4);
+        assert(out[2 * i + 1] == out[2 * i]);
+    }
+
+    /* 96 to 44.1 kHz: a tone above the new Nyquist frequency is removed */
+    Resampler down(1, 96000, 44100, ResampleQuality::High);
+    resample_sine(down, 30000, 4096, out);
+    assert(out.len() == 44100);
+
+    for (int i = 441; i < 44100 - 441; i++)
+        assert(fabsf(out[i]) < 1e-4);
+
+    /* an odd ratio (interpolated between phases) */
+    Resampler odd(1, 44100, 96001, ResampleQuality::Medium);
+    resample_sine(odd, 5000, 777, out);
+    assert(out.len() == 96001);
+
+    for (int i = 960; i < 96001 - 960; i++)
+    {
+        float ref = 0.5 * sin(2 * M_PI * 5000 * i / 96001);
+        assert(fabsf(out[i] - ref) < 1e-3);
+    }
+}
+
+/* throughput of each quality level, for common conversions of stereo audio */
+static void benchmark_resampler()
+{
+    static const char * const names[] = {"Low", "Medium", "High", "Best"};
+    static const int rates[][2] = {{44100, 48000}, {96000, 48000}};
+    constexpr int seconds = 20;
+
+    for (auto & rate : rates)
+    {
+        Index<float> data, out;
+        data.resize(2 * rate[0] * seconds);
+
+        for (int i = 0; i < data.len(); i++)
+            data[i] = sin(0.01 * i);
+
+        for (int q = 0; q < Resampler::n_qualities; q++)
+        {
+            Resampler resampler(2, rate[0], rate[1], (ResampleQuality)q);
+            int64_t start = g_get_monotonic_time();
+
+            /* pieces of 50 ms, as written by a typical decoder */
+            int chunk = rate[0] / 20;
+            for (int i = 0; i < rate[0] * seconds; i += chunk)
+                resampler.process(&data[2 * i], chunk, out);
+
+            int64_t time = g_get_monotonic_time() - start;
+
+            printf("%d to %d Hz, %s quality: %.0fx realtime\n", rate[0],
+                   rate[1], names[q],
+                   seconds * 1e6 / aud::max(time, (int64_t)1));
+        }
+    }
+}
+
+/* conversion of ID3v1-sized tag strings, as for a collection tagged in one
+ * legacy charset: half of the strings are in that charset and half are ASCII
+ * or UTF-8 (which need no conversion).  The legacy strings are recognized by
+ * libguess for the given region, or converted from a fallback charset. */
+static void benchmark_charsets()
+{
+    static const struct
+    {
+        const char * region, * fallback, * charset, * text;
+    } cases[] = {{"japanese", "", "SHIFT_JIS", "椎名林檎 - 歌舞伎町の女王"},
+                 {"chinese", "", "GBK", "周杰伦 - 七里香"},
+                 {"russian", "", "CP1251", "Кино - Группа крови"},
+                 {"", "CP1251", "CP1251", "Кино - Группа крови"}};
+
+    static const char * const plain[] = {"Pink Floyd - Time",
+                                         "Sigur Rós - Hoppípolla"};
+
+    constexpr int n_strings = 4000;
+    constexpr int passes = 25;
+
+    Index<String> ascii, utf8;
+    for (int i = 0; i < n_strings / 2; i++)
+    {
+        (i % 2 ? utf8 : ascii)
+            .append(String(str_printf("%s %d", plain[i % 2], i % 100)));
+    }
+
+    chardet_init();
+
+    for (auto & c : cases)
+    {
+        aud_set_str("chardet_detector", c.region);
+        aud_set_str("chardet_fallback", c.fallback);
+
+        Index<String> corpus, expected;
+        for (int i = 0; i < n_strings; i++)
+        {
+            if (i % 2)
+            {
+                const String & text = (i % 4 == 1) ? ascii[i / 4] : utf8[i / 4];
+                corpus.append(text);
+                expected.append(text);
+            }
+            else
+            {
+                StringBuf text = str_printf("%s %d", c.text, i % 100);
+                StringBuf legacy = str_convert(text, -1, "UTF-8", c.charset);
+                corpus.append(String(legacy));
+                expected.append(String(text));
+            }
+        }
+
+        /* the first pass opens the converters and checks the results */
+        for (int i = 0; i < n_strings; i++)
+        {
+            StringBuf converted = str_to_utf8(corpus[i], strlen(corpus[i]));
+            assert(converted && !strcmp(converted, expected[i]));
+        }
+
+        int64_t start = g_get_monotonic_time();
+
+        for (int p = 0; p < passes; p++)
+        {
+            for (const String & str : corpus)
+                str_to_utf8(str, strlen(str));
+        }
+
+        int64_t time = g_get_monotonic_time() - start;
+
+        printf("str_to_utf8(), %s %s: %.2f us per string\n", c.charset,
+               c.region[0] ? c.region : "fallback",
+               (double)time / (passes * n_strings));
+    }
+
+    chardet_cleanup();
+    aud_set_str("chardet_detector", "");
+    aud_set_str("chardet_fallback", "");
+
+    for (auto list : {&ascii, &utf8})
+    {
+        constexpr int reps = 2000;
+        int valid = 0;
+
+        int64_t start = g_get_monotonic_time();
+        for (int r = 0; r < reps; r++)
+        {
+            for (const String & str : *list)
+                valid += str_is_utf8(str, strlen(str));
+        }
+
+        int64_t ours = g_get_monotonic_time() - start;
+
+        start = g_get_monotonic_time();
+        for (int r = 0; r < reps; r++)
+        {
+            for (const String & str : *list)
+                valid += g_utf8_validate(str, strlen(str), nullptr);
+        }
+
+        int64_t glib = g_get_monotonic_time() - start;
+
+        assert(valid == 2 * reps * list->len());
+
+        double n = (double)reps * list->len() / 1000;
+        printf("str_is_utf8(), %s strings: %.1f ns per string "
+               "(g_utf8_validate(): %.1f ns)\n",
+               list == &ascii ? "ASCII" : "UTF-8", ours / n, glib / n);
+    }
+}
+
+/* a synthetic set of input plugins, each with a few file extensions, some of
+ * which are shared with other plugins; the handles are only compared */
+struct SyntheticPlugins
+{
+    static constexpr int n_plugins = 40;
+    static constexpr int n_exts = 8;
+
+    char handles[n_plugins];
+    Index<String> keys[n_plugins];
+    Index<String> queries; /* every extension, in mixed case, and some misses */
+
+    PluginHandle * handle(int i) { return (PluginHandle *)&handles[i]; }
+
+    SyntheticPlugins()
+    {
+        for (int i = 0; i < n_plugins; i++)
+        {
+            for (int j = 0; j < n_exts; j++)
+            {
+                int ext = (i * 5 + j * 3) % 150;
+                keys[i].append(String(str_printf("ex%d", ext)));
+            }
+
+            /* a duplicate key, as some plugins have */
+            keys[i].append(keys[i][0]);
+        }
+
+        for (int e = 0; e < 150; e++)
+            queries.append(String(str_printf(e % 2 ? "EX%d" : "ex%d", e)));
+        for (int e = 0; e < 50; e++)
+            queries.append(String(str_printf("none%d", e)));
+    }
+
+    Index<PluginHandle *> lookup_linear(const char * key)
+    {
+        Index<PluginHandle *> matches;
+        for (int i = 0; i < n_plugins; i++)
+        {
+            if (PluginKeyIndex::has_key(keys[i], key))
+                matches.append(handle(i));
+        }
+
+        return matches;
+    }
+};
+
+static void test_plugin_keys()
+{
+    SyntheticPlugins plugins;
+    PluginKeyIndex index;
+
+    for (int i = 0; i < plugins.n_plugins; i++)
+        index.add(plugins.handle(i), plugins.keys[i]);
+
+    int found = 0;
+    for (const String & query : plugins.queries)
+    {
+        auto linear = plugins.lookup_linear(query);
+        auto indexed = index.lookup(query);
+
+        /* the same plugins, in the same (priority) order */
+        assert(indexed.len() == linear.len());
+        for (int i = 0; i < linear.len(); i++)
+            assert(indexed[i] == linear[i]);
+
+        found += linear.len();
+    }
+
+    assert(found == plugins.n_plugins * plugins.n_exts);
+
+    index.clear();
+    assert(!index.lookup("ex0").len());
+}
+
+/* probing 300000 files by extension, with and without the index */
+static void benchmark_plugin_keys()
+{
+    constexpr int n_lookups = 300000;
+
+    SyntheticPlugins plugins;
+    PluginKeyIndex index;
+
+    for (int i = 0; i < plugins.n_plugins; i++)
+        index.add(plugins.handle(i), plugins.keys[i]);
+
+    int64_t start = g_get_monotonic_time();
+    int linear_matches = 0;
+
+    for (int n = 0; n < n_lookups; n++)
+        linear_matches +=
+            plugins.lookup_linear(plugins.queries[n % plugins.queries.len()])
+                .len();
+
+    int64_t linear_time = g_get_monotonic_time() - start;
+
+    start = g_get_monotonic_time();
+    int index_matches = 0;
+
+    for (int n = 0; n < n_lookups; n++)
+        index_matches +=
+            index.lookup(plugins.queries[n % plugins.queries.len()]).len();
+
+    int64_t index_time = g_get_monotonic_time() - start;
+
+    assert(index_matches == linear_matches);
+
+    printf("input plugin keys, %d plugins: linear scan %.0f ms, index %.0f ms "
+           "(%d matches)\n",
+           plugins.n_plugins, linear_time / 1000.0, index_time / 1000.0,
+           index_matches);
+}
+
+struct DoublingGrowth
+{
+    static int64_t next_size(int64_t size, int64_t needed)
+    {
+        return aud::max(size * 2, needed);
+    }
+};
+
+/* a binary registry with one transport and two input plugins */
+static Index<char> make_bin_registry(const BinStamp & stamp, int bad_ref = -1)
+{
+    static const char * const names[] = {"neon", "ffaudio", "vorbis"};
+    BinWriter writer;
+
+    for (int i = 0; i < 3; i++)
+    {
+        BinPlugin & bin = writer.plugins.append();
+        bin.path = writer.add_string(str_printf("/plugins/%s.so", names[i]));
+        bin.name = writer.add_string(str_printf("Name %d", i));
+        bin.type = (int)(i ? PluginType::Input : PluginType::Transport);
+        bin.enabled = (int)PluginEnabled::Primary;
+
+        Index<String> exts;
+        if (i)
+            exts.append(String("ogg"));
+
+        bin.lists[ListKeys + (int)InputKey::Ext] = writer.add_strings(exts);
+    }
+
+    BinKey & key = writer.keys[InputKey::Ext].append();
+    key.key = writer.add_string("ogg");
+    key.plugins = {(uint32_t)writer.refs.len(), 2};
+    writer.refs.append(1);
+    writer.refs.append(bad_ref >= 0 ? bad_ref : 2);
+
+    return writer.finish("en_US:en", stamp);
+}
+
+static void test_plugin_registry_bin()
+{
+    const BinStamp stamp = {12, 1700000000, 4096};
+    Index<char> data = make_bin_registry(stamp);
+
+    BinReader reader(data.begin(), data.len());
+    assert(reader.check(stamp));
+    assert(reader.header().n_plugins == 3);
+    assert(!strcmp(reader.raw_string(reader.header().locale), "en_US:en"));
+    assert(reader.get_string(reader.plugin(2).name) == String("Name 2"));
+    StringBuf basename =
+        plugin_path_basename(reader.raw_string(reader.plugin(1).path));
+    assert(!strcmp(basename, "ffaudio"));
+
+    Index<String> exts;
+    reader.get_strings(reader.plugin(1).lists[ListKeys + (int)InputKey::Ext],
+                       exts);
+    assert(exts.len() == 1 && exts[0] == String("ogg"));
+
+    const BinKey & key = reader.key(InputKey::Ext, 0);
+    assert(key.plugins.count == 2 && reader.ref(key.plugins.first + 1) == 2);
+
+    /* the text registry was rewritten, replaced, or removed since */
+    auto check = [&](const BinStamp & text) {
+        return BinReader(data.begin(), data.len()).check(text);
+    };
+
+    assert(!check({13, stamp.mtime, stamp.size}));
+    assert(!check({12, stamp.mtime + 1, stamp.size}));
+    assert(!check({12, stamp.mtime, stamp.size - 1}));
+    assert(!check({12, -1, -1}));
+
+    /* truncated files */
+    assert(!BinReader(data.begin(), 0).check(stamp));
+    assert(!BinReader(data.begin(), sizeof(BinHeader) - 1).check(stamp));
+    assert(!BinReader(data.begin(), data.len() - 1).check(stamp));
+
+    /* damaged header or contents */
+    Index<char> copy;
+    copy.insert(data.begin(), 0, data.len());
+    copy[0] = 'X';
+    assert(!BinReader(copy.begin(), copy.len()).check(stamp));
+
+    copy[0] = data[0];
+    ((BinHeader *)copy.begin())->bin_format++;
+    assert(!BinReader(copy.begin(), copy.len()).check(stamp));
+
+    ((BinHeader *)copy.begin())->bin_format--;
+    copy[data.len() - 2] ^= 1;
+    assert(!BinReader(copy.begin(), copy.len()).check(stamp));
+
+    copy[data.len() - 2] ^= 1;
+    assert(BinReader(copy.begin(), copy.len()).check(stamp));
+
+    /* consistent checksum, but a key refers to a missing or non-input plugin */
+    for (int bad_ref : {0, 3, 1000})
+    {
+        Index<char> bad = make_bin_registry(stamp, bad_ref);
+        assert(!BinReader(bad.begin(), bad.len()).check(stamp));
+    }
+}
+
+static void config_set_hook(void * data, void * user)
+{
+    auto changed = (const Index<String> *)data;
+    auto events = (Index<String> *)user;
+
+    /* one entry per event, listing the changed names */
+    events->append(String(index_to_str_list(*changed, ",")));
+}
+
+static void config_set_one_hook(void *, void * user) { (*(int *)user)++; }
+
+static void test_config()
+{
+    char * dir = g_dir_make_tmp("audacious-test-XXXXXX", nullptr);
+    assert(dir);
+    user_dir = String(dir);
+
+    config_load();
+    assert(aud_get_int("tag_padding") == 16384);
+    assert(aud_get_bool("use_qt") && !aud_get_bool("repeat"));
+
+    Index<String> events;
+    int single_events = 0;
+    hook_associate("set", config_set_hook, &events);
+    hook_associate("set step_size", config_set_one_hook, &single_events);
+
+    /* "repeat" is unchanged (and the default) */
+    const char * const batch[] = {"step_size", "7", "repeat", "FALSE",
+                                  "test_str", "two words", nullptr};
+    aud_set_strs(nullptr, batch);
+
+    assert(events.len() == 1 && events[0] == String("step_size,test_str"));
+    assert(!single_events);
+    assert(aud_get_int("step_size") == 7 && aud_get_double("step_size") == 7);
+    assert(aud_get_str("test_str") == String("two words"));
+
+    /* nothing changed, or not in the main section: no event */
+    aud_set_strs(nullptr, batch);
+    const char * const other[] = {"step_size", "8", nullptr};
+    aud_set_strs("test", other);
+    assert(events.len() == 1 && aud_get_int("test", "step_size") == 8);
+
+    /* a single value still gets its own event */
+    aud_set_int("step_size", 9);
+    assert(events.len() == 1 && single_events == 1);
+
+    hook_dissociate("set", config_set_hook);
+    hook_dissociate("set step_size", config_set_one_hook);
+
+    /* queue two snapshots; config_cleanup() waits for the newest one */
+    for (int i = 0; i < 500; i++)
+        aud_set_int("test", str_printf("key%03d", i), i);
+
+    config_save();
+
+    for (int i = 0; i < 500; i++)
+        aud_set_int("test", str_printf("key%03d", i), i * 2);
+
+    aud_set_double("test", "double", 2.5);
+    aud_set_bool("test", "bool", true);
+
+    config_save();
+    config_cleanup();
+
+    assert(!aud_get_int("step_size") && !aud_get_int("test", "key001"));
+
+    StringBuf path = filename_build({dir, "config"});
+    StringBuf temp = str_concat({path, ".tmp"});
+    assert(g_file_test(path, G_FILE_TEST_EXISTS));
+    assert(!g_file_test(temp, G_FILE_TEST_EXISTS));
+
+    /* everything is read back from the file */
+    config_load();
+
+    for (int i = 0; i < 500; i++)
+        assert(aud_get_int("test", str_printf("key%03d", i)) == i * 2);
+
+    assert(aud_get_double("test", "double") == 2.5);
+    assert(aud_get_bool("test", "bool"));
+    assert(aud_get_int("test", "step_size") == 8);
+    assert(aud_get_int("step_size") == 9);
+    assert(aud_get_str("test_str") == String("two words"));
+    assert(aud_get_int("tag_padding") == 16384);
+
+    config_cleanup();
+
+    g_unlink(path);
+    g_rmdir(dir);
+    g_free(dir);
+    user_dir = String();
+}
+
+static void dummy_hook(void *, void * user) { (*(int *)user)++; }
+
+static void test_small_index()
+{
+    size_t allocs = misc_allocations;
+
+    SmallIndex<int, 4> list;
+    for (int i = 0; i < 4; i++)
+        list.append(i);
+
+    assert(list.is_inline() && list.len() == 4);
+    assert(misc_allocations == allocs);
+
+    list.append(4);
+    assert(!list.is_inline() && list.len() == 5);
+    assert(misc_allocations == allocs + 1);
+
+    SmallIndex<int, 4> moved(std::move(list));
+    assert(!list.len() && list.is_inline());
+    assert(moved.len() == 5 && moved[4] == 4);
+
+    moved.remove_if([](int x) { return x % 2; });
+    assert(moved.len() == 3 && moved[1] == 2);
+
+    list = std::move(moved);
+    assert(list.len() == 3 && list[2] == 4 && !moved.len());
+
+    SmallIndex<int, 2, DoublingGrowth> doubled;
+    for (int i = 0; i < 64; i++)
+        doubled.append(i);
+
+    assert(doubled.capacity() == 64 && doubled[63] == 63);
+
+    /* workloads that previously caused repeated reallocation */
+    allocs = misc_allocations;
+
+    {
+        Tuple tuple;
+        tuple.set_filename("file:///folder/file.ogg");
+        tuple.set_str(Tuple::Title, "Title");
+        tuple.set_str(Tuple::Artist, "Artist");
+        tuple.set_str(Tuple::Album, "Album");
+        tuple.set_str(Tuple::Genre, "Genre");
+        tuple.set_int(Tuple::Year, 2000);
+        tuple.set_int(Tuple::Track, 1);
+        tuple.set_int(Tuple::Length, 180000);
+        tuple.set_int(Tuple::Bitrate, 192);
+
+        Tuple copy = tuple.ref();
+        copy.set_str(Tuple::Comment, "Comment");
+        assert(copy.get_int(Tuple::Year) == 2000);
+    }
+
+    size_t tuple_allocs = misc_allocations - allocs;
+    allocs = misc_allocations;
+
+    int calls = 0;
+    for (int i = 0; i < 3; i++)
+        hook_associate("test hook", dummy_hook, &calls);
+
+    hook_call("test hook", nullptr);
+    hook_dissociate("test hook", dummy_hook);
+    assert(calls == 3);
+
+    size_t hook_allocs = misc_allocations - allocs;
+
+    AUDDBG("Index allocations: tuple %d, hook %d\n", (int)tuple_allocs,
+           (int)hook_allocs);
+
+    assert(!tuple_allocs && !hook_allocs);
+}
+
 static void test_uri_construct()
 {
     StringBuf result;
@@ -594,14 +1416,33 @@ int main(int argc, const char ** argv)
     if (argc >= 2 && !strcmp(argv[1], "--qt"))
         use_qt = true;
 
+    if (argc >= 2 && !strcmp(argv[1], "--bench"))
+    {
+        benchmark_resampler();
+        benchmark_charsets();
+        benchmark_plugin_keys();
+        return 0;
+    }
+
     test_audio_conversion();
     test_case_conversion();
+    test_utf8_validation();
     test_numeric_conversion();
     test_filename_split();
     test_tuple_formats();
     test_ringbuf();
+    test_small_index();
+    test_multihash();
     test_stringbuf();
+    test_stringbuf_growth();
     test_str_printf();
+    test_async_log();
+    test_trace();
+    test_loudness();
+    test_resampler();
+    test_plugin_keys();
+    test_plugin_registry_bin();
+    test_config();
     test_uri_construct();
 
     test_mainloop();
@@ -25,6 +25,7 @@ namespace aud
 
 EXPORT void spinlock::lock() { tiny_lock(&m_lock); }
 EXPORT void spinlock::unlock() { tiny_unlock(&m_lock); }
+EXPORT bool spinlock::try_lock() { return tiny_trylock(&m_lock); }
 
 EXPORT void spinlock_rw::lock_r() { tiny_lock_read(&m_lock); }
 EXPORT void spinlock_rw::unlock_r() { tiny_unlock_read(&m_lock); }
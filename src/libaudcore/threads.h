@@ -43,6 +43,9 @@ public:
     void lock();
     void unlock();
 
+    /* Takes the lock only if it is free; returns true if it was taken */
+    bool try_lock();
+
     /* Scope-based lock ownership */
     typedef owner<spinlock, &spinlock::lock, &spinlock::unlock> holder;
 
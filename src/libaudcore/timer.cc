@@ -24,6 +24,22 @@
 #include "runtime.h"
 #include "threads.h"
 
+#include <atomic>
+#include <chrono>
+
+/*
+ * All timer rates share a single main loop source, which ticks at the interval
+ * of the fastest rate currently in use and is stopped entirely while no timers
+ * are registered.  Each rate is a slot with its own deadline; on every tick,
+ * the slots that have come due are run.
+ *
+ * The callback list of each rate is copy-on-write: timer_add() and
+ * timer_remove() build a new list under the mutex and publish it atomically,
+ * so the dispatcher never takes the mutex.  Replaced lists are freed by the
+ * dispatcher itself at the start of the next tick, when it is known not to be
+ * using them.
+ */
+
 static const aud::array<TimerRate, int> rate_to_ms = {1000, 250, 100, 33};
 
 struct TimerItem
@@ -32,11 +48,10 @@ struct TimerItem
     void * data;
 };
 
-struct TimerList
+struct TimerSnapshot
 {
-    QueuedFunc source;
     Index<TimerItem> items;
-    int use_count = 0;
+    TimerSnapshot * next_garbage = nullptr;
 
     bool contains(TimerFunc func, void * data) const
     {
@@ -48,48 +63,167 @@ struct TimerList
 
         return false;
     }
+};
+
+struct TimerList
+{
+    std::atomic<TimerSnapshot *> current{nullptr};
+    int64_t next_due = 0; /* used only by the dispatcher */
+};
+
+static aud::mutex mutex;
+static aud::array<TimerRate, TimerList> lists;
+static QueuedFunc source;
+static int source_interval; /* protected by mutex */
+
+static std::atomic<TimerSnapshot *> garbage{nullptr};
+
+static std::atomic<int64_t> wakeup_count{0};
+static std::atomic<int64_t> window_start{0};
+static std::atomic<int64_t> window_count{0};
+static std::atomic<float> wakeup_rate{0};
+
+static constexpr int64_t RateWindow = 5000; /* milliseconds */
+
+static int64_t now_ms()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch())
+        .count();
+}
 
-    void check_stop()
+static void free_garbage()
+{
+    TimerSnapshot * snap = garbage.exchange(nullptr);
+
+    while (snap)
     {
-        if (!use_count)
-        {
-            auto is_empty = [](const TimerItem & item) { return !item.func; };
+        TimerSnapshot * next = snap->next_garbage;
+        delete snap;
+        snap = next;
+    }
+}
 
-            items.remove_if(is_empty, true);
+static void count_wakeup(int64_t now)
+{
+    wakeup_count++;
+    window_count++;
 
-            if (!items.len() && source.running())
-                source.stop();
-        }
+    int64_t elapsed = now - window_start.load();
+    if (elapsed >= RateWindow)
+    {
+        wakeup_rate.store(window_count.exchange(0) * 1000.0f / elapsed);
+        window_start.store(now);
     }
+}
 
-    void run();
-};
+/* Runs the callbacks of one rate.  A callback may add or remove timers
+ * (including ones later in the same list), so if the list has been replaced,
+ * items that are no longer registered are skipped. */
+static void run_list(TimerList & list)
+{
+    TimerSnapshot * snap = list.current.load(std::memory_order_acquire);
+    if (!snap)
+        return;
 
-static aud::mutex mutex;
-static aud::array<TimerRate, TimerList> lists;
+    for (const TimerItem & item : snap->items)
+    {
+        TimerSnapshot * now = list.current.load(std::memory_order_acquire);
+        if (now != snap && !(now && now->contains(item.func, item.data)))
+            continue;
+
+        item.func(item.data);
+    }
+}
 
-void TimerList::run()
+static void run_timers()
 {
-    auto mh = mutex.take();
+    free_garbage();
 
-    use_count++;
+    int64_t now = now_ms();
+    count_wakeup(now);
 
-    /* note: the list may grow (but not shrink) during the call */
-    for (int i = 0; i < items.len(); i++)
+    int tick = 0;
+
+    /* fastest rate first; its interval is the tick interval */
+    for (int r = (int)TimerRate::count - 1; r >= 0; r--)
     {
-        /* copy locally to prevent race condition */
-        TimerItem item = items[i];
+        auto rate = (TimerRate)r;
+        TimerList & list = lists[rate];
 
-        if (item.func)
+        if (!list.current.load(std::memory_order_acquire))
         {
-            mh.unlock();
-            item.func(item.data);
-            mh.lock();
+            list.next_due = 0;
+            continue;
         }
+
+        int interval = rate_to_ms[rate];
+
+        if (!tick)
+            tick = interval;
+        /* newly registered; the source has already waited one tick */
+        if (!list.next_due)
+            list.next_due = now + interval - tick;
+
+        /* allow for the tick landing a little early */
+        if (now < list.next_due - tick / 2)
+            continue;
+
+        list.next_due += interval;
+        if (list.next_due <= now)
+            list.next_due = now + interval;
+
+        run_list(list);
+    }
+}
+
+/* starts, retunes or stops the shared source; called with the mutex held */
+static void update_source()
+{
+    int interval = 0;
+
+    for (int r = 0; r < (int)TimerRate::count; r++)
+    {
+        auto rate = (TimerRate)r;
+        if (lists[rate].current.load())
+            interval = rate_to_ms[rate]; /* rates are in increasing order */
+    }
+
+    if (!interval)
+    {
+        if (source.running())
+            source.stop();
+
+        source_interval = 0;
+    }
+    else if (interval != source_interval || !source.running())
+    {
+        source.start(interval, run_timers);
+        source_interval = interval;
+    }
+}
+
+/* replaces the callback list of <list>; called with the mutex held */
+static void publish(TimerList & list, Index<TimerItem> && items)
+{
+    TimerSnapshot * snap = nullptr;
+
+    if (items.len())
+    {
+        snap = new TimerSnapshot;
+        snap->items = std::move(items);
+    }
+
+    TimerSnapshot * old = list.current.exchange(snap);
+
+    if (old)
+    {
+        old->next_garbage = garbage.load();
+        while (!garbage.compare_exchange_weak(old->next_garbage, old))
+            ;
     }
 
-    use_count--;
-    check_stop();
+    update_source();
 }
 
 EXPORT void timer_add(TimerRate rate, TimerFunc func, void * data)
@@ -97,13 +231,16 @@ EXPORT void timer_add(TimerRate rate, TimerFunc func, void * data)
     auto & list = lists[rate];
     auto mh = mutex.take();
 
-    if (!list.contains(func, data))
-    {
-        list.items.append(func, data);
+    TimerSnapshot * snap = list.current.load();
+    if (snap && snap->contains(func, data))
+        return;
 
-        if (!list.source.running())
-            list.source.start(rate_to_ms[rate], [&list]() { list.run(); });
-    }
+    Index<TimerItem> items;
+    if (snap)
+        items.insert(snap->items.begin(), 0, snap->items.len());
+
+    items.append(func, data);
+    publish(list, std::move(items));
 }
 
 EXPORT void timer_remove(TimerRate rate, TimerFunc func, void * data)
@@ -111,13 +248,27 @@ EXPORT void timer_remove(TimerRate rate, TimerFunc func, void * data)
     auto & list = lists[rate];
     auto mh = mutex.take();
 
-    for (TimerItem & item : list.items)
+    TimerSnapshot * snap = list.current.load();
+    if (!snap)
+        return;
+
+    Index<TimerItem> items;
+
+    for (const TimerItem & item : snap->items)
     {
-        if (item.func == func && (!data || item.data == data))
-            item.func = nullptr;
+        if (!(item.func == func && (!data || item.data == data)))
+            items.append(item);
     }
 
-    list.check_stop();
+    if (items.len() < snap->items.len())
+        publish(list, std::move(items));
+}
+
+EXPORT int64_t timer_get_wakeups() { return wakeup_count.load(); }
+
+EXPORT float timer_get_wakeup_rate()
+{
+    return source.running() ? wakeup_rate.load() : 0;
 }
 
 void timer_cleanup()
@@ -126,8 +277,14 @@ void timer_cleanup()
 
     int timers_running = 0;
     for (TimerList & list : lists)
-        timers_running += list.items.len();
+    {
+        TimerSnapshot * snap = list.current.load();
+        if (snap)
+            timers_running += snap->items.len();
+    }
 
     if (timers_running)
         AUDWARN("%d timers still registered at exit\n", timers_running);
+
+    free_garbage();
 }
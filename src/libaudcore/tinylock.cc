@@ -32,6 +32,11 @@ EXPORT void tiny_lock(TinyLock * lock)
 
 EXPORT void tiny_unlock(TinyLock * lock) { __sync_lock_release(lock); }
 
+EXPORT bool tiny_trylock(TinyLock * lock)
+{
+    return !__sync_lock_test_and_set(lock, 1);
+}
+
 EXPORT void tiny_lock_read(TinyRWLock * lock)
 {
     while (__builtin_expect(__sync_fetch_and_add(lock, 1) & WRITE_BIT, 0))
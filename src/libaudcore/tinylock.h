@@ -33,6 +33,7 @@ typedef char TinyLock;
 
 void tiny_lock(TinyLock * lock);
 void tiny_unlock(TinyLock * lock);
+bool tiny_trylock(TinyLock * lock);
 
 typedef unsigned short TinyRWLock;
 
@@ -0,0 +1,241 @@
+/*
+ * trace.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "runtime.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include <glib.h> /* for g_get_user_cache_dir */
+#include <glib/gstdio.h>
+
+#include "audstrings.h"
+#include "index.h"
+#include "threads.h"
+
+namespace audtrace
+{
+
+struct ThreadState
+{
+    int tid;
+    int depth;
+};
+
+struct Event
+{
+    const char * name;
+    String detail;
+    int64_t start, end;
+    int tid, depth;
+};
+
+static std::atomic<bool> trace_enabled(false);
+static int64_t origin;
+static String trace_file;
+
+static aud::mutex mutex;
+static Index<Event> events;
+static int next_tid = 1;
+
+static pthread_key_t key;
+static std::once_flag once;
+
+static int64_t get_timestamp()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void free_state(void * state) { delete (ThreadState *)state; }
+static void make_key() { pthread_key_create(&key, free_state); }
+
+/* threads are numbered in the order in which they first record a span, so
+ * that the main thread is normally thread 1 */
+static ThreadState * get_state()
+{
+    std::call_once(once, make_key);
+
+    auto state = (ThreadState *)pthread_getspecific(key);
+
+    if (!state)
+    {
+        auto mh = mutex.take();
+        state = new ThreadState{next_tid++, 0};
+        mh.unlock();
+
+        pthread_setspecific(key, state);
+    }
+
+    return state;
+}
+
+static void record(const char * name, const char * detail, int64_t start,
+                   int64_t end, int tid, int depth)
+{
+    auto mh = mutex.take();
+
+    if (trace_enabled.load(std::memory_order_relaxed))
+        events.append(name, String(detail), start, end, tid, depth);
+}
+
+EXPORT void enable(const char * filename)
+{
+    auto mh = mutex.take();
+
+    if (trace_enabled.load(std::memory_order_relaxed))
+        return;
+
+    origin = get_timestamp();
+    trace_file = String(filename);
+    trace_enabled.store(true, std::memory_order_release);
+}
+
+EXPORT bool enabled()
+{
+    return trace_enabled.load(std::memory_order_acquire);
+}
+
+EXPORT int64_t now() { return get_timestamp() - origin; }
+
+EXPORT int64_t begin()
+{
+    if (!enabled())
+        return -1;
+
+    get_state()->depth++;
+    return now();
+}
+
+EXPORT void end(const char * name, const char * detail, int64_t start)
+{
+    int64_t stop = now();
+    ThreadState * state = get_state();
+
+    state->depth--;
+    record(name, detail, start, stop, state->tid, state->depth);
+}
+
+EXPORT void add(const char * name, const char * detail, int64_t start,
+                int64_t end)
+{
+    if (!enabled())
+        return;
+
+    ThreadState * state = get_state();
+    record(name, detail, start, end, state->tid, state->depth);
+}
+
+static void write_escaped(FILE * handle, const char * str)
+{
+    for (; *str; str++)
+    {
+        if (*str == '"' || *str == '\\')
+            fprintf(handle, "\\%c", *str);
+        else if ((unsigned char)*str < 0x20)
+            fprintf(handle, "\\u%04x", (unsigned char)*str);
+        else
+            fputc(*str, handle);
+    }
+}
+
+static void write_event(FILE * handle, const Event & event)
+{
+    fputs(",\n{\"name\":\"", handle);
+    write_escaped(handle, event.name);
+    fprintf(handle,
+            "\",\"cat\":\"audacious\",\"ph\":\"X\",\"ts\":%" PRId64
+            ",\"dur\":%" PRId64 ",\"pid\":1,\"tid\":%d,\"args\":{\"depth\":%d",
+            event.start, event.end - event.start, event.tid, event.depth);
+
+    if (event.detail)
+    {
+        fputs(",\"detail\":\"", handle);
+        write_escaped(handle, event.detail);
+        fputc('"', handle);
+    }
+
+    fputs("}}", handle);
+}
+
+EXPORT void write()
+{
+    auto mh = mutex.take();
+
+    if (!trace_enabled.load(std::memory_order_relaxed))
+        return;
+
+    trace_enabled.store(false, std::memory_order_release);
+
+    auto list = std::move(events);
+    String filename = std::move(trace_file);
+
+    mh.unlock();
+
+    StringBuf path;
+    if (filename)
+        path = str_copy(filename);
+    else
+    {
+        StringBuf dir = filename_build({g_get_user_cache_dir(), "audacious"});
+        g_mkdir_with_parents(dir, 0700);
+        path = filename_build({dir, "trace.json"});
+    }
+
+    /* Chrome expects nested spans on the same thread in start order */
+    list.sort([](const Event & a, const Event & b) {
+        if (a.start != b.start)
+            return (a.start > b.start) - (a.start < b.start);
+        return a.depth - b.depth;
+    });
+
+    FILE * handle = g_fopen(path, "w");
+    if (!handle)
+    {
+        AUDERR("Error writing %s: %s\n", (const char *)path, strerror(errno));
+        return;
+    }
+
+    fputs("{\"traceEvents\":[", handle);
+
+    fputs("\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+          "\"args\":{\"name\":\"main\"}}",
+          handle);
+
+    for (const Event & event : list)
+        write_event(handle, event);
+
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", handle);
+
+    if (fclose(handle) < 0)
+        AUDERR("Error writing %s: %s\n", (const char *)path, strerror(errno));
+    else
+        AUDINFO("Wrote %d trace events to %s.\n", list.len(),
+                (const char *)path);
+}
+
+} // namespace audtrace
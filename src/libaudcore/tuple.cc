@@ -24,7 +24,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include <glib.h> /* for g_utf8_validate */
+#include <glib.h> /* for g_ascii_isalpha */
 
 #include "audio.h"
 #include "audstrings.h"
@@ -59,8 +59,10 @@ union TupleVal {
  */
 struct TupleData
 {
-    uint64_t setmask;     // which fields are present
-    Index<TupleVal> vals; // ordered list of field values
+    uint64_t setmask; // which fields are present
+
+    // ordered list of field values, stored inline for a typical tuple
+    SmallIndex<TupleVal, 16> vals;
 
     short * subtunes; /**< Array of int containing subtune index numbers.
                            Can be nullptr if indexing is linear or if
@@ -501,7 +503,7 @@ EXPORT void Tuple::set_str(Field field, const char * str)
 
     data = TupleData::copy_on_write(data);
 
-    if (g_utf8_validate(str, -1, nullptr))
+    if (str_is_utf8(str))
         data->set_str(field, str);
     else
     {
@@ -60,19 +60,11 @@ static TransportPlugin * lookup_transport(const char * filename, String & error,
         }
     }
 
-    if (custom_input)
+    if (custom_input &&
+        input_plugin_lookup_key(InputKey::Scheme, scheme).len())
     {
-        for (PluginHandle * plugin : aud_plugin_list(PluginType::Input))
-        {
-            if (!aud_plugin_get_enabled(plugin))
-                continue;
-
-            if (input_plugin_has_key(plugin, InputKey::Scheme, scheme))
-            {
-                *custom_input = true;
-                return nullptr;
-            }
-        }
+        *custom_input = true;
+        return nullptr;
     }
 
     AUDERR("Unknown URI scheme: %s://\n", (const char *)scheme);
@@ -275,12 +267,24 @@ EXPORT String VFSFile::get_metadata(const char * field)
 EXPORT void VFSFile::set_limit_to_buffer(bool limit)
 {
     auto buffer = dynamic_cast<ProbeBuffer *>(m_impl.get());
+
     if (buffer)
         buffer->set_limit_to_buffer(limit);
     else
         AUDERR("<%p> buffering not supported!\n", m_impl.get());
 }
 
+EXPORT void VFSFile::set_access_hint(VFSAccessHint hint)
+{
+    local_file_set_access_hint(m_impl.get(), hint);
+}
+
+EXPORT int64_t VFSFile::bytes_read()
+{
+    auto buffer = dynamic_cast<ProbeBuffer *>(m_impl.get());
+    return buffer ? buffer->bytes_read() : -1;
+}
+
 EXPORT Index<char> VFSFile::read_all()
 {
     constexpr int maxbuf = 256 * 1024 * 1024;
@@ -392,6 +396,41 @@ EXPORT Index<String> VFSFile::read_folder(const char * filename, String & error)
     return tp ? tp->read_folder(filename, error) : Index<String>();
 }
 
+EXPORT Index<VFSFolderEntry>
+VFSFile::read_folder_entries(const char * filename, String & error,
+                             bool get_stat)
+{
+    auto tp = lookup_transport(filename, error);
+    if (!tp)
+        return Index<VFSFolderEntry>();
+
+    /* plugins built against older API versions lack the virtual function */
+    if (tp->version < 49)
+        return tp->TransportPlugin::read_folder_entries(filename, error,
+                                                        get_stat);
+
+    return tp->read_folder_entries(filename, error, get_stat);
+}
+
+EXPORT Index<VFSFolderEntry>
+TransportPlugin::read_folder_entries(const char * filename, String & error,
+                                     bool get_stat)
+{
+    Index<VFSFolderEntry> entries;
+
+    for (String & name : read_folder(filename, error))
+    {
+        String test_error; /* discarded */
+        VFSFileTest type = test_file(
+            name, VFSFileTest(VFS_IS_REGULAR | VFS_IS_DIR | VFS_IS_SYMLINK),
+            test_error);
+
+        entries.append(std::move(name), type, (int64_t)-1, (int64_t)-1);
+    }
+
+    return entries;
+}
+
 EXPORT Index<char> VFSFile::read_file(const char * filename,
                                       VFSReadOptions options)
 {
@@ -43,12 +43,46 @@ enum VFSFileTest
     VFS_NO_ACCESS = (1 << 5)
 };
 
+/* a folder entry as returned by VFSFile::read_folder_entries() */
+struct VFSFolderEntry
+{
+    String filename;  /* full URI */
+    VFSFileTest type; /* VFS_IS_REGULAR, VFS_IS_DIR, and/or VFS_IS_SYMLINK
+                       * (symlinks also have the type of their target);
+                       * zero if the type could not be determined */
+    int64_t size;     /* size in bytes, or -1 if not requested/unknown */
+    int64_t mtime;    /* modification time (seconds since the epoch), or -1
+                       * if not requested/unknown */
+};
+
+/* statistics of the read-ahead cache for upcoming tracks */
+struct VFSPrefetchStats
+{
+    int64_t hits;             /* prefetched files found in the cache */
+    int64_t misses;           /* prefetched files not (yet) in the cache */
+    int64_t bytes_prefetched; /* total bytes read ahead so far */
+    int64_t bytes_cached;     /* bytes currently held in the cache */
+    int files_cached;
+
+    float hit_rate() const
+    {
+        return (hits + misses) ? (float)hits / (hits + misses) : 0;
+    }
+};
+
 enum VFSReadOptions
 {
     VFS_APPEND_NULL = (1 << 0),
     VFS_IGNORE_MISSING = (1 << 1)
 };
 
+enum VFSAccessHint
+{
+    VFS_ACCESS_NORMAL,
+    VFS_ACCESS_SEQUENTIAL, /* e.g. decoding */
+    VFS_ACCESS_RANDOM      /* e.g. reading tags */
+};
+
 enum VFSSeekType
 {
     VFS_SEEK_SET = 0,
@@ -158,6 +192,14 @@ public:
      * buffered region (useful for probing the file type) */
     void set_limit_to_buffer(bool limit);
 
+    /* tells the VFS layer how the file is going to be read; currently this
+     * only has an effect on local files */
+    void set_access_hint(VFSAccessHint hint);
+
+    /* returns the number of bytes read so far from a file opened in read-only
+     * mode (counting re-reads of the buffered region), or -1 if unknown */
+    int64_t bytes_read();
+
     /* utility functions */
 
     /* reads the entire file into memory (limited to 256 MiB) */
@@ -180,6 +222,14 @@ public:
     /* returns a sorted list of folder entries (as full URIs) */
     static Index<String> read_folder(const char * filename, String & error);
 
+    /* like read_folder(), but also returns the type of each entry and
+     * optionally its size and modification time.  this is much faster than
+     * calling test_file() on each entry, since for local folders the type is
+     * usually known without an extra stat() call. */
+    static Index<VFSFolderEntry> read_folder_entries(const char * filename,
+                                                     String & error,
+                                                     bool get_stat = false);
+
     /* convenience functions to read/write entire files */
     static Index<char> read_file(const char * filename, VFSReadOptions options);
     static bool write_file(const char * filename, const void * data,
@@ -188,6 +238,11 @@ public:
     /* returns a list of supported URI schemes */
     static Index<const char *> supported_uri_schemes();
 
+    /* returns statistics of the read-ahead cache for upcoming tracks
+     * (configured by "prefetch_tracks", "prefetch_size", and
+     * "prefetch_cache_size", the last two in megabytes) */
+    static VFSPrefetchStats prefetch_stats();
+
 private:
     String m_filename, m_error;
     SmartPtr<VFSImpl> m_impl;
@@ -17,68 +17,213 @@
  * the use of this software.
  */
 
+/* Asynchronous file reads are served by a small, fixed pool of worker threads
+ * rather than a thread per request, since UIs may request hundreds of images
+ * or lyrics files at once.  Requests for the same URI are merged while one is
+ * pending, higher priorities are read first, and finished reads are handed to
+ * the main loop in batches (all reads completed since the last wakeup are
+ * delivered in one go). */
+
 #include "vfs_async.h"
+
+#include <chrono>
+
+#include "internal.h"
 #include "list.h"
 #include "mainloop.h"
+#include "multihash.h"
 #include "threads.h"
 #include "vfs.h"
 
+static constexpr int n_workers = 4;
+
+struct Consumer
+{
+    int handle;
+    VFSConsumer2 cons_f;
+};
+
 struct QueuedData : public ListNode
 {
     const String filename;
-    const VFSConsumer2 cons_f;
+    VFSPriority priority;
+    Index<Consumer> consumers;
 
-    std::thread thread;
+    bool started = false; /* taken by a worker */
+    int64_t queue_time; /* microseconds */
     Index<char> buf;
 
-    QueuedData(const char * filename, VFSConsumer2 cons_f)
-        : filename(filename), cons_f(cons_f)
+    QueuedData(const String & filename, VFSPriority priority,
+               int64_t queue_time)
+        : filename(filename), priority(priority), queue_time(queue_time)
     {
     }
 };
 
-static QueuedFunc queued_func;
-static List<QueuedData> queue;
 static aud::mutex mutex;
+static aud::condvar cond;
+static std::thread workers[n_workers];
+static bool workers_running, quit;
+
+static QueuedFunc queued_func;
+static aud::array<VFSPriority, List<QueuedData>> pending;
+static List<QueuedData> finished;
+
+/* all requests not yet delivered, for merging duplicates */
+static SimpleHash<String, QueuedData *> requests;
+
+static int last_handle;
+static int n_pending, peak_pending, n_reading;
+static int64_t n_completed, n_merged, n_canceled;
+static int64_t total_latency, max_latency; /* microseconds */
+
+static int64_t get_timestamp()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static QueuedData * take_pending()
+{
+    /* highest priority first */
+    for (int p = (int)VFSPriority::count; p--;)
+    {
+        QueuedData * data = pending[(VFSPriority)p].pop_head();
+        if (data)
+        {
+            n_pending--;
+            return data;
+        }
+    }
+
+    return nullptr;
+}
 
 static void send_data()
 {
     auto mh = mutex.take();
+    int64_t now = get_timestamp();
 
     QueuedData * data;
-    while ((data = queue.head()))
+    while ((data = finished.pop_head()))
     {
-        queue.remove(data);
+        /* consumers may have been canceled while the file was read */
+        if (data->consumers.len())
+        {
+            int64_t latency = now - data->queue_time;
+            n_completed++;
+            total_latency += latency;
+            max_latency = aud::max(max_latency, latency);
+        }
 
-        mh.unlock();
+        /* take the consumers one at a time, so that one can still cancel
+         * another, and the request stays findable by vfs_async_cancel() until
+         * all of them are called */
+        while (data->consumers.len())
+        {
+            Consumer consumer = std::move(data->consumers[0]);
+            data->consumers.remove(0, 1);
+
+            mh.unlock();
+            consumer.cons_f(data->filename, data->buf);
+            mh.lock();
+        }
 
-        data->thread.join();
-        data->cons_f(data->filename, data->buf);
+        requests.remove(data->filename);
         delete data;
+    }
+}
+
+static void read_worker()
+{
+    auto mh = mutex.take();
+
+    while (!quit)
+    {
+        QueuedData * data = take_pending();
+        if (!data)
+        {
+            cond.wait(mh);
+            continue;
+        }
+
+        data->started = true;
+        n_reading++;
+
+        mh.unlock();
+
+        VFSFile file(data->filename, "r");
+        if (file)
+            data->buf = file.read_all();
 
         mh.lock();
+
+        n_reading--;
+
+        if (!finished.head())
+            queued_func.queue(send_data);
+
+        finished.append(data);
     }
 }
 
-static void read_worker(QueuedData * data)
+EXPORT int vfs_async_file_get_contents(const char * filename,
+                                       VFSConsumer2 cons_f,
+                                       VFSPriority priority)
 {
-    VFSFile file(data->filename, "r");
-    if (file)
-        data->buf = file.read_all();
-
     auto mh = mutex.take();
 
-    if (!queue.head())
-        queued_func.queue(send_data);
+    if (quit)
+        return 0;
+
+    String key(filename);
+    int handle = ++last_handle;
+
+    QueuedData ** found = requests.lookup(key);
+    QueuedData * data = found ? *found : nullptr;
+
+    if (data)
+    {
+        n_merged++;
+
+        /* move a waiting request up if it is now wanted sooner */
+        if (!data->started && priority > data->priority)
+        {
+            pending[data->priority].remove(data);
+            data->priority = priority;
+            pending[priority].append(data);
+        }
+    }
+    else
+    {
+        data = *requests.add(key,
+                             new QueuedData(key, priority, get_timestamp()));
+
+        pending[priority].append(data);
+        n_pending++;
+        peak_pending = aud::max(peak_pending, n_pending);
+
+        if (!workers_running)
+        {
+            for (std::thread & thread : workers)
+                thread = std::thread(read_worker);
 
-    queue.append(data);
+            workers_running = true;
+        }
+
+        cond.notify_one();
+    }
+
+    data->consumers.append(Consumer{handle, std::move(cons_f)});
+    return handle;
 }
 
 EXPORT void vfs_async_file_get_contents(const char * filename,
                                         VFSConsumer2 cons_f)
 {
-    auto data = new QueuedData(filename, cons_f);
-    data->thread = std::thread(read_worker, data);
+    vfs_async_file_get_contents(filename, std::move(cons_f),
+                                VFSPriority::Normal);
 }
 
 EXPORT void vfs_async_file_get_contents(const char * filename,
@@ -87,3 +232,83 @@ EXPORT void vfs_async_file_get_contents(const char * filename,
     using namespace std::placeholders;
     vfs_async_file_get_contents(filename, std::bind(cons_f, _1, _2, user));
 }
+
+EXPORT void vfs_async_cancel(int handle)
+{
+    auto mh = mutex.take();
+
+    QueuedData * owner = nullptr;
+    requests.iterate([&](const String &, QueuedData *& data) {
+        for (int i = 0; i < data->consumers.len(); i++)
+        {
+            if (data->consumers[i].handle == handle)
+            {
+                data->consumers.remove(i, 1);
+                owner = data;
+                return;
+            }
+        }
+    });
+
+    if (!owner)
+        return;
+
+    n_canceled++;
+
+    /* a request that is already being read is dropped once finished */
+    if (!owner->consumers.len() && !owner->started)
+    {
+        pending[owner->priority].remove(owner);
+        n_pending--;
+
+        requests.remove(owner->filename);
+        delete owner;
+    }
+}
+
+EXPORT VFSAsyncStats vfs_async_get_stats()
+{
+    auto mh = mutex.take();
+
+    VFSAsyncStats stats;
+    stats.queued = n_pending;
+    stats.peak_queued = peak_pending;
+    stats.reading = n_reading;
+    stats.completed = n_completed;
+    stats.merged = n_merged;
+    stats.canceled = n_canceled;
+    stats.avg_latency_ms =
+        n_completed ? total_latency / (1000.0f * n_completed) : 0;
+    stats.max_latency_ms = max_latency / 1000.0f;
+
+    return stats;
+}
+
+void vfs_async_cleanup()
+{
+    auto mh = mutex.take();
+
+    quit = true;
+    cond.notify_all();
+
+    if (workers_running)
+    {
+        mh.unlock();
+
+        for (std::thread & thread : workers)
+            thread.join();
+
+        mh.lock();
+        workers_running = false;
+    }
+
+    /* undelivered results are discarded */
+    queued_func.stop();
+
+    for (auto & list : pending)
+        list.clear();
+
+    finished.clear();
+    requests.clear();
+    n_pending = 0;
+}
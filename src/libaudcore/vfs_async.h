@@ -21,6 +21,7 @@
 #define LIBAUDCORE_VFS_ASYNC_H
 
 #include <functional>
+#include <stdint.h>
 #include <libaudcore/index.h>
 
 typedef std::function<void(const char * filename, const Index<char> & buf)>
@@ -29,8 +30,39 @@ typedef std::function<void(const char * filename, const Index<char> & buf)>
 typedef void (*VFSConsumer)(const char * filename, const Index<char> & buf,
                             void * user);
 
+enum class VFSPriority
+{
+    Low,
+    Normal,
+    High,
+    count
+};
+
+struct VFSAsyncStats
+{
+    int queued;           /* requests waiting for a worker thread */
+    int peak_queued;      /* highest number of waiting requests so far */
+    int reading;          /* requests being read right now */
+    int64_t completed;    /* requests delivered to at least one consumer */
+    int64_t merged;       /* requests merged with one for the same file */
+    int64_t canceled;     /* consumers removed by vfs_async_cancel() */
+    float avg_latency_ms; /* from request to delivery */
+    float max_latency_ms;
+};
+
+/* Reads a file in a background thread and passes the contents to cons_f in
+ * the main thread.  Concurrent requests for the same file are read only once.
+ * Returns a handle for vfs_async_cancel() (0 if the request was refused). */
+int vfs_async_file_get_contents(const char * filename, VFSConsumer2 cons_f,
+                                VFSPriority priority);
 void vfs_async_file_get_contents(const char * filename, VFSConsumer2 cons_f);
 
+/* Ensures that the consumer of the given request is not called (must be
+ * called from the main thread, possibly from another consumer). */
+void vfs_async_cancel(int handle);
+
+VFSAsyncStats vfs_async_get_stats();
+
 void vfs_async_file_get_contents(const char * filename, VFSConsumer cons_f,
                                  void * user) __attribute__((deprecated));
 
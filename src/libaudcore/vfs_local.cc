@@ -18,9 +18,15 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+
 #include <glib/gstdio.h>
 
 /* needs to be after system headers for #undef's to take effect */
@@ -29,6 +35,8 @@
 
 #include "audstrings.h"
 #include "i18n.h"
+#include "internal.h"
+#include "probe-buffer.h"
 #include "runtime.h"
 
 #ifdef _WIN32
@@ -56,6 +64,8 @@ public:
 
     ~LocalFile();
 
+    void set_access_hint(VFSAccessHint hint);
+
 protected:
     int64_t fread(void * ptr, int64_t size, int64_t nmemb);
     int fseek(int64_t offset, VFSSeekType whence);
@@ -76,6 +86,41 @@ private:
     LocalOp m_last_op;
 };
 
+/* Read-only local file whose beginning was read into memory ahead of time (see
+ * vfs_prefetch.cc).  Reads within the prefetched data are served from memory;
+ * the real file is only seeked and read beyond it. */
+class PrefetchedFile : public VFSImpl
+{
+public:
+    PrefetchedFile(LocalFile * file, Index<char> && head)
+        : m_file(file), m_head(std::move(head))
+    {
+    }
+
+    LocalFile * file() { return m_file.get(); }
+
+protected:
+    int64_t fread(void * ptr, int64_t size, int64_t nmemb);
+    int fseek(int64_t offset, VFSSeekType whence);
+
+    int64_t ftell() { return m_pos; }
+    int64_t fsize() { return real()->fsize(); }
+    bool feof() { return m_eof; }
+
+    int64_t fwrite(const void * ptr, int64_t size, int64_t nmemb) { return 0; }
+    int ftruncate(int64_t length) { return -1; }
+    int fflush() { return 0; }
+
+private:
+    VFSImpl * real() { return m_file.get(); }
+
+    SmartPtr<LocalFile> m_file;
+    Index<char> m_head;
+    int64_t m_pos = 0;
+    int64_t m_file_pos = 0; /* real position of m_file, or -1 if unknown */
+    bool m_eof = false;
+};
+
 VFSImpl * LocalTransport::fopen(const char * uri, const char * mode,
                                 String & error)
 {
@@ -123,7 +168,14 @@ VFSImpl * LocalTransport::fopen(const char * uri, const char * mode,
         }
     }
 
-    return new LocalFile(path, stream);
+    bool read_only = (mode[0] == 'r' && !strchr(mode, '+'));
+    auto file = new LocalFile(path, stream);
+
+    Index<char> head;
+    if (read_only && vfs_prefetch_take(path, head))
+        return new PrefetchedFile(file, std::move(head));
+
+    return file;
 }
 
 VFSImpl * StdinTransport::fopen(const char * uri, const char * mode,
@@ -411,3 +463,212 @@ Index<String> LocalTransport::read_folder(const char * uri, String & error)
 
     return entries;
 }
+
+#ifndef _WIN32
+static int mode_to_type(mode_t mode)
+{
+    return S_ISREG(mode) ? VFS_IS_REGULAR : S_ISDIR(mode) ? VFS_IS_DIR : 0;
+}
+#endif
+
+Index<VFSFolderEntry> LocalTransport::read_folder_entries(const char * uri,
+                                                          String & error,
+                                                          bool get_stat)
+{
+#ifdef _WIN32
+    return TransportPlugin::read_folder_entries(uri, error, get_stat);
+#else
+    Index<VFSFolderEntry> entries;
+
+    StringBuf path = uri_to_filename(uri);
+    if (!path)
+    {
+        error = String(_("Invalid file name"));
+        return entries;
+    }
+
+    DIR * folder = opendir(path);
+    if (!folder)
+    {
+        error = String(strerror(errno));
+        return entries;
+    }
+
+    /* build the folder URI once and append each (encoded) name to it */
+    StringBuf folder_uri = filename_to_uri(path);
+    if (folder_uri[folder_uri.len() - 1] != '/')
+        folder_uri.insert(-1, "/");
+
+    /* convert names from locale as in filename_to_uri() */
+    bool from_locale = !g_get_charset(nullptr);
+    int fd = dirfd(folder);
+
+    struct dirent * entry;
+    while ((entry = readdir(folder)))
+    {
+        const char * name = entry->d_name;
+
+        // skip hidden files (may need revisiting)
+        if (name[0] == '.')
+            continue;
+
+        struct stat st;
+        bool have_stat = false;
+        int type = 0;
+
+        switch (entry->d_type)
+        {
+        case DT_REG:
+            type = VFS_IS_REGULAR;
+            break;
+        case DT_DIR:
+            type = VFS_IS_DIR;
+            break;
+        case DT_LNK:
+            type = VFS_IS_SYMLINK;
+            break;
+        case DT_UNKNOWN:
+            /* not all filesystems report the type */
+            if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+            {
+                if (S_ISLNK(st.st_mode))
+                    type = VFS_IS_SYMLINK;
+                else
+                {
+                    type = mode_to_type(st.st_mode);
+                    have_stat = true;
+                }
+            }
+            break;
+        }
+
+        /* symlinks also get the type of their target */
+        if ((type & VFS_IS_SYMLINK) || (get_stat && !have_stat))
+        {
+            if (fstatat(fd, name, &st, 0) == 0)
+            {
+                type |= mode_to_type(st.st_mode);
+                have_stat = true;
+            }
+        }
+
+        int64_t size = -1, mtime = -1;
+        if (get_stat && have_stat)
+        {
+            size = st.st_size;
+            mtime = st.st_mtime;
+        }
+
+        StringBuf utf8;
+        if (from_locale && !g_utf8_validate(name, -1, nullptr))
+            utf8 = str_from_locale(name);
+
+        StringBuf entry_uri =
+            str_concat({folder_uri, str_encode_percent(utf8 ? utf8 : name)});
+
+        entries.append(String(entry_uri), VFSFileTest(type), size, mtime);
+    }
+
+    closedir(folder);
+
+    return entries;
+#endif
+}
+
+void LocalFile::set_access_hint(VFSAccessHint hint)
+{
+#ifdef POSIX_FADV_NORMAL
+    int advice = (hint == VFS_ACCESS_SEQUENTIAL) ? POSIX_FADV_SEQUENTIAL
+                 : (hint == VFS_ACCESS_RANDOM)   ? POSIX_FADV_RANDOM
+                                                 : POSIX_FADV_NORMAL;
+
+    if (m_stream != stdin)
+        posix_fadvise(fileno(m_stream), 0, 0, advice);
+#endif
+}
+
+int64_t PrefetchedFile::fread(void * ptr, int64_t size, int64_t nmemb)
+{
+    if (size <= 0 || nmemb <= 0)
+        return 0;
+
+    int64_t want = size * nmemb;
+    int64_t done = 0;
+
+    if (m_pos < m_head.len())
+    {
+        done = aud::min(want, m_head.len() - m_pos);
+        memcpy(ptr, &m_head[m_pos], done);
+        m_pos += done;
+    }
+
+    if (done < want)
+    {
+        if (m_file_pos != m_pos && real()->fseek(m_pos, VFS_SEEK_SET) < 0)
+            m_file_pos = -1;
+        else
+        {
+            int64_t got = real()->fread((char *)ptr + done, 1, want - done);
+            done += got;
+            m_pos += got;
+            m_file_pos = m_pos;
+        }
+    }
+
+    /* like stdio, set EOF on a short read */
+    if (done < want)
+        m_eof = true;
+
+    return done / size;
+}
+
+int PrefetchedFile::fseek(int64_t offset, VFSSeekType whence)
+{
+    int64_t pos;
+
+    switch (whence)
+    {
+    case VFS_SEEK_SET:
+        pos = offset;
+        break;
+    case VFS_SEEK_CUR:
+        pos = m_pos + offset;
+        break;
+    case VFS_SEEK_END:
+        if (fsize() < 0)
+            return -1;
+        pos = fsize() + offset;
+        break;
+    default:
+        return -1;
+    }
+
+    if (pos < 0)
+        return -1;
+
+    /* the real file is seeked only when it is next read */
+    m_pos = pos;
+    m_eof = false;
+    return 0;
+}
+
+/* the LocalFile underneath any buffering, or nullptr */
+static LocalFile * get_local_file(VFSImpl * impl)
+{
+    auto buffer = dynamic_cast<ProbeBuffer *>(impl);
+    if (buffer)
+        impl = buffer->file();
+
+    auto prefetched = dynamic_cast<PrefetchedFile *>(impl);
+    if (prefetched)
+        return prefetched->file();
+
+    return dynamic_cast<LocalFile *>(impl);
+}
+
+void local_file_set_access_hint(VFSImpl * impl, VFSAccessHint hint)
+{
+    LocalFile * file = get_local_file(impl);
+    if (file)
+        file->set_access_hint(hint);
+}
@@ -31,6 +31,8 @@ public:
     VFSFileTest test_file(const char * filename, VFSFileTest test,
                           String & error);
     Index<String> read_folder(const char * filename, String & error);
+    Index<VFSFolderEntry> read_folder_entries(const char * filename,
+                                              String & error, bool get_stat);
 };
 
 class StdinTransport : public TransportPlugin
@@ -41,6 +43,10 @@ public:
     VFSImpl * fopen(const char * filename, const char * mode, String & error);
 };
 
+/* For a file opened by LocalTransport (possibly buffered), passes the access
+ * pattern on to the system. */
+void local_file_set_access_hint(VFSImpl * impl, VFSAccessHint hint);
+
 VFSImpl * vfs_tmpfile(String & error);
 
 #endif /* LIBAUDCORE_VFS_LOCAL_H */
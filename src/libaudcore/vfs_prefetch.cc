@@ -0,0 +1,334 @@
+/*
+ * vfs_prefetch.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Read-ahead for the tracks that are going to be played next.  A small pool of
+ * worker threads reads the beginning of each upcoming local file into memory,
+ * so that the decoder does not have to wait for the disk (or network share) at
+ * the start of the track.  The data is kept in a cache bounded by
+ * "prefetch_cache_size" and handed out to LocalTransport when the file is
+ * actually opened, so reads are served from memory without any change to the
+ * input plugins.  The data is copied rather than mapped, so a file that is
+ * truncated meanwhile cannot fault the process.
+ *
+ * Each file needs only one sequential read, and only a few files are read
+ * ahead at a time, so the time is spent waiting for the disk or network share
+ * rather than in system calls.  Blocking reads on a couple of threads keep
+ * those few reads in flight just as well as io_uring would, without a
+ * Linux-only dependency. */
+
+#include "internal.h"
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <thread>
+
+#include <glib/gstdio.h>
+
+#include "audstrings.h"
+#include "multihash.h"
+#include "runtime.h"
+#include "threads.h"
+#include "vfs.h"
+
+static constexpr int n_workers = 2;
+
+struct CachedFile
+{
+    Index<char> head;    // prefetched bytes (counted against the limit)
+    int64_t size, mtime; // to detect changes to the file
+    int64_t rank;        // higher for files needed sooner
+};
+
+static aud::mutex mutex;
+static aud::condvar cond;
+static std::thread workers[n_workers];
+static bool workers_running, quit;
+
+static Index<String> pending;     // local paths waiting to be prefetched
+static Index<String> in_progress; // local paths being prefetched right now
+static Index<String> requested;   // all paths from the latest request
+static SimpleHash<String, CachedFile> cache;
+
+static int64_t size_limit, cache_limit;
+static int64_t cache_bytes, request_serial;
+static int64_t hits, misses, bytes_prefetched;
+
+static bool get_file_info(const char * path, int64_t & size, int64_t & mtime)
+{
+    struct stat st;
+    if (stat(path, &st) < 0 || !S_ISREG(st.st_mode))
+        return false;
+
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+/* files earlier in the latest request rank highest; files no longer
+ * requested rank lowest */
+static int64_t get_rank(const String & path)
+{
+    int idx = requested.find(path);
+    return (idx < 0) ? 0 : (request_serial << 16) - idx;
+}
+
+static void remove_cached(const String & path)
+{
+    cache_bytes -= cache.lookup(path)->head.len();
+    cache.remove(path);
+}
+
+/* drops files that are no longer upcoming, and then the lowest-ranked files
+ * until the cache fits its limit */
+static void trim_cache()
+{
+    Index<String> stale;
+    cache.iterate([&](const String & path, CachedFile & cached) {
+        if (!cached.rank)
+            stale.append(path);
+    });
+
+    for (const String & path : stale)
+        remove_cached(path);
+
+    while (cache_bytes > cache_limit)
+    {
+        const String * lowest = nullptr;
+        int64_t lowest_rank = 0;
+
+        cache.iterate([&](const String & path, CachedFile & cached) {
+            if (!lowest || cached.rank < lowest_rank)
+            {
+                lowest = &path;
+                lowest_rank = cached.rank;
+            }
+        });
+
+        if (!lowest)
+            break;
+
+        remove_cached(String(*lowest));
+    }
+}
+
+/* reads up to <len> bytes at the start of a file */
+static bool read_head(const char * path, int64_t len, Index<char> & head)
+{
+    FILE * stream = g_fopen(path, "rb");
+    if (!stream)
+        return false;
+
+    head.resize(len);
+    head.resize(fread(head.begin(), 1, len, stream));
+    fclose(stream);
+
+    return head.len() > 0;
+}
+
+static void worker()
+{
+    auto mh = mutex.take();
+
+    while (!quit)
+    {
+        if (!pending.len())
+        {
+            cond.wait(mh);
+            continue;
+        }
+
+        String path = std::move(pending[0]);
+        pending.remove(0, 1);
+        in_progress.append(path);
+
+        int64_t limit = size_limit;
+        mh.unlock();
+
+        CachedFile cached{};
+        bool valid = get_file_info(path, cached.size, cached.mtime) &&
+                     read_head(path, aud::min(limit, cached.size), cached.head);
+
+        mh.lock();
+
+        in_progress.remove(in_progress.find(path), 1);
+
+        if (valid && !quit && !cache.lookup(path))
+        {
+            AUDINFO("Prefetched %d bytes of %s\n", cached.head.len(),
+                    (const char *)path);
+
+            cached.rank = get_rank(path);
+            cache_bytes += cached.head.len();
+            bytes_prefetched += cached.head.len();
+            cache.add(path, std::move(cached));
+
+            trim_cache();
+        }
+    }
+}
+
+void vfs_prefetch(const Index<String> & filenames)
+{
+    /* at most 1 GiB per file, to fit in an Index */
+    int64_t new_size_limit = (int64_t)aud::clamp(aud_get_int("prefetch_size"),
+                                                  0, 1024)
+                             << 20;
+    int64_t new_cache_limit = (int64_t)aud_get_int("prefetch_cache_size") << 20;
+
+    auto mh = mutex.take();
+
+    if (quit)
+        return;
+
+    size_limit = aud::max(new_size_limit, (int64_t)0);
+    cache_limit = size_limit ? aud::max(new_cache_limit, (int64_t)0) : 0;
+
+    /* older requests are no longer upcoming */
+    pending.clear();
+    requested.clear();
+    request_serial++;
+
+    if (cache_limit)
+    {
+        /* don't read ahead more files than the cache can hold */
+        int max_files = aud::max(cache_limit / size_limit, (int64_t)1);
+
+        for (const String & filename : filenames)
+        {
+            if (requested.len() >= max_files)
+                break;
+
+            /* only local files are prefetched */
+            StringBuf path = uri_to_filename(strip_subtune(filename));
+            if (!path)
+                continue;
+
+            String key(path);
+            if (requested.find(key) >= 0)
+                continue;
+
+            requested.append(key);
+
+            if (!cache.lookup(key) && in_progress.find(key) < 0)
+                pending.append(key);
+        }
+    }
+
+    cache.iterate([](const String & path, CachedFile & cached) {
+        cached.rank = get_rank(path);
+    });
+
+    trim_cache();
+
+    if (pending.len() && !workers_running)
+    {
+        for (std::thread & thread : workers)
+            thread = std::thread(worker);
+
+        workers_running = true;
+    }
+
+    cond.notify_all();
+}
+
+bool vfs_prefetch_take(const char * path, Index<char> & head)
+{
+    auto mh = mutex.take();
+
+    String key(path);
+    int idx = requested.find(key);
+    if (idx < 0)
+        return false; /* not prefetched, not counted */
+
+    requested.remove(idx, 1);
+
+    CachedFile * cached = cache.lookup(key);
+    if (!cached)
+    {
+        misses++;
+        return false;
+    }
+
+    Index<char> data = std::move(cached->head);
+    int64_t size = cached->size, mtime = cached->mtime;
+
+    cache_bytes -= data.len();
+    cache.remove(key);
+
+    mh.unlock();
+
+    /* discard the data if the file has changed meanwhile */
+    int64_t new_size, new_mtime;
+    bool valid = get_file_info(path, new_size, new_mtime) &&
+                 new_size == size && new_mtime == mtime;
+
+    mh.lock();
+
+    if (!valid)
+    {
+        misses++;
+        return false;
+    }
+
+    hits++;
+    head = std::move(data);
+    return true;
+}
+
+void vfs_prefetch_cleanup()
+{
+    auto mh = mutex.take();
+
+    quit = true;
+    cond.notify_all();
+
+    if (workers_running)
+    {
+        mh.unlock();
+
+        for (std::thread & thread : workers)
+            thread.join();
+
+        mh.lock();
+        workers_running = false;
+    }
+
+    pending.clear();
+    requested.clear();
+    cache.clear();
+    cache_bytes = 0;
+}
+
+EXPORT VFSPrefetchStats VFSFile::prefetch_stats()
+{
+    auto mh = mutex.take();
+
+    VFSPrefetchStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.bytes_prefetched = bytes_prefetched;
+    stats.bytes_cached = cache_bytes;
+    stats.files_cached = 0;
+
+    cache.iterate([&](const String &, CachedFile &) { stats.files_cached++; });
+
+    return stats;
+}
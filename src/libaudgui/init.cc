@@ -368,6 +368,7 @@ EXPORT void audgui_init ()
     aud_config_set_defaults ("audgui", audgui_defaults);
 
     status_init ();
+    audgui_art_thumbnail_init ();
 
     hook_associate ("playlist set playing", playlist_set_playing_cb, nullptr);
     hook_associate ("playlist position", playlist_position_cb, nullptr);
@@ -386,6 +387,7 @@ EXPORT void audgui_cleanup ()
     hook_dissociate ("playlist position", playlist_position_cb);
 
     status_cleanup ();
+    audgui_art_thumbnail_cleanup ();
 
     for (int id = 0; id < AUDGUI_NUM_UNIQUE_WINDOWS; id ++)
         audgui_hide_unique_window (id);
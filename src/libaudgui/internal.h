@@ -47,6 +47,8 @@ void audgui_hide_unique_window (int id);
 
 /* pixbufs.c */
 void audgui_pixbuf_uncache ();
+void audgui_art_thumbnail_init ();
+void audgui_art_thumbnail_cleanup ();
 
 /* plugin-menu.c */
 void plugin_menu_cleanup ();
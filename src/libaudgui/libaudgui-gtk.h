@@ -58,6 +58,9 @@ AudguiPixbuf audgui_pixbuf_fallback ();
 void audgui_pixbuf_scale_within (AudguiPixbuf & pixbuf, int size);
 AudguiPixbuf audgui_pixbuf_request (const char * filename, bool * queued = nullptr);
 AudguiPixbuf audgui_pixbuf_request_current (bool * queued = nullptr);
+/* see aud_art_request_thumbnail() */
+AudguiPixbuf audgui_pixbuf_request_thumbnail (const char * filename, int size,
+ bool * queued = nullptr);
 
 /* plugin-menu.c */
 GtkWidget * audgui_get_plugin_menu (AudMenuID id);
@@ -17,6 +17,7 @@
  * the use of this software.
  */
 
+#include <string.h>
 #include <gdk-pixbuf/gdk-pixbuf.h>
 
 #include <libaudcore/audstrings.h>
@@ -121,3 +122,69 @@ EXPORT AudguiPixbuf audgui_pixbuf_from_data (const void * data, int64_t size)
     g_object_unref (loader);
     return AudguiPixbuf (pixbuf);
 }
+
+/* called from the thumbnail workers in libaudcore; GdkPixbuf (unlike most of
+ * GTK) may be used outside the main thread */
+static AudArtThumbnail scale_thumbnail (const Index<char> & data, int size)
+{
+    AudArtThumbnail thumb;
+
+    AudguiPixbuf pixbuf = audgui_pixbuf_from_data (data.begin (), data.len ());
+    if (! pixbuf)
+        return thumb;
+
+    audgui_pixbuf_scale_within (pixbuf, size);
+
+    if (! gdk_pixbuf_get_has_alpha (pixbuf.get ()))
+        pixbuf.capture (gdk_pixbuf_add_alpha (pixbuf.get (), false, 0, 0, 0));
+
+    if (! pixbuf || gdk_pixbuf_get_bits_per_sample (pixbuf.get ()) != 8 ||
+     gdk_pixbuf_get_n_channels (pixbuf.get ()) != 4)
+        return thumb;
+
+    int row = 4 * pixbuf.width ();
+    int stride = gdk_pixbuf_get_rowstride (pixbuf.get ());
+    const unsigned char * pixels = gdk_pixbuf_get_pixels (pixbuf.get ());
+
+    thumb.width = pixbuf.width ();
+    thumb.height = pixbuf.height ();
+    thumb.pixels.resize (row * thumb.height);
+
+    /* copy line by line, since rows may be padded */
+    for (int y = 0; y < thumb.height; y ++)
+        memcpy (thumb.pixels.begin () + row * y, pixels + stride * y, row);
+
+    return thumb;
+}
+
+void audgui_art_thumbnail_init ()
+{
+    aud_art_set_scale_func (scale_thumbnail);
+}
+
+void audgui_art_thumbnail_cleanup ()
+{
+    aud_art_unset_scale_func (scale_thumbnail);
+}
+
+EXPORT AudguiPixbuf audgui_pixbuf_request_thumbnail (const char * filename,
+ int size, bool * queued)
+{
+    AudArtThumbnail thumb = aud_art_request_thumbnail (filename, size, queued);
+    if (! thumb.pixels.len ())
+        return AudguiPixbuf ();
+
+    GdkPixbuf * pixbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, true, 8,
+     thumb.width, thumb.height);
+    if (! pixbuf)
+        return AudguiPixbuf ();
+
+    int row = 4 * thumb.width;
+    int stride = gdk_pixbuf_get_rowstride (pixbuf);
+    unsigned char * pixels = gdk_pixbuf_get_pixels (pixbuf);
+
+    for (int y = 0; y < thumb.height; y ++)
+        memcpy (pixels + stride * y, thumb.pixels.begin () + row * y, row);
+
+    return AudguiPixbuf (pixbuf);
+}
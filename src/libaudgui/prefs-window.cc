@@ -146,6 +146,22 @@ static const ComboItem record_elements[] = {
     ComboItem (N_("After applying equalization"), (int) OutputStream::AfterEqualizer)
 };
 
+static const ComboItem resample_rate_elements[] = {
+    ComboItem (N_("Same as first song"), 0),
+    ComboItem ("44100", 44100),
+    ComboItem ("48000", 48000),
+    ComboItem ("88200", 88200),
+    ComboItem ("96000", 96000),
+    ComboItem ("192000", 192000)
+};
+
+static const ComboItem resample_quality_elements[] = {
+    ComboItem (N_("Low"), (int) ResampleQuality::Low),
+    ComboItem (N_("Medium"), (int) ResampleQuality::Medium),
+    ComboItem (N_("High"), (int) ResampleQuality::High),
+    ComboItem (N_("Best"), (int) ResampleQuality::Best)
+};
+
 static const ComboItem replaygainmode_elements[] = {
     ComboItem (N_("Track"), (int) ReplayGainMode::Track),
     ComboItem (N_("Album"), (int) ReplayGainMode::Album),
@@ -196,6 +212,7 @@ static void output_combo_changed ();
 static void * output_create_config_button ();
 static void * output_create_about_button ();
 static void output_bit_depth_changed ();
+static void output_resample_changed ();
 
 static const PreferencesWidget output_combo_widgets[] = {
     WidgetCombo (N_("Output plugin:"),
@@ -240,6 +257,16 @@ static const PreferencesWidget audio_page_widgets[] = {
         WidgetBool (0, "soft_clipping")),
     WidgetCheck (N_("Use software volume control (not recommended)"),
         WidgetBool (0, "software_volume_control")),
+    WidgetCheck (N_("Resample to a fixed rate"),
+        WidgetBool (0, "resample_output", output_resample_changed)),
+    WidgetCombo (N_("Rate:"),
+        WidgetInt (0, "resample_rate", output_resample_changed),
+        {{resample_rate_elements}},
+        WIDGET_CHILD),
+    WidgetCombo (N_("Quality:"),
+        WidgetInt (0, "resample_quality", output_resample_changed),
+        {{resample_quality_elements}},
+        WIDGET_CHILD),
     WidgetLabel (N_("<b>Recording Settings</b>")),
     WidgetCustomGTK (record_create_checkbox),
     WidgetBox ({{record_buttons}, true},
@@ -746,6 +773,11 @@ static void output_bit_depth_changed ()
     aud_output_reset (OutputReset::ReopenStream);
 }
 
+static void output_resample_changed ()
+{
+    aud_output_reset (OutputReset::ReopenStream);
+}
+
 static void * output_create_config_button ()
 {
     auto do_config = [] (void *)
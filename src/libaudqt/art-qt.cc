@@ -17,6 +17,8 @@
  * the use of this software.
  */
 
+#include <string.h>
+
 #include <QApplication>
 #include <QIcon>
 #include <QImage>
@@ -28,6 +30,8 @@
 #include <libaudcore/runtime.h>
 #include <libaudqt/libaudqt.h>
 
+#include "libaudqt-internal.h"
+
 namespace audqt
 {
 
@@ -79,4 +83,48 @@ EXPORT QPixmap art_request_current(unsigned int w, unsigned int h,
     return art_request(filename, w, h, want_hidpi);
 }
 
+// called from the thumbnail workers in libaudcore; QImage (unlike QPixmap) may
+// be used outside the main thread
+static AudArtThumbnail scale_thumbnail(const Index<char> & data, int size)
+{
+    AudArtThumbnail thumb;
+
+    auto image = QImage::fromData((const uchar *)data.begin(), data.len());
+    if (image.isNull())
+        return thumb;
+
+    if (image.width() > size || image.height() > size)
+        image = image.scaled(size, size, Qt::KeepAspectRatio,
+                             Qt::SmoothTransformation);
+
+    image = image.convertToFormat(QImage::Format_RGBA8888);
+
+    int row = 4 * image.width();
+    thumb.width = image.width();
+    thumb.height = image.height();
+    thumb.pixels.resize(row * image.height());
+
+    // copy line by line in case the image has padding at the end of each line
+    for (int y = 0; y < image.height(); y++)
+        memcpy(thumb.pixels.begin() + row * y, image.constScanLine(y), row);
+
+    return thumb;
+}
+
+void art_thumbnail_init() { aud_art_set_scale_func(scale_thumbnail); }
+void art_thumbnail_cleanup() { aud_art_unset_scale_func(scale_thumbnail); }
+
+EXPORT QImage art_request_thumbnail(const char * filename, unsigned int size,
+                                    bool * queued)
+{
+    AudArtThumbnail thumb = aud_art_request_thumbnail(filename, size, queued);
+    if (!thumb.pixels.len())
+        return QImage();
+
+    // QImage does not take ownership of the buffer, so make a copy
+    return QImage((const uchar *)thumb.pixels.begin(), thumb.width,
+                  thumb.height, 4 * thumb.width, QImage::Format_RGBA8888)
+        .copy();
+}
+
 } // namespace audqt
@@ -115,6 +115,7 @@ EXPORT void init()
 
     aud_config_set_defaults("audqt", audqt_defaults);
     log_init();
+    art_thumbnail_init();
 
     // The QApplication instance is created only once and is not deleted
     // by audqt::cleanup(). If it already exists, we are done here.
@@ -199,6 +200,7 @@ EXPORT void cleanup()
     prefswin_hide();
 
     log_cleanup();
+    art_thumbnail_cleanup();
 
     // We do not delete the QApplication here due to issues that arise
     // if it is deleted and then re-created. Instead, it is deleted
@@ -30,6 +30,10 @@ class QStyle;
 namespace audqt
 {
 
+/* art-qt.cc */
+void art_thumbnail_init();
+void art_thumbnail_cleanup();
+
 /* audqt.cc */
 void set_icon_theme();
 
@@ -175,6 +175,8 @@ QPixmap art_request(const char * filename, unsigned int w, unsigned int h,
                     bool want_hidpi = true);
 QPixmap art_request_current(unsigned int w, unsigned int h,
                             bool want_hidpi = true);
+QImage art_request_thumbnail(const char * filename, unsigned int size,
+                             bool * queued = nullptr);
 
 /* infopopup-qt.cc */
 void infopopup_show(Playlist playlist, int entry);
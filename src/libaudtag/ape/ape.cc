@@ -30,6 +30,7 @@
 #include <libaudcore/runtime.h>
 #include <libaudcore/vfs.h>
 #include <libaudtag/builtin.h>
+#include <libaudtag/util.h>
 
 #pragma pack(push) /* must be byte-aligned */
 #pragma pack(1)
@@ -54,9 +55,10 @@ struct ValuePair {
 
 namespace audtag {
 
-static bool ape_read_header (VFSFile & handle, APEHeader * header)
+static bool ape_read_header (VFSFile & handle, const TagProbe & probe,
+ int64_t offset, APEHeader * header)
 {
-    if (handle.fread (header, 1, sizeof (APEHeader)) != sizeof (APEHeader))
+    if (! probe.read_at (handle, offset, header, sizeof (APEHeader)))
         return false;
 
     if (strncmp (header->magic, "APETAGEX", 8))
@@ -73,15 +75,12 @@ static bool ape_read_header (VFSFile & handle, APEHeader * header)
     return true;
 }
 
-static bool ape_find_header (VFSFile & handle, APEHeader * header,
- int * start, int * length, int * data_start, int * data_length)
+static bool ape_find_header (VFSFile & handle, const TagProbe & probe,
+ APEHeader * header, int * start, int * length, int * data_start, int * data_length)
 {
     APEHeader secondary;
 
-    if (handle.fseek (0, VFS_SEEK_SET))
-        return false;
-
-    if (ape_read_header (handle, header))
+    if (ape_read_header (handle, probe, 0, header))
     {
         AUDDBG ("Found header at 0, length = %d, version = %d.\n",
          (int) header->length, (int) header->version);
@@ -99,10 +98,8 @@ static bool ape_find_header (VFSFile & handle, APEHeader * header,
 
         if (! (header->flags & APE_FLAG_HAS_NO_FOOTER))
         {
-            if (handle.fseek (header->length, VFS_SEEK_CUR))
-                return false;
-
-            if (! ape_read_header (handle, & secondary))
+            if (! ape_read_header (handle, probe, sizeof (APEHeader) +
+             header->length, & secondary))
             {
                 AUDWARN ("Expected footer, but found none.\n");
                 return false;
@@ -114,16 +111,17 @@ static bool ape_find_header (VFSFile & handle, APEHeader * header,
         return true;
     }
 
-    if (handle.fseek (-(int) sizeof (APEHeader), VFS_SEEK_END))
+    if (probe.size < 0)
         return false;
 
-    if (! ape_read_header (handle, header))
+    int64_t footer = probe.size - (int) sizeof (APEHeader);
+
+    if (! ape_read_header (handle, probe, footer, header))
     {
         /* APE tag may be followed by an ID3v1 tag */
-        if (handle.fseek (-128 - (int) sizeof (APEHeader), VFS_SEEK_END))
-            return false;
+        footer -= 128;
 
-        if (! ape_read_header (handle, header))
+        if (! ape_read_header (handle, probe, footer, header))
         {
             AUDDBG ("No header found.\n");
             return false;
@@ -131,12 +129,11 @@ static bool ape_find_header (VFSFile & handle, APEHeader * header,
     }
 
     AUDDBG ("Found footer at %d, length = %d, version = %d.\n",
-     (int) handle.ftell () - (int) sizeof (APEHeader), (int) header->length,
-     (int) header->version);
+     (int) footer, (int) header->length, (int) header->version);
 
-    * start = handle.ftell () - header->length;
+    * start = footer + (int) sizeof (APEHeader) - (int64_t) header->length;
     * length = header->length;
-    * data_start = handle.ftell () - header->length;
+    * data_start = * start;
     * data_length = header->length - sizeof (APEHeader);
 
     if ((header->flags & APE_FLAG_HAS_NO_FOOTER) || (header->flags & APE_FLAG_IS_HEADER))
@@ -147,10 +144,7 @@ static bool ape_find_header (VFSFile & handle, APEHeader * header,
 
     if (header->flags & APE_FLAG_HAS_HEADER)
     {
-        if (handle.fseek (-(int) header->length - sizeof (APEHeader), VFS_SEEK_CUR))
-            return false;
-
-        if (! ape_read_header (handle, & secondary))
+        if (! ape_read_header (handle, probe, * start - (int) sizeof (APEHeader), & secondary))
         {
             AUDDBG ("Expected header, but found none.\n");
             return false;
@@ -163,13 +157,13 @@ static bool ape_find_header (VFSFile & handle, APEHeader * header,
     return true;
 }
 
-bool APETagModule::can_handle_file (VFSFile & handle)
+bool APETagModule::can_handle_file (VFSFile & handle, const TagProbe & probe)
 {
     APEHeader header;
     int start, length, data_start, data_length;
 
-    return ape_find_header (handle, & header, & start, & length, & data_start,
-     & data_length);
+    return ape_find_header (handle, probe, & header, & start, & length,
+     & data_start, & data_length);
 }
 
 /* returns start of next item or nullptr */
@@ -209,22 +203,21 @@ static const char * ape_read_item (const char * data, int length, ValuePair & pa
     return value + value_len;
 }
 
-static Index<ValuePair> ape_read_items (VFSFile & handle)
+static Index<ValuePair> ape_read_items (VFSFile & handle, const TagProbe & probe)
 {
     Index<ValuePair> list;
     APEHeader header;
     int start, length, data_start, data_length;
 
-    if (! ape_find_header (handle, & header, & start, & length, & data_start, & data_length))
-        return list;
-
-    if (handle.fseek (data_start, VFS_SEEK_SET))
+    if (! ape_find_header (handle, probe, & header, & start, & length,
+     & data_start, & data_length))
         return list;
 
+    /* small tags are usually within the probed tail already */
     Index<char> data;
     data.insert (0, data_length);
 
-    if (handle.fread (data.begin (), 1, data_length) != data_length)
+    if (! probe.read_at (handle, data_start, data.begin (), data_length))
         return list;
 
     AUDDBG ("Reading %d items:\n", header.items);
@@ -243,9 +236,10 @@ static Index<ValuePair> ape_read_items (VFSFile & handle)
     return list;
 }
 
-bool APETagModule::read_tag (VFSFile & handle, Tuple & tuple, Index<char> * image)
+bool APETagModule::read_tag (VFSFile & handle, const TagProbe & probe,
+ Tuple & tuple, Index<char> * image)
 {
-    Index<ValuePair> list = ape_read_items (handle);
+    Index<ValuePair> list = ape_read_items (handle, probe);
 
     for (const ValuePair & pair : list)
     {
@@ -350,37 +344,16 @@ static bool write_header (int data_length, int items, bool is_header,
     return handle.fwrite (& header, 1, sizeof (APEHeader)) == sizeof (APEHeader);
 }
 
-bool APETagModule::write_tag (VFSFile & handle, const Tuple & tuple)
+/* writes a complete tag (header, items, footer) at the current position */
+static bool write_ape_tag (VFSFile & handle, const Tuple & tuple,
+ const Index<ValuePair> & list, int * tag_length)
 {
-    Index<ValuePair> list = ape_read_items (handle);
-    APEHeader header;
-    int start, length, data_start, data_length, items;
-
-    if (ape_find_header (handle, & header, & start, & length, & data_start, & data_length))
-    {
-        if (start + length != handle.fsize ())
-        {
-            AUDERR ("Writing tags is only supported at end of file.\n");
-            return false;
-        }
-
-        if (handle.ftruncate (start))
-            return false;
-    }
-    else
-    {
-        start = handle.fsize ();
-
-        if (start < 0)
-            return false;
-    }
+    int64_t start = handle.ftell ();
+    int length = 0, items = 0;
 
-    if (handle.fseek (start, VFS_SEEK_SET) || ! write_header (0, 0, true, handle))
+    if (start < 0 || ! write_header (0, 0, true, handle))
         return false;
 
-    length = 0;
-    items = 0;
-
     if (! write_string_item (tuple, Tuple::Artist, handle, "Artist", & length, & items) ||
      ! write_string_item (tuple, Tuple::Title, handle, "Title", & length, & items) ||
      ! write_string_item (tuple, Tuple::Album, handle, "Album", & length, & items) ||
@@ -416,7 +389,58 @@ bool APETagModule::write_tag (VFSFile & handle, const Tuple & tuple)
     if (! write_header (length, items, true, handle))
         return false;
 
+    * tag_length = length + 2 * sizeof (APEHeader);
     return true;
 }
 
+bool APETagModule::write_tag (VFSFile & handle, const TagProbe & probe,
+ const Tuple & tuple)
+{
+    Index<ValuePair> list = ape_read_items (handle, probe);
+    APEHeader header;
+    int start, length, data_start, data_length, new_length;
+
+    int64_t size = probe.size;
+    if (size < 0)
+        return false;
+
+    if (! ape_find_header (handle, probe, & header, & start, & length,
+     & data_start, & data_length))
+    {
+        /* no tag yet, so append one */
+        start = size;
+        length = 0;
+    }
+
+    if (start + length == size)
+    {
+        /* tag at end of file: overwrite it in place, then cut off whatever is
+         * left of the old tag */
+        if (handle.fseek (start, VFS_SEEK_SET) < 0 ||
+         ! write_ape_tag (handle, tuple, list, & new_length))
+            return false;
+
+        return new_length >= length || handle.ftruncate (start + new_length) == 0;
+    }
+
+    /* tag followed by other data (such as an ID3v1 tag), or at the start of the
+     * file: write a new file with the tag in the same place */
+    ReplacementFile temp (handle);
+    if (! temp)
+        return false;
+
+    if (handle.fseek (0, VFS_SEEK_SET) < 0 || ! temp.file ().copy_from (handle, start))
+        return false;
+
+    if (! write_ape_tag (temp.file (), tuple, list, & new_length) ||
+     temp.file ().fseek (0, VFS_SEEK_END) < 0)
+        return false;
+
+    if (handle.fseek (start + length, VFS_SEEK_SET) < 0 ||
+     ! temp.file ().copy_from (handle, -1))
+        return false;
+
+    return temp.commit ();
+}
+
 }
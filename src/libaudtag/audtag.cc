@@ -28,7 +28,8 @@ namespace audtag {
 
 EXPORT bool read_tag (VFSFile & file, Tuple & tuple, Index<char> * image)
 {
-    TagModule * module = find_tag_module (file, TagType::None);
+    TagProbe probe;
+    TagModule * module = find_tag_module (file, probe, TagType::None);
 
     if (! module)
     {
@@ -36,12 +37,13 @@ EXPORT bool read_tag (VFSFile & file, Tuple & tuple, Index<char> * image)
         return false;
     }
 
-    return module->read_tag (file, tuple, image);
+    return module->read_tag (file, probe, tuple, image);
 }
 
 EXPORT bool write_tuple (VFSFile & file, const Tuple & tuple, TagType new_type)
 {
-    TagModule * module = find_tag_module (file, new_type);
+    TagProbe probe;
+    TagModule * module = find_tag_module (file, probe, new_type);
 
     if (! module)
     {
@@ -49,7 +51,7 @@ EXPORT bool write_tuple (VFSFile & file, const Tuple & tuple, TagType new_type)
         return false;
     }
 
-    return module->write_tag (file, tuple);
+    return module->write_tag (file, probe, tuple);
 }
 
 }
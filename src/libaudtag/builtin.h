@@ -28,34 +28,38 @@ struct ID3v1TagModule : TagModule
 {
     constexpr ID3v1TagModule () : TagModule ("ID3v1", TagType::None) {}
 
-    bool can_handle_file (VFSFile & file);
-    bool read_tag (VFSFile & file, Tuple & tuple, Index<char> * image);
+    bool can_handle_file (VFSFile & file, const TagProbe & probe);
+    bool read_tag (VFSFile & file, const TagProbe & probe, Tuple & tuple,
+     Index<char> * image);
 };
 
 struct ID3v22TagModule : TagModule
 {
     constexpr ID3v22TagModule () : TagModule ("ID3v2.2", TagType::None) {}
 
-    bool can_handle_file (VFSFile & file);
-    bool read_tag (VFSFile & file, Tuple & tuple, Index<char> * image);
+    bool can_handle_file (VFSFile & file, const TagProbe & probe);
+    bool read_tag (VFSFile & file, const TagProbe & probe, Tuple & tuple,
+     Index<char> * image);
 };
 
 struct ID3v24TagModule : TagModule
 {
     constexpr ID3v24TagModule () : TagModule ("ID3v2.3/v2.4", TagType::ID3v2) {}
 
-    bool can_handle_file (VFSFile & file);
-    bool read_tag (VFSFile & file, Tuple & tuple, Index<char> * image);
-    bool write_tag (VFSFile & file, const Tuple & tuple);
+    bool can_handle_file (VFSFile & file, const TagProbe & probe);
+    bool read_tag (VFSFile & file, const TagProbe & probe, Tuple & tuple,
+     Index<char> * image);
+    bool write_tag (VFSFile & file, const TagProbe & probe, const Tuple & tuple);
 };
 
 struct APETagModule : TagModule
 {
     constexpr APETagModule () : TagModule ("APE", TagType::APE) {}
 
-    bool can_handle_file (VFSFile & file);
-    bool read_tag (VFSFile & file, Tuple & tuple, Index<char> * image);
-    bool write_tag (VFSFile & file, const Tuple & tuple);
+    bool can_handle_file (VFSFile & file, const TagProbe & probe);
+    bool read_tag (VFSFile & file, const TagProbe & probe, Tuple & tuple,
+     Index<char> * image);
+    bool write_tag (VFSFile & file, const TagProbe & probe, const Tuple & tuple);
 };
 
 }
@@ -54,30 +54,27 @@ struct ID3v1Ext {
 
 namespace audtag {
 
-static bool read_id3v1_tag (VFSFile & file, ID3v1Tag * tag)
+static bool read_id3v1_tag (VFSFile & file, const TagProbe & probe, ID3v1Tag * tag)
 {
-    if (file.fseek (-sizeof (ID3v1Tag), VFS_SEEK_END) < 0)
-        return false;
-    if (file.fread (tag, 1, sizeof (ID3v1Tag)) != sizeof (ID3v1Tag))
+    if (! probe.read_at (file, -(int64_t) sizeof (ID3v1Tag), tag, sizeof (ID3v1Tag)))
         return false;
 
     return ! strncmp (tag->header, "TAG", 3);
 }
 
-static bool read_id3v1_ext (VFSFile & file, ID3v1Ext * ext)
+static bool read_id3v1_ext (VFSFile & file, const TagProbe & probe, ID3v1Ext * ext)
 {
-    if (file.fseek (-(sizeof (ID3v1Ext) + sizeof (ID3v1Tag)), VFS_SEEK_END) < 0)
-        return false;
-    if (file.fread (ext, 1, sizeof (ID3v1Ext)) != sizeof (ID3v1Ext))
+    if (! probe.read_at (file, -(int64_t) (sizeof (ID3v1Ext) + sizeof (ID3v1Tag)),
+     ext, sizeof (ID3v1Ext)))
         return false;
 
     return ! strncmp (ext->header, "TAG+", 4);
 }
 
-bool ID3v1TagModule::can_handle_file (VFSFile & file)
+bool ID3v1TagModule::can_handle_file (VFSFile & file, const TagProbe & probe)
 {
     ID3v1Tag tag;
-    return read_id3v1_tag (file, & tag);
+    return read_id3v1_tag (file, probe, & tag);
 }
 
 static bool combine_string (Tuple & tuple, Tuple::Field field,
@@ -96,15 +93,16 @@ static bool combine_string (Tuple & tuple, Tuple::Field field,
     return true;
 }
 
-bool ID3v1TagModule::read_tag (VFSFile & file, Tuple & tuple, Index<char> * image)
+bool ID3v1TagModule::read_tag (VFSFile & file, const TagProbe & probe,
+ Tuple & tuple, Index<char> * image)
 {
     ID3v1Tag tag;
     ID3v1Ext ext;
 
-    if (! read_id3v1_tag (file, & tag))
+    if (! read_id3v1_tag (file, probe, & tag))
         return false;
 
-    if (! read_id3v1_ext (file, & ext))
+    if (! read_id3v1_ext (file, probe, & ext))
         memset (& ext, 0, sizeof (ID3v1Ext));
 
     combine_string (tuple, Tuple::Title, tag.title, sizeof tag.title, ext.title, sizeof ext.title);
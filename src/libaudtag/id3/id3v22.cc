@@ -120,16 +120,12 @@ static bool validate_header (ID3v22Header * header)
     return true;
 }
 
-static bool read_header (VFSFile & handle, int * version, bool *
- syncsafe, int64_t * offset, int * header_size, int * data_size)
+static bool read_header (VFSFile & handle, const TagProbe & probe, int *
+ version, bool * syncsafe, int64_t * offset, int * header_size, int * data_size)
 {
     ID3v22Header header;
 
-    if (handle.fseek (0, VFS_SEEK_SET))
-        return false;
-
-    if (handle.fread (& header, 1, sizeof (ID3v22Header)) != sizeof
-     (ID3v22Header))
+    if (! probe.read_at (handle, 0, & header, sizeof (ID3v22Header)))
         return false;
 
     if (validate_header (& header))
@@ -206,25 +202,29 @@ static int get_frame_id (const char * key)
     return -1;
 }
 
-bool ID3v22TagModule::can_handle_file (VFSFile & handle)
+bool ID3v22TagModule::can_handle_file (VFSFile & handle, const TagProbe & probe)
 {
     int version, header_size, data_size;
     bool syncsafe;
     int64_t offset;
 
-    return read_header (handle, & version, & syncsafe, & offset, & header_size,
-     & data_size);
+    return read_header (handle, probe, & version, & syncsafe, & offset,
+     & header_size, & data_size);
 }
 
-bool ID3v22TagModule::read_tag (VFSFile & handle, Tuple & tuple, Index<char> * image)
+bool ID3v22TagModule::read_tag (VFSFile & handle, const TagProbe & probe,
+ Tuple & tuple, Index<char> * image)
 {
     int version, header_size, data_size;
     bool syncsafe;
     int64_t offset;
     int pos;
 
-    if (! read_header (handle, & version, & syncsafe, & offset, & header_size,
-     & data_size))
+    if (! read_header (handle, probe, & version, & syncsafe, & offset,
+     & header_size, & data_size))
+        return false;
+
+    if (handle.fseek (offset + header_size, VFS_SEEK_SET))
         return false;
 
     AUDDBG ("Reading tags from %i bytes of ID3 data in %s\n", data_size,
@@ -28,6 +28,7 @@
 #include <libaudcore/audio.h>
 #include <libaudcore/audstrings.h>
 #include <libaudcore/multihash.h>
+#include <libaudcore/probe.h>
 #include <libaudcore/runtime.h>
 #include <libaudtag/builtin.h>
 #include <libaudtag/util.h>
@@ -120,39 +121,31 @@ typedef SimpleHash<String, FrameList> FrameDict;
 
 namespace audtag {
 
-static bool skip_extended_header_3 (VFSFile & handle, int * _size)
+/* returns the size of the extended header at <offset> */
+static bool read_extended_header (VFSFile & handle, const TagProbe & probe,
+ int64_t offset, int version, int * _size)
 {
     uint32_t size;
 
-    if (handle.fread (& size, 1, 4) != 4)
+    if (! probe.read_at (handle, offset, & size, 4))
         return false;
 
-    size = FROM_BE32 (size);
-
-    AUDDBG ("Found v2.3 extended header, size = %d.\n", (int) size);
-
-    if (handle.fseek (size, VFS_SEEK_CUR))
-        return false;
-
-    * _size = 4 + size;
-    return true;
-}
-
-static bool skip_extended_header_4 (VFSFile & handle, int * _size)
-{
-    uint32_t size;
-
-    if (handle.fread (& size, 1, 4) != 4)
-        return false;
-
-    size = unsyncsafe32 (FROM_BE32 (size));
+    if (version == 3)
+    {
+        size = FROM_BE32 (size);
+        AUDDBG ("Found v2.3 extended header, size = %d.\n", (int) size);
 
-    AUDDBG ("Found v2.4 extended header, size = %d.\n", (int) size);
+        /* the size field is not included */
+        * _size = 4 + size;
+    }
+    else
+    {
+        size = unsyncsafe32 (FROM_BE32 (size));
+        AUDDBG ("Found v2.4 extended header, size = %d.\n", (int) size);
 
-    if (handle.fseek (size - 4, VFS_SEEK_CUR))
-        return false;
+        * _size = size;
+    }
 
-    * _size = size;
     return true;
 }
 
@@ -187,15 +180,12 @@ struct HeaderInfo {
     bool valid = false;
 };
 
-static HeaderInfo read_header (VFSFile & handle)
+static HeaderInfo read_header (VFSFile & handle, const TagProbe & probe)
 {
     HeaderInfo info;
     ID3v24Header header, footer;
 
-    if (handle.fseek (0, VFS_SEEK_SET))
-        return info;
-
-    if (handle.fread (& header, 1, sizeof (ID3v24Header)) != sizeof (ID3v24Header))
+    if (! probe.read_at (handle, 0, & header, sizeof (ID3v24Header)))
         return info;
 
     if (validate_header (& header, false))
@@ -206,32 +196,25 @@ static HeaderInfo read_header (VFSFile & handle)
 
         if (header.flags & ID3_HEADER_HAS_FOOTER)
         {
-            if (handle.fseek (header.size, VFS_SEEK_CUR))
-                return info;
-
-            if (handle.fread (& footer, 1, sizeof (ID3v24Header)) != sizeof (ID3v24Header))
+            if (! probe.read_at (handle, sizeof (ID3v24Header) + header.size,
+             & footer, sizeof (ID3v24Header)))
                 return info;
 
             if (! validate_header (& footer, true))
                 return info;
 
-            if (handle.fseek (sizeof (ID3v24Header), VFS_SEEK_SET))
-                return info;
-
             info.footer_size = sizeof (ID3v24Header);
         }
     }
     else
     {
-        int64_t end = handle.fsize ();
+        int64_t end = probe.size;
 
         if (end < 0)
             return info;
 
-        if (handle.fseek (end - sizeof (ID3v24Header), VFS_SEEK_SET))
-            return info;
-
-        if (handle.fread (& footer, 1, sizeof (ID3v24Header)) != sizeof (ID3v24Header))
+        if (! probe.read_at (handle, end - sizeof (ID3v24Header), & footer,
+         sizeof (ID3v24Header)))
             return info;
 
         if (! validate_header (& footer, true))
@@ -243,11 +226,7 @@ static HeaderInfo read_header (VFSFile & handle)
         info.data_size = footer.size;
         info.footer_size = sizeof (ID3v24Header);
 
-        if (handle.fseek (info.offset, VFS_SEEK_SET))
-            return info;
-
-        if (handle.fread (& header, 1, sizeof (ID3v24Header)) != sizeof
-         (ID3v24Header))
+        if (! probe.read_at (handle, info.offset, & header, sizeof (ID3v24Header)))
             return info;
 
         if (! validate_header (& header, false))
@@ -262,16 +241,9 @@ static HeaderInfo read_header (VFSFile & handle)
     {
         int extended_size = 0;
 
-        if (header.version == 3)
-        {
-            if (! skip_extended_header_3 (handle, & extended_size))
-                return info;
-        }
-        else if (header.version == 4)
-        {
-            if (! skip_extended_header_4 (handle, & extended_size))
-                return info;
-        }
+        if (! read_extended_header (handle, probe, info.offset +
+         sizeof (ID3v24Header), header.version, & extended_size))
+            return info;
 
         if (extended_size > info.data_size)
             return info;
@@ -310,13 +282,21 @@ static void unsyncsafe (Index<char> & data)
     data.remove (set - data.begin (), -1);
 }
 
-static Index<char> read_tag_data (VFSFile & handle, int size, bool syncsafe)
+static Index<char> read_tag_data (VFSFile & handle, const TagProbe & probe,
+ const HeaderInfo & info)
 {
+    int64_t start = info.offset + info.header_size;
     Index<char> data;
-    data.resize (size);
-    data.resize (handle.fread (data.begin (), 1, size));
 
-    if (syncsafe)
+    if (const char * buffered = probe.find (start, info.data_size))
+        data.insert (buffered, 0, info.data_size);
+    else if (! handle.fseek (start, VFS_SEEK_SET))
+    {
+        data.resize (info.data_size);
+        data.resize (handle.fread (data.begin (), 1, info.data_size));
+    }
+
+    if (info.syncsafe)
         unsyncsafe (data);
 
     return data;
@@ -327,32 +307,33 @@ struct ReadFrameRet : public GenericFrame {
     bool valid = false;
 };
 
-static ReadFrameRet read_frame (const char * data, int max_size, int version)
+/* Converts a frame header to host byte order and returns the size of the frame
+ * (including the header), or 0 if there are no more frames. */
+static int check_frame_header (ID3v24FrameHeader & header, int max_size, int version)
 {
-    ReadFrameRet frame;
-    ID3v24FrameHeader header;
-    unsigned skip = 0;
-
     if ((max_size -= sizeof (ID3v24FrameHeader)) < 0)
-        return frame;
-
-    memcpy (& header, data, sizeof (ID3v24FrameHeader));
-    data += sizeof (ID3v24FrameHeader);
+        return 0;
 
     if (! header.key[0]) /* padding */
-        return frame;
+        return 0;
 
     header.size = (version == 3) ? FROM_BE32 (header.size) : unsyncsafe32 (FROM_BE32 (header.size));
     header.flags = FROM_BE16 (header.flags);
 
     if (header.size > (unsigned) max_size)
-        return frame;
+        return 0;
 
-    // set frame size here so we can continue past empty/invalid frames
-    frame.size = sizeof (ID3v24FrameHeader) + header.size;
+    return sizeof (ID3v24FrameHeader) + header.size;
+}
+
+/* Fills in the key and contents of a frame from its checked header and data. */
+static void decode_frame (const ID3v24FrameHeader & header, const char * data,
+ ReadFrameRet & frame)
+{
+    unsigned skip = 0;
 
     if (! header.size)
-        return frame;
+        return;
 
     AUDDBG ("Found frame:\n");
     AUDDBG (" key = %.4s\n", header.key);
@@ -362,7 +343,7 @@ static ReadFrameRet read_frame (const char * data, int max_size, int version)
     if (header.flags & (ID3_FRAME_COMPRESSED | ID3_FRAME_ENCRYPTED))
     {
         AUDDBG ("Hit compressed/encrypted frame %.4s.\n", header.key);
-        return frame;
+        return;
     }
 
     if (header.flags & ID3_FRAME_HAS_GROUP)
@@ -371,7 +352,7 @@ static ReadFrameRet read_frame (const char * data, int max_size, int version)
         skip += 4;
 
     if (skip >= header.size)
-        return frame;
+        return;
 
     frame.key = String (str_copy (header.key, 4));
     frame.insert (data + skip, 0, header.size - skip);
@@ -381,6 +362,24 @@ static ReadFrameRet read_frame (const char * data, int max_size, int version)
 
     AUDDBG ("Data size = %d.\n", frame.len ());
     frame.valid = true;
+}
+
+static ReadFrameRet read_frame (const char * data, int max_size, int version)
+{
+    ReadFrameRet frame;
+    ID3v24FrameHeader header;
+
+    if (max_size < (int) sizeof (ID3v24FrameHeader))
+        return frame;
+
+    memcpy (& header, data, sizeof (ID3v24FrameHeader));
+
+    // set frame size here so we can continue past empty/invalid frames
+    frame.size = check_frame_header (header, max_size, version);
+
+    if (frame.size)
+        decode_frame (header, data + sizeof (ID3v24FrameHeader), frame);
+
     return frame;
 }
 
@@ -429,6 +428,18 @@ static bool write_frame (VFSFile & file, const GenericFrame & frame, int version
     return true;
 }
 
+static int get_frames_size (FrameDict & dict)
+{
+    int size = 0;
+
+    dict.iterate ([&] (const String & key, const FrameList & list) {
+        for (const GenericFrame & frame : list)
+            size += sizeof (ID3v24FrameHeader) + frame.len ();
+    });
+
+    return size;
+}
+
 static int write_all_frames (VFSFile & file, FrameDict & dict, int version)
 {
     int written_size = 0;
@@ -574,94 +585,211 @@ static void add_frameFromTupleInt (const Tuple & tuple, Tuple::Field field,
         remove_frame (id3_field, dict);
 }
 
-bool ID3v24TagModule::can_handle_file (VFSFile & handle)
+/* Returns the tuple fields that a frame may set. */
+static uint64_t get_frame_fields (int id)
+{
+    constexpr uint64_t gain_fields = aud_tag_field (Tuple::AlbumGain) |
+     aud_tag_field (Tuple::AlbumPeak) | aud_tag_field (Tuple::TrackGain) |
+     aud_tag_field (Tuple::TrackPeak) | aud_tag_field (Tuple::GainDivisor) |
+     aud_tag_field (Tuple::PeakDivisor);
+
+    switch (id)
+    {
+      case ID3_ALBUM: return aud_tag_field (Tuple::Album);
+      case ID3_TITLE: return aud_tag_field (Tuple::Title);
+      case ID3_COMPOSER: return aud_tag_field (Tuple::Composer);
+      case ID3_COPYRIGHT: return aud_tag_field (Tuple::Copyright);
+      case ID3_DATE: return aud_tag_field (Tuple::Date);
+      case ID3_LENGTH: return aud_tag_field (Tuple::Length);
+      case ID3_ARTIST: return aud_tag_field (Tuple::Artist);
+      case ID3_ALBUM_ARTIST: return aud_tag_field (Tuple::AlbumArtist);
+      case ID3_TRACKNR: return aud_tag_field (Tuple::Track);
+      case ID3_YEAR:
+      case ID3_RECORDING_TIME: return aud_tag_field (Tuple::Year);
+      case ID3_PUBLISHER: return aud_tag_field (Tuple::Publisher);
+      case ID3_GENRE: return aud_tag_field (Tuple::Genre);
+      case ID3_COMMENT: return aud_tag_field (Tuple::Comment);
+      case ID3_TXXX: return aud_tag_field (Tuple::CatalogNum) | gain_fields;
+      case ID3_RVA2: return gain_fields;
+      case ID3_LYRICS: return aud_tag_field (Tuple::Lyrics);
+      case ID3_DISCNR: return aud_tag_field (Tuple::Disc);
+      default: return 0;
+    }
+}
+
+static bool frame_wanted (int id, uint64_t fields, Index<char> * image)
+{
+    /* we can return only one image, so once we have found a
+     * valid one, don't read any more APIC frames */
+    if (id == ID3_APIC)
+        return image && ! image->len ();
+
+    return (get_frame_fields (id) & fields) != 0;
+}
+
+/* Reads the next frame directly from the file.  Only the header is read for
+ * frames that are not wanted; their contents are skipped over. */
+static ReadFrameRet read_frame_lazy (VFSFile & handle, int max_size,
+ int version, uint64_t fields, Index<char> * image)
+{
+    ReadFrameRet frame;
+    ID3v24FrameHeader header;
+
+    if (max_size < (int) sizeof (ID3v24FrameHeader) ||
+     handle.fread (& header, 1, sizeof (ID3v24FrameHeader)) != sizeof (ID3v24FrameHeader))
+        return frame;
+
+    int size = check_frame_header (header, max_size, version);
+    if (! size)
+        return frame;
+
+    if (! frame_wanted (get_frame_id (str_copy (header.key, 4)), fields, image))
+    {
+        AUDDBG ("Skipping frame %.4s, size = %d.\n", header.key, (int) header.size);
+
+        if (! handle.fseek (header.size, VFS_SEEK_CUR))
+            frame.size = size;
+
+        return frame;
+    }
+
+    Index<char> data;
+    data.resize (header.size);
+
+    if (handle.fread (data.begin (), 1, header.size) != header.size)
+        return frame;
+
+    frame.size = size;
+    decode_frame (header, data.begin (), frame);
+    return frame;
+}
+
+static void decode_frame_into (int id, ReadFrameRet & frame, Tuple & tuple,
+ Index<char> * image, FrameList & rva_frames)
+{
+    switch (id)
+    {
+      case ID3_ALBUM:
+        id3_associate_string (tuple, Tuple::Album, & frame[0], frame.len ());
+        break;
+      case ID3_TITLE:
+        id3_associate_string (tuple, Tuple::Title, & frame[0], frame.len ());
+        break;
+      case ID3_COMPOSER:
+        id3_associate_string (tuple, Tuple::Composer, & frame[0], frame.len ());
+        break;
+      case ID3_COPYRIGHT:
+        id3_associate_string (tuple, Tuple::Copyright, & frame[0], frame.len ());
+        break;
+      case ID3_DATE:
+        id3_associate_string (tuple, Tuple::Date, & frame[0], frame.len ());
+        break;
+      case ID3_LENGTH:
+        id3_associate_length (tuple, & frame[0], frame.len ());
+        break;
+      case ID3_ARTIST:
+        id3_associate_string (tuple, Tuple::Artist, & frame[0], frame.len ());
+        break;
+      case ID3_ALBUM_ARTIST:
+        id3_associate_string (tuple, Tuple::AlbumArtist, & frame[0], frame.len ());
+        break;
+      case ID3_TRACKNR:
+        id3_associate_int (tuple, Tuple::Track, & frame[0], frame.len ());
+        break;
+      case ID3_YEAR:
+      case ID3_RECORDING_TIME:
+        id3_associate_int (tuple, Tuple::Year, & frame[0], frame.len ());
+        break;
+      case ID3_PUBLISHER:
+        id3_associate_string (tuple, Tuple::Publisher, & frame[0], frame.len ());
+        break;
+      case ID3_GENRE:
+        id3_decode_genre (tuple, & frame[0], frame.len ());
+        break;
+      case ID3_COMMENT:
+        id3_associate_memo (tuple, Tuple::Comment, & frame[0], frame.len ());
+        break;
+      case ID3_TXXX:
+        id3_decode_txxx (tuple, & frame[0], frame.len ());
+        break;
+      case ID3_RVA2:
+        rva_frames.append (std::move (frame));
+        break;
+      case ID3_APIC:
+        if (image && ! image->len ())
+            * image = id3_decode_apic (& frame[0], frame.len ());
+        break;
+      case ID3_LYRICS:
+        id3_associate_memo (tuple, Tuple::Lyrics, & frame[0], frame.len ());
+        break;
+      case ID3_DISCNR:
+        id3_associate_int (tuple, Tuple::Disc, & frame[0], frame.len ());
+        break;
+      default:
+        AUDDBG ("Ignoring unsupported ID3 frame %s.\n", (const char *) frame.key);
+        break;
+    }
+}
+
+bool ID3v24TagModule::can_handle_file (VFSFile & handle, const TagProbe & probe)
 {
-    auto info = read_header (handle);
+    auto info = read_header (handle, probe);
     return info.valid;
 }
 
-bool ID3v24TagModule::read_tag (VFSFile & handle, Tuple & tuple, Index<char> * image)
+bool ID3v24TagModule::read_tag (VFSFile & handle, const TagProbe & probe,
+ Tuple & tuple, Index<char> * image)
 {
-    auto info = read_header (handle);
+    auto info = read_header (handle, probe);
     if (! info.valid)
         return false;
 
-    auto data = read_tag_data (handle, info.data_size, info.syncsafe);
+    uint64_t fields = aud_file_get_wanted_fields ();
     FrameList rva_frames;
 
-    for (const char * pos = data.begin (); pos < data.end (); )
+    int64_t data_start = info.offset + info.header_size;
+
+    if (info.syncsafe || probe.find (data_start, info.data_size))
     {
-        auto frame = read_frame (pos, data.end () - pos, info.version);
-        if (! frame.size)
-            break;
+        /* tag-level unsynchronisation (ID3v2.3) shifts the frame boundaries,
+         * so the whole tag has to be read to find them; small tags have
+         * usually been read whole while probing anyway */
+        auto data = read_tag_data (handle, probe, info);
 
-        pos += frame.size;
-        if (! frame.valid)
-            continue;
+        for (const char * pos = data.begin (); pos < data.end (); )
+        {
+            auto frame = read_frame (pos, data.end () - pos, info.version);
+            if (! frame.size)
+                break;
+
+            pos += frame.size;
+            if (! frame.valid)
+                continue;
+
+            int id = get_frame_id (frame.key);
+            if (frame_wanted (id, fields, image))
+                decode_frame_into (id, frame, tuple, image, rva_frames);
+        }
+    }
+    else
+    {
+        /* read frame by frame, seeking past unwanted (typically large)
+         * frames rather than reading them */
+        if (handle.fseek (data_start, VFS_SEEK_SET))
+            return false;
 
-        switch (get_frame_id (frame.key))
+        for (int pos = 0; pos < info.data_size; )
         {
-          case ID3_ALBUM:
-            id3_associate_string (tuple, Tuple::Album, & frame[0], frame.len ());
-            break;
-          case ID3_TITLE:
-            id3_associate_string (tuple, Tuple::Title, & frame[0], frame.len ());
-            break;
-          case ID3_COMPOSER:
-            id3_associate_string (tuple, Tuple::Composer, & frame[0], frame.len ());
-            break;
-          case ID3_COPYRIGHT:
-            id3_associate_string (tuple, Tuple::Copyright, & frame[0], frame.len ());
-            break;
-          case ID3_DATE:
-            id3_associate_string (tuple, Tuple::Date, & frame[0], frame.len ());
-            break;
-          case ID3_LENGTH:
-            id3_associate_length (tuple, & frame[0], frame.len ());
-            break;
-          case ID3_ARTIST:
-            id3_associate_string (tuple, Tuple::Artist, & frame[0], frame.len ());
-            break;
-          case ID3_ALBUM_ARTIST:
-            id3_associate_string (tuple, Tuple::AlbumArtist, & frame[0], frame.len ());
-            break;
-          case ID3_TRACKNR:
-            id3_associate_int (tuple, Tuple::Track, & frame[0], frame.len ());
-            break;
-          case ID3_YEAR:
-          case ID3_RECORDING_TIME:
-            id3_associate_int (tuple, Tuple::Year, & frame[0], frame.len ());
-            break;
-          case ID3_PUBLISHER:
-            id3_associate_string (tuple, Tuple::Publisher, & frame[0], frame.len ());
-            break;
-          case ID3_GENRE:
-            id3_decode_genre (tuple, & frame[0], frame.len ());
-            break;
-          case ID3_COMMENT:
-            id3_associate_memo (tuple, Tuple::Comment, & frame[0], frame.len ());
-            break;
-          case ID3_TXXX:
-            id3_decode_txxx (tuple, & frame[0], frame.len ());
-            break;
-          case ID3_RVA2:
-            rva_frames.append (std::move (frame));
-            break;
-          case ID3_APIC:
-            /* we can return only one image, so once we have found a
-             * valid one, don't read any more APIC frames */
-            if (image && !image->len())
-                * image = id3_decode_apic (& frame[0], frame.len ());
-            break;
-          case ID3_LYRICS:
-            id3_associate_memo (tuple, Tuple::Lyrics, & frame[0], frame.len ());
-            break;
-          case ID3_DISCNR:
-            id3_associate_int (tuple, Tuple::Disc, & frame[0], frame.len ());
-            break;
-          default:
-            AUDDBG ("Ignoring unsupported ID3 frame %s.\n", (const char *) frame.key);
-            break;
+            auto frame = read_frame_lazy (handle, info.data_size - pos,
+             info.version, fields, image);
+            if (! frame.size)
+                break;
+
+            pos += frame.size;
+            if (! frame.valid)
+                continue;
+
+            decode_frame_into (get_frame_id (frame.key), frame, tuple, image, rva_frames);
         }
     }
 
@@ -675,14 +803,15 @@ bool ID3v24TagModule::read_tag (VFSFile & handle, Tuple & tuple, Index<char> * i
     return true;
 }
 
-bool ID3v24TagModule::write_tag (VFSFile & f, const Tuple & tuple)
+bool ID3v24TagModule::write_tag (VFSFile & f, const TagProbe & probe,
+ const Tuple & tuple)
 {
     //read all frames into generic frames;
     FrameDict dict;
 
-    auto info = read_header (f);
+    auto info = read_header (f, probe);
     if (info.valid)
-        read_all_frames (read_tag_data (f, info.data_size, info.syncsafe), info.version, dict);
+        read_all_frames (read_tag_data (f, probe, info), info.version, dict);
 
     //make the new frames from tuple and replace in the dictionary the old frames with the new ones
     add_frameFromTupleStr (tuple, Tuple::Title, ID3_TITLE, dict);
@@ -703,6 +832,27 @@ bool ID3v24TagModule::write_tag (VFSFile & f, const Tuple & tuple)
     String lyrics = tuple.get_str (Tuple::Lyrics);
     add_memo_frame (ID3_LYRICS, lyrics, dict);
 
+    int version = info.valid ? info.version : 3;
+    int frames_size = get_frames_size (dict);
+
+    /* if the new frames fit into the space of the existing tag at the start of
+     * the file (including its padding), overwrite it in place; a footer is
+     * not allowed together with padding, so that case is left out */
+    if (info.valid && ! info.offset && ! info.footer_size)
+    {
+        int space = info.header_size + info.data_size - sizeof (ID3v24Header);
+
+        if (frames_size <= space)
+        {
+            AUDDBG ("Rewriting tag in place (%d of %d bytes).\n", frames_size, space);
+
+            return f.fseek (0, VFS_SEEK_SET) == 0 &&
+             write_header (f, version, space) &&
+             write_all_frames (f, dict, version) == frames_size &&
+             write_padding (f, space - frames_size);
+        }
+    }
+
     /* location and size of non-tag data */
     int64_t mp3_offset = 0;
     int64_t mp3_size = -1;
@@ -712,30 +862,23 @@ bool ID3v24TagModule::write_tag (VFSFile & f, const Tuple & tuple)
     if (info.valid && info.offset)    /* existing tag at end */
         mp3_size = info.offset;
 
-    auto temp = VFSFile::tmpfile ();
+    /* leave room for the next edit to be made in place */
+    int padding = aud::clamp (aud_get_int ("tag_padding"), 0, MAX_TAG_SIZE / 2);
+
+    ReplacementFile temp (f);
     if (! temp)
         return false;
 
-    /* write empty header (will be overwritten later) */
-    int version = info.valid ? info.version : 3;
-    if (! write_header (temp, version, 0))
+    if (! write_header (temp.file (), version, frames_size + padding) ||
+     write_all_frames (temp.file (), dict, version) != frames_size ||
+     ! write_padding (temp.file (), padding))
         return false;
 
-    /* write tag data */
-    int data_size = write_all_frames (temp, dict, version);
-
     /* copy non-tag data */
-    if (f.fseek (mp3_offset, VFS_SEEK_SET) < 0 || ! temp.copy_from (f, mp3_size))
+    if (f.fseek (mp3_offset, VFS_SEEK_SET) < 0 || ! temp.file ().copy_from (f, mp3_size))
         return false;
 
-    /* go back to beginning and write real header */
-    if (temp.fseek (0, VFS_SEEK_SET) < 0 || ! write_header (temp, version, data_size))
-        return false;
-
-    if (! f.replace_with (temp))
-        return false;
-
-    return true;
+    return temp.commit ();
 }
 
 }
@@ -36,17 +36,17 @@ static ID3v24TagModule id3v24;
 
 static TagModule * const modules[] = {& id3v24, & id3v22, & ape, & id3v1};
 
-TagModule * find_tag_module (VFSFile & fd, TagType new_type)
+TagModule * find_tag_module (VFSFile & fd, TagProbe & probe, TagType new_type)
 {
-    for (TagModule * module : modules)
+    if (! probe.read (fd))
     {
-        if (fd.fseek (0, VFS_SEEK_SET))
-        {
-            AUDDBG("not a seekable file\n");
-            return nullptr;
-        }
+        AUDDBG("not a seekable file\n");
+        return nullptr;
+    }
 
-        if (module->can_handle_file (fd))
+    for (TagModule * module : modules)
+    {
+        if (module->can_handle_file (fd, probe))
         {
             AUDDBG ("Module %s accepted file.\n", module->m_name);
             return module;
@@ -70,20 +70,21 @@ TagModule * find_tag_module (VFSFile & fd, TagType new_type)
 /**************************************************************************************************************
  * tag module object management                                                                               *
  **************************************************************************************************************/
-bool TagModule::can_handle_file (VFSFile & file)
+bool TagModule::can_handle_file (VFSFile & file, const TagProbe & probe)
 {
     AUDDBG("Module %s does not support %s (no probing function implemented).\n", m_name,
            file.filename ());
     return false;
 }
 
-bool TagModule::read_tag (VFSFile & file, Tuple & tuple, Index<char> * image)
+bool TagModule::read_tag (VFSFile & file, const TagProbe & probe, Tuple & tuple,
+ Index<char> * image)
 {
     AUDDBG ("%s: read_tag() not implemented.\n", m_name);
     return false;
 }
 
-bool TagModule::write_tag (VFSFile & file, Tuple const & tuple)
+bool TagModule::write_tag (VFSFile & file, const TagProbe & probe, Tuple const & tuple)
 {
     AUDDBG ("%s: write_tag() not implemented.\n", m_name);
     return false;
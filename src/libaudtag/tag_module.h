@@ -21,6 +21,7 @@
 #define TAG_MODULE_H
 
 #include "audtag.h"
+#include "util.h"
 
 namespace audtag {
 
@@ -29,9 +30,12 @@ struct TagModule
     const char * m_name;
     TagType m_type; /* set to None if the module cannot create new tags */
 
-    virtual bool can_handle_file (VFSFile & file);
-    virtual bool read_tag (VFSFile & file, Tuple & tuple, Index<char> * image);
-    virtual bool write_tag (VFSFile & file, const Tuple & tuple);
+    /* all of these get the file's head and tail as already read by
+     * find_tag_module(), so that a tag can be found without further I/O */
+    virtual bool can_handle_file (VFSFile & file, const TagProbe & probe);
+    virtual bool read_tag (VFSFile & file, const TagProbe & probe, Tuple & tuple,
+     Index<char> * image);
+    virtual bool write_tag (VFSFile & file, const TagProbe & probe, const Tuple & tuple);
 
 protected:
     constexpr TagModule (const char * name, TagType type) :
@@ -39,7 +43,9 @@ protected:
         m_type (type) {}
 };
 
-TagModule * find_tag_module (VFSFile & handle, TagType new_type);
+/* reads the head and tail of the file into <probe> and returns the module
+ * whose tag is found there (or one that can create a new tag of <new_type>) */
+TagModule * find_tag_module (VFSFile & handle, TagProbe & probe, TagType new_type);
 
 }
 
@@ -19,6 +19,19 @@
 
 #include "util.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/xattr.h>
+#endif
+
+#include <glib/gstdio.h>
+
+#include <libaudcore/audstrings.h>
+#include <libaudcore/runtime.h>
+
 const char *convert_numericgenre_to_text(int numericgenre)
 {
     static const struct
@@ -173,3 +186,220 @@ uint32_t syncsafe32 (uint32_t x)
 {
     return (x & 0x7f) | ((x & 0x3f80) << 1) | ((x & 0x1fc000) << 2) | ((x & 0xfe00000) << 3);
 }
+
+bool TagProbe::read (VFSFile & file)
+{
+    head.clear ();
+    tail.clear ();
+
+    if (file.fseek (0, VFS_SEEK_SET))
+        return false;
+
+    head.resize (HeadSize);
+    head.resize (aud::max (file.fread (head.begin (), 1, HeadSize), (int64_t) 0));
+
+    size = file.fsize ();
+
+    /* a short read means that the whole file is buffered */
+    if (size < 0 && head.len () < HeadSize)
+        size = head.len ();
+
+    int64_t tail_len = aud::min (size - head.len (), (int64_t) TailSize);
+
+    if (tail_len > 0)
+    {
+        tail.resize (tail_len);
+
+        if (file.fseek (size - tail_len, VFS_SEEK_SET) ||
+         file.fread (tail.begin (), 1, tail_len) != tail_len)
+            tail.clear ();
+    }
+
+    AUDDBG ("Probed %s: size = %d, head = %d, tail = %d.\n", file.filename (),
+     (int) size, head.len (), tail.len ());
+
+    return true;
+}
+
+const char * TagProbe::find (int64_t offset, int64_t len) const
+{
+    if (offset < 0 || len < 0)
+        return nullptr;
+
+    if (offset + len <= head.len ())
+        return head.begin () + offset;
+
+    int64_t tail_start = size - tail.len ();
+
+    if (tail.len () && offset >= tail_start && offset + len <= size)
+        return tail.begin () + (offset - tail_start);
+
+    return nullptr;
+}
+
+bool TagProbe::read_at (VFSFile & file, int64_t offset, void * buf, int64_t len) const
+{
+    if (offset < 0)
+    {
+        if (size < 0)
+            return ! file.fseek (offset, VFS_SEEK_END) &&
+             file.fread (buf, 1, len) == len;
+
+        if ((offset += size) < 0)
+            return false;
+    }
+
+    if (const char * buffered = find (offset, len))
+    {
+        memcpy (buf, buffered, len);
+        return true;
+    }
+
+    return ! file.fseek (offset, VFS_SEEK_SET) && file.fread (buf, 1, len) == len;
+}
+
+bool write_padding (VFSFile & file, int64_t size)
+{
+    char zeros[4096];
+    memset (zeros, 0, sizeof zeros);
+
+    while (size > 0)
+    {
+        int64_t chunk = aud::min (size, (int64_t) sizeof zeros);
+        if (file.fwrite (zeros, 1, chunk) != chunk)
+            return false;
+
+        size -= chunk;
+    }
+
+    return true;
+}
+
+/* the file itself, rather than a symlink to it */
+static StringBuf get_real_path (const char * filename)
+{
+    StringBuf path = uri_to_filename (filename);
+
+#ifndef _WIN32
+    char * real = path ? realpath (path, nullptr) : nullptr;
+    if (real)
+    {
+        path = str_copy (real);
+        free (real);
+    }
+#endif
+
+    return path;
+}
+
+/* Renaming a new file over the original would split hard links and lose any
+ * extended attributes, so copy it back into the original instead. */
+static bool can_rename_over (const char * path, const GStatBuf & st)
+{
+    if (st.st_nlink > 1)
+        return false;
+
+#ifdef __linux__
+    /* attributes in the security namespace (SELinux labels and the like) are
+     * given to the new file by the system */
+    ssize_t len = listxattr (path, nullptr, 0);
+    if (len > 0)
+    {
+        StringBuf names (len);
+        len = listxattr (path, names, len);
+
+        if (len < 0)
+            return false;
+
+        for (const char * name = names; name < names + len;
+         name += strlen (name) + 1)
+        {
+            if (strncmp (name, "security.", 9))
+                return false;
+        }
+    }
+#endif
+
+    return true;
+}
+
+/* keeps the owner, group, and permissions of the original */
+static bool copy_owner (int fd, const char * temp, const GStatBuf & st)
+{
+#ifndef _WIN32
+    if (fchown (fd, st.st_uid, st.st_gid) < 0)
+        return false;
+#endif
+
+    g_chmod (temp, st.st_mode & 07777);
+    return true;
+}
+
+ReplacementFile::ReplacementFile (VFSFile & orig) :
+    m_orig (orig)
+{
+    StringBuf path = get_real_path (orig.filename ());
+    GStatBuf st;
+
+    if (path && g_stat (path, & st) == 0 && can_rename_over (path, st))
+    {
+        StringBuf temp = str_concat ({path, ".XXXXXX"});
+        int fd = g_mkstemp (temp);
+
+        if (fd >= 0)
+        {
+            /* fails for another user's file in a folder we can write to */
+            bool owned = copy_owner (fd, temp, st);
+            close (fd);
+
+            if (owned)
+            {
+                m_file = VFSFile (filename_to_uri (temp), "w");
+
+                if (m_file)
+                {
+                    m_path = String (path);
+                    m_temp_path = String (temp);
+                    return;
+                }
+            }
+
+            g_unlink (temp);
+        }
+    }
+
+    m_file = VFSFile::tmpfile ();
+}
+
+ReplacementFile::~ReplacementFile ()
+{
+    if (m_temp_path)
+    {
+        m_file = VFSFile ();
+        g_unlink (m_temp_path);
+    }
+}
+
+bool ReplacementFile::commit ()
+{
+    if (m_file.fflush () != 0)
+        return false;
+
+    if (! m_temp_path)
+        return m_orig.replace_with (m_file);
+
+    m_file = VFSFile ();
+
+    if (g_rename (m_temp_path, m_path) == 0)
+    {
+        AUDDBG ("Replaced %s.\n", (const char *) m_path);
+        m_temp_path = String ();
+        return true;
+    }
+
+    /* renaming over an open file fails on some systems */
+    AUDDBG ("Cannot rename %s, copying instead.\n", (const char *) m_temp_path);
+
+    VFSFile temp (filename_to_uri (m_temp_path), "r");
+    return temp && m_orig.replace_with (temp);
+}
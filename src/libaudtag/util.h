@@ -22,6 +22,8 @@
 
 #include <stdint.h>
 
+#include <libaudcore/vfs.h>
+
 enum {
     GENRE_BLUES = 0,
     GENRE_CLASSIC_ROCK,
@@ -155,4 +157,55 @@ const char *convert_numericgenre_to_text(int numericgenre);
 uint32_t unsyncsafe32 (uint32_t x);
 uint32_t syncsafe32 (uint32_t x);
 
+/* The first and last few KB of a file, read once and shared by all the tag
+ * modules, so that looking for each kind of tag (and then reading its header
+ * again) does not cost another round of seeks and reads. */
+struct TagProbe
+{
+    static constexpr int HeadSize = 8192;
+    static constexpr int TailSize = 4096;
+
+    int64_t size = -1; /* -1 if unknown */
+    Index<char> head, tail;
+
+    /* fails if the file is not seekable */
+    bool read (VFSFile & file);
+
+    /* returns the buffered data at <offset>, or nullptr if not all of the
+     * <len> bytes are buffered */
+    const char * find (int64_t offset, int64_t len) const;
+
+    /* copies <len> bytes at <offset> (from the end of the file if negative)
+     * into <buf>, reading from the file only if they were not buffered; the
+     * file position is undefined afterwards */
+    bool read_at (VFSFile & file, int64_t offset, void * buf, int64_t len) const;
+};
+
+/* writes <size> zero bytes */
+bool write_padding (VFSFile & file, int64_t size);
+
+/* A new file that takes the place of an existing one once it is complete.  For
+ * local files, it is created in the same folder and then renamed over the
+ * original (following any symlinks), so that the audio data is written only
+ * once and the original is left intact if anything goes wrong.  Otherwise (or
+ * if the rename fails, or would lose hard links, extended attributes, or the
+ * owner of the original), it is a temporary file, which is copied over the
+ * original. */
+class ReplacementFile
+{
+public:
+    explicit ReplacementFile (VFSFile & orig);
+    ~ReplacementFile ();
+
+    explicit operator bool () const { return (bool) m_file; }
+    VFSFile & file () { return m_file; }
+
+    bool commit ();
+
+private:
+    VFSFile & m_orig;
+    String m_path, m_temp_path;
+    VFSFile m_file;
+};
+
 #endif /* TAGUTIL_H */
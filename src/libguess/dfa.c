@@ -46,15 +46,28 @@ dfa_top(guess_dfa *order[])
     return top;
 }
 
+/* Advances all live DFAs by one byte.  The number of live DFAs is kept as
+ * they are advanced, rather than asking dfa_alone() for each of them, which
+ * made every byte cost quadratic time in the number of candidates.  The
+ * result is the same: a DFA wins as soon as it is the only one left when its
+ * turn comes. */
 const char *
 dfa_process(guess_dfa *order[], int c)
 {
-    int i;
+    int i, alive = 0;
+
+    for (i = 0; order[i] != NULL; i++) {
+        if (DFA_ALIVE_P(order[i]))
+            alive++;
+    }
+
     for (i = 0; order[i] != NULL; i++) {
         if (DFA_ALIVE_P(order[i])) {
-            if (dfa_alone(order[i], order))
+            if (alive == 1)
                 return order[i]->name;
             DFA_NEXT_P(order[i], c);
+            if (!DFA_ALIVE_P(order[i]))
+                alive--;
         }
     }
 